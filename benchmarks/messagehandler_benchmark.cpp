@@ -0,0 +1,203 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares sending tag reader messages over a QLocalSocket with sending them
+// through a SharedMemoryDevice.  Both ends run in this process, so it measures
+// the cost of the transport rather than of starting workers.
+//
+// Usage: messagehandler_benchmark [message count]
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStringList>
+#include <QTime>
+
+#include <cstdio>
+
+#include "core/logging.h"
+#include "core/messagehandler.h"
+#include "core/sharedmemorydevice.h"
+#include "tagreadermessages.pb.h"
+
+namespace {
+
+typedef AbstractMessageHandler<pb::tagreader::Message> Handler;
+
+const int kDefaultMessageCount = 2000;
+const int kTimeoutMsec = 60000;
+
+// Replies to every request with a LoadEmbeddedArtResponse of a fixed size,
+// like the tag reader does when it's asked for album art.
+class EchoHandler : public Handler {
+ public:
+  EchoHandler(QIODevice* device, int reply_size)
+      : Handler(device, nullptr), data_(reply_size, 'x') {}
+
+ protected:
+  void MessageArrived(const pb::tagreader::Message& message) {
+    pb::tagreader::Message reply;
+    reply.mutable_load_embedded_art_response()->set_data(data_.constData(),
+                                                         data_.size());
+    SendReply(message, &reply);
+  }
+
+ private:
+  QByteArray data_;
+};
+
+// A connected pair of devices, one for each end.
+struct Connection {
+  Connection()
+      : server_socket(nullptr),
+        server_device(nullptr),
+        client_device(nullptr) {}
+
+  QLocalServer server;
+  QLocalSocket client_socket;
+  QLocalSocket* server_socket;
+
+  QIODevice* server_device;
+  QIODevice* client_device;
+};
+
+bool Connect(bool shared_memory, Connection* c) {
+  const QString name = QString("messagehandler_benchmark_%1")
+                           .arg(QCoreApplication::applicationPid());
+  QLocalServer::removeServer(name);
+  if (!c->server.listen(name)) return false;
+
+  c->client_socket.connectToServer(name);
+  if (!c->client_socket.waitForConnected(1000) ||
+      !c->server.waitForNewConnection(1000)) {
+    return false;
+  }
+  c->server_socket = c->server.nextPendingConnection();
+
+  if (!shared_memory) {
+    c->server_device = c->server_socket;
+    c->client_device = &c->client_socket;
+    return true;
+  }
+
+  c->server_device =
+      SharedMemoryDevice::Create(c->server_socket, c->server_socket);
+  c->client_device =
+      SharedMemoryDevice::Receive(&c->client_socket, &c->client_socket);
+  return c->server_device && c->client_device;
+}
+
+bool WaitFor(Handler::ReplyType* reply) {
+  QTime t;
+  t.start();
+  while (!reply->is_finished()) {
+    if (t.elapsed() > kTimeoutMsec) return false;
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+  }
+  return true;
+}
+
+Handler::ReplyType* NewRequest(int id) {
+  pb::tagreader::Message message;
+  message.set_id(id);
+  message.mutable_load_embedded_art_request()->set_filename(
+      "/music/Artist/Album/01 - Title.flac");
+  return new Handler::ReplyType(message);
+}
+
+void Run(bool shared_memory, int reply_size, int count) {
+  const char* transport = shared_memory ? "shared memory" : "socket";
+
+  Connection c;
+  if (!Connect(shared_memory, &c)) {
+    printf("%-14s %9d  unavailable\n", transport, reply_size);
+    return;
+  }
+
+  EchoHandler server(c.server_device, reply_size);
+  Handler client(c.client_device, nullptr);
+  QList<Handler::ReplyType*> replies;
+
+  // Throughput: send all the requests at once, like a library scan does.
+  QTime t;
+  t.start();
+  for (int i = 0; i < count; ++i) {
+    replies << NewRequest(i);
+    client.SendRequest(replies.last());
+  }
+  if (!WaitFor(replies.last())) {
+    // The handler aborts the replies that are still pending.
+    printf("%-14s %9d  timed out\n", transport, reply_size);
+    return;
+  }
+  const int throughput_msec = qMax(1, t.elapsed());
+
+  qDeleteAll(replies);
+  replies.clear();
+
+  // Latency: send one request at a time and wait for each reply.
+  t.restart();
+  for (int i = 0; i < count; ++i) {
+    Handler::ReplyType* reply = NewRequest(count + i);
+    client.SendRequest(reply);
+    if (!WaitFor(reply)) {
+      printf("%-14s %9d  timed out\n", transport, reply_size);
+      return;
+    }
+    delete reply;
+  }
+  const int latency_msec = t.elapsed();
+
+  const double messages_per_sec = count * 1000.0 / throughput_msec;
+  const double mb_per_sec =
+      double(reply_size) * count / (1024 * 1024) * 1000.0 / throughput_msec;
+  const double usec_per_round_trip = latency_msec * 1000.0 / count;
+
+  printf("%-14s %9d  %10.0f  %8.1f  %10.1f\n", transport, reply_size,
+         messages_per_sec, mb_per_sec, usec_per_round_trip);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  QCoreApplication a(argc, argv);
+
+  logging::Init();
+  logging::SetLevels("*:1");
+
+  int count = kDefaultMessageCount;
+  if (a.arguments().count() > 1) {
+    count = qMax(1, a.arguments()[1].toInt());
+  }
+
+  printf("%d messages per run\n\n", count);
+  printf("%-14s %9s  %10s  %8s  %10s\n", "transport", "bytes", "msgs/sec",
+         "MB/sec", "usec/rtt");
+
+  // From a tiny reply up to a large piece of embedded album art.
+  const int kReplySizes[] = {64, 4 * 1024, 64 * 1024, 512 * 1024,
+                             4 * 1024 * 1024};
+
+  for (int reply_size : kReplySizes) {
+    // Fewer messages for the big sizes so the run doesn't take forever.
+    const int n = reply_size > 64 * 1024 ? qMax(1, count / 20) : count;
+    Run(false, reply_size, n);
+    Run(true, reply_size, n);
+  }
+
+  return 0;
+}
@@ -0,0 +1,338 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Generates a synthetic library, scans it with a LibraryWatcher into a
+// MemoryDatabase, and reports how long everything took.
+//
+// Usage: scan_benchmark [options]
+//   --artists N          Number of artists (default 10)
+//   --albums N           Albums per artist (default 5)
+//   --tracks N           Tracks per album (default 10)
+//   --cue-interval N     Every Nth album is a CUE sheet - 0 for none
+//                        (default 10)
+//   --cover-size N       Size of cover.jpg in pixels, 0 for none (default 500)
+//   --modify-percent N   Tracks changed before the last scan (default 5)
+//   --rpc-samples N      Tag reader requests timed at the end (default 200)
+//   --library DIR        Generate the library here and keep it afterwards
+//   --generate-only      Stop after generating the library
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSettings>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+#include <sys/resource.h>
+
+#include "syntheticlibrary.h"
+#include "timedlibrarybackend.h"
+#include "core/database.h"
+#include "core/logging.h"
+#include "core/metatypes.h"
+#include "core/tagreaderclient.h"
+#include "core/taskmanager.h"
+#include "core/utilities.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/librarywatcher.h"
+
+namespace {
+
+const int kScanTimeoutMsec = 30 * 60 * 1000;
+const int kRpcTimeoutMsec = 60 * 1000;
+
+struct Options {
+  Options() : modify_percent(5), rpc_samples(200), generate_only(false) {}
+
+  SyntheticLibrary::Options library;
+  int modify_percent;
+  int rpc_samples;
+  QString library_dir;
+  bool generate_only;
+};
+
+bool ParseArguments(const QStringList& args, Options* options) {
+  QMap<QString, int*> numbers;
+  numbers["--artists"] = &options->library.artists;
+  numbers["--albums"] = &options->library.albums_per_artist;
+  numbers["--tracks"] = &options->library.tracks_per_album;
+  numbers["--cue-interval"] = &options->library.cue_album_interval;
+  numbers["--cover-size"] = &options->library.cover_size;
+  numbers["--modify-percent"] = &options->modify_percent;
+  numbers["--rpc-samples"] = &options->rpc_samples;
+
+  for (int i = 1; i < args.count(); ++i) {
+    const QString& arg = args[i];
+    if (arg == "--generate-only") {
+      options->generate_only = true;
+      continue;
+    }
+
+    if (i + 1 >= args.count()) return false;
+    const QString value = args[++i];
+
+    if (arg == "--library") {
+      options->library_dir = value;
+      continue;
+    }
+
+    bool ok = false;
+    const int number = value.toInt(&ok);
+    if (!ok || number < 0 || !numbers.contains(arg)) return false;
+
+    *numbers[arg] = number;
+  }
+  return true;
+}
+
+double Msec(qint64 nsec) { return nsec / 1000000.0; }
+
+// Peak resident set size in KB.  Linux reports ru_maxrss in KB already.
+long PeakRss(int who) {
+  rusage usage;
+  if (getrusage(who, &usage) != 0) return 0;
+#ifdef Q_OS_MAC
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+int CountSongs(Database* db, const QString& table) {
+  QMutexLocker l(db->Mutex());
+  QSqlDatabase connection(db->Connect());
+  QSqlQuery q(QString("SELECT COUNT(*) FROM %1 WHERE unavailable = 0")
+                  .arg(table),
+              connection);
+  q.exec();
+  return q.next() ? q.value(0).toInt() : 0;
+}
+
+// Waits until the backend has written the results of another scan.
+bool WaitForScan(TimedLibraryBackend* timed, int scans_before) {
+  QElapsedTimer t;
+  t.start();
+  while (timed->scans_finished() <= scans_before) {
+    if (t.elapsed() > kScanTimeoutMsec) return false;
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+  }
+  return true;
+}
+
+void PrintScan(const char* name, qint64 nsec, int files,
+               TimedLibraryBackend* timed) {
+  const double secs = nsec / 1e9;
+  printf("%-22s %9.1f ms  %9.0f files/sec\n", name, Msec(nsec),
+         secs > 0 ? files / secs : 0.0);
+  printf("  database writes      %9.1f ms  (%d AddOrUpdateSongs calls, "
+         "%d songs, %.1f ms)\n",
+         Msec(timed->total_nsec()), timed->add_or_update_calls(),
+         timed->add_or_update_songs(), Msec(timed->add_or_update_nsec()));
+  printf("                                     (unavailable %.1f ms, "
+         "other %.1f ms)\n",
+         Msec(timed->mark_unavailable_nsec()), Msec(timed->other_nsec()));
+}
+
+// Adding the directory to the backend starts a full scan, otherwise an
+// incremental scan is started on the watcher.
+bool TimeScan(const char* name, int files, TimedLibraryBackend* timed,
+              LibraryBackend* backend, LibraryWatcher* watcher,
+              const QString& add_directory) {
+  timed->Reset();
+  const int scans_before = timed->scans_finished();
+
+  QElapsedTimer t;
+  t.start();
+  if (!add_directory.isEmpty()) {
+    backend->AddDirectory(add_directory);
+  } else {
+    watcher->IncrementalScanAsync();
+  }
+
+  if (!WaitForScan(timed, scans_before)) {
+    printf("%-22s timed out\n", name);
+    return false;
+  }
+
+  PrintScan(name, t.nsecsElapsed(), files, timed);
+  return true;
+}
+
+// Sends requests to the tag reader one at a time and prints percentiles of
+// how long they took.
+void TimeRpc(const char* name, TagReaderClient* client,
+             const QStringList& files, int samples, int batch_size) {
+  QList<qint64> latencies;
+
+  for (int i = 0; i < samples && !files.isEmpty(); ++i) {
+    QStringList batch;
+    for (int j = 0; j < batch_size; ++j) {
+      batch << files[(i * batch_size + j) % files.count()];
+    }
+
+    QElapsedTimer t;
+    t.start();
+    TagReaderReply* reply = batch_size == 1 ? client->ReadFile(batch[0])
+                                            : client->ReadFiles(batch);
+    while (!reply->is_finished() && t.elapsed() < kRpcTimeoutMsec) {
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+    }
+    latencies << t.nsecsElapsed();
+    reply->deleteLater();
+  }
+
+  if (latencies.isEmpty()) return;
+  std::sort(latencies.begin(), latencies.end());
+
+  const auto percentile = [&latencies](int p) {
+    return Msec(latencies[qMin(latencies.count() - 1,
+                               latencies.count() * p / 100)]);
+  };
+
+  printf("%-22s p50 %7.2f ms  p90 %7.2f ms  p99 %7.2f ms  max %7.2f ms\n",
+         name, percentile(50), percentile(90), percentile(99),
+         Msec(latencies.last()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  QCoreApplication a(argc, argv);
+  a.setOrganizationName("Clementine");
+  a.setApplicationName("clementine-benchmark");
+
+  logging::Init();
+  logging::SetLevels("*:1");
+  RegisterMetaTypes();
+
+  Options options;
+  if (!ParseArguments(a.arguments(), &options)) {
+    fprintf(stderr, "Invalid arguments - see the top of scan_benchmark.cpp\n");
+    return 1;
+  }
+
+#ifdef TAGREADER_BUILD_DIR
+  // Let WorkerPool find the tag reader in the build tree.
+  qputenv("PATH", TAGREADER_BUILD_DIR ":" + qgetenv("PATH"));
+#endif
+
+  // Scan exactly when we're told to, and don't let the file watcher start
+  // rescans of its own.
+  {
+    QSettings s;
+    s.beginGroup(LibraryWatcher::kSettingsGroup);
+    s.setValue("startup_scan", true);
+    s.setValue("monitor", false);
+  }
+
+  // Generate the library.
+  const bool keep_library = !options.library_dir.isEmpty();
+  const QString root = keep_library ? options.library_dir
+                                    : Utilities::MakeTempDir("scan_benchmark");
+
+  SyntheticLibrary library(root, options.library);
+
+  QElapsedTimer t;
+  t.start();
+  if (!library.Generate()) return 1;
+  printf("Generated %d files (%d songs) in %s in %.1f ms\n\n",
+         library.media_files().count(), library.expected_song_count(),
+         qPrintable(root), Msec(t.nsecsElapsed()));
+
+  if (options.generate_only) return 0;
+
+  // Set everything up like Library and Application do, except the backend
+  // lives in this thread so we can time it.
+  std::unique_ptr<TagReaderClient> client(new TagReaderClient);
+  client->Start();
+
+  std::shared_ptr<Database> database(new MemoryDatabase(nullptr));
+  LibraryBackend backend;
+  backend.Init(database.get(), Library::kSongsTable, Library::kDirsTable,
+               Library::kSubdirsTable, Library::kFtsTable,
+               Library::kFullScanProgressTable);
+
+  TaskManager task_manager;
+  TimedLibraryBackend timed(&backend);
+
+  QThread watcher_thread;
+  LibraryWatcher* watcher = new LibraryWatcher;
+  watcher->moveToThread(&watcher_thread);
+  watcher->set_backend(&backend);
+  watcher->set_task_manager(&task_manager);
+  timed.Connect(watcher);
+  watcher_thread.start(QThread::IdlePriority);
+
+  // The first full scan also pays for starting the tag reader workers.
+  bool ok = TimeScan("Full scan", library.media_files().count(), &timed,
+                     &backend, watcher, root);
+
+  if (ok) {
+    printf("  songs in database    %9d  (expected %d)\n\n",
+           CountSongs(database.get(), Library::kSongsTable),
+           library.expected_song_count());
+
+    ok = TimeScan("Unchanged rescan", library.media_files().count(), &timed,
+                  &backend, watcher, QString());
+    printf("\n");
+  }
+
+  if (ok) {
+    const int changed = library.Modify(options.modify_percent);
+    ok = TimeScan("Incremental rescan", changed, &timed, &backend, watcher,
+                  QString());
+    printf("  files changed        %9d\n", changed);
+    printf("  songs in database    %9d  (expected %d)\n\n",
+           CountSongs(database.get(), Library::kSongsTable),
+           library.expected_song_count());
+  }
+
+  if (ok) {
+    TimeRpc("ReadFile", client.get(), library.media_files(),
+            options.rpc_samples, 1);
+    TimeRpc("ReadFiles", client.get(), library.media_files(),
+            qMax(1, options.rpc_samples / TagReaderClient::kReadFilesBatchSize),
+            TagReaderClient::kReadFilesBatchSize);
+    printf("\n");
+  }
+
+  printf("Peak RSS               %9ld KB\n", PeakRss(RUSAGE_SELF));
+
+  // The thread's event loop has stopped by the time it's joined, so the
+  // watcher can't be deleted later - delete it here instead.
+  watcher->Stop();
+  watcher_thread.exit();
+  watcher_thread.wait();
+  delete watcher;
+
+  // Destroying the client waits for the workers to exit, after which their
+  // peak RSS is available too.
+  client.reset();
+  printf("Peak worker RSS        %9ld KB\n", PeakRss(RUSAGE_CHILDREN));
+
+  if (!keep_library) {
+    Utilities::RemoveRecursive(root);
+  }
+
+  return ok ? 0 : 1;
+}
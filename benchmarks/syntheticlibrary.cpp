@@ -0,0 +1,294 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "syntheticlibrary.h"
+
+#include <QColor>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <QSet>
+#include <QTextStream>
+
+#include <fileref.h>
+#include <tag.h>
+
+#include <utime.h>
+
+#include "core/logging.h"
+
+namespace {
+
+const char* kFormats[] = {"mp3", "flac", "ogg"};
+const int kFormatCount = 3;
+
+const char* kGenres[] = {"Rock", "Jazz", "Electronic", "Classical", "Folk",
+                         "Hip-Hop"};
+const int kGenreCount = 6;
+
+// How far in the past generated files are dated.
+const int kAgeSecs = 24 * 60 * 60;
+
+// CUE sheet tracks are this many frames (1/75ths of a second) apart, so they
+// all fit inside the short beep file.
+const int kCueTrackFrames = 2;
+
+TagLib::String ToTagLibString(const QString& s) {
+  return TagLib::String(s.toUtf8().constData(), TagLib::String::UTF8);
+}
+
+QString ArtistName(int artist) {
+  return QString("Artist %1").arg(artist + 1, 3, 10, QChar('0'));
+}
+
+QString AlbumName(int album) {
+  return QString("Album %1").arg(album + 1, 3, 10, QChar('0'));
+}
+
+QString TrackTitle(int track) {
+  return QString("Track %1").arg(track + 1, 2, 10, QChar('0'));
+}
+
+QString CueTime(int frames) {
+  return QString("%1:%2:%3")
+      .arg(frames / (75 * 60), 2, 10, QChar('0'))
+      .arg((frames / 75) % 60, 2, 10, QChar('0'))
+      .arg(frames % 75, 2, 10, QChar('0'));
+}
+
+void SetMTime(const QString& path, time_t mtime) {
+  utimbuf times;
+  times.actime = mtime;
+  times.modtime = mtime;
+  utime(QFile::encodeName(path).constData(), &times);
+}
+
+}  // namespace
+
+SyntheticLibrary::SyntheticLibrary(const QString& root, const Options& options)
+    : root_(root),
+      options_(options),
+      expected_song_count_(0),
+      modify_count_(0) {
+  Q_INIT_RESOURCE(testdata);
+}
+
+bool SyntheticLibrary::Generate() {
+  media_files_.clear();
+  retaggable_files_.clear();
+  expected_song_count_ = 0;
+
+  if (!QDir().mkpath(root_)) {
+    qLog(Error) << "Couldn't create" << root_;
+    return false;
+  }
+
+  for (int artist = 0; artist < options_.artists; ++artist) {
+    for (int album = 0; album < options_.albums_per_artist; ++album) {
+      if (!WriteAlbum(artist, album)) return false;
+    }
+  }
+
+  AgeFiles(root_);
+  return true;
+}
+
+int SyntheticLibrary::Modify(int percent) {
+  int ret = 0;
+
+  // Retag every nth track.
+  if (percent > 0 && !retaggable_files_.isEmpty()) {
+    const int interval = qMax(1, 100 / percent);
+    QSet<QString> touched_dirs;
+
+    for (int i = 0; i < retaggable_files_.count(); i += interval) {
+      const QString& filename = retaggable_files_[i];
+      TagLib::FileRef ref(QFile::encodeName(filename).constData());
+      if (ref.isNull() || !ref.tag()) continue;
+
+      ref.tag()->setTitle(
+          ToTagLibString(QString("%1 (edit %2)")
+                             .arg(QFileInfo(filename).completeBaseName())
+                             .arg(modify_count_ + 1)));
+      if (ref.save()) {
+        ++ret;
+        touched_dirs << QFileInfo(filename).path();
+      }
+    }
+
+    // Saving tags doesn't change the directory's mtime, but something that
+    // edits tags in place would have been noticed by the file watcher.  Make
+    // sure the incremental scan looks at these directories too.
+    const time_t now = QDateTime::currentDateTime().toTime_t();
+    for (const QString& dir : touched_dirs) {
+      SetMTime(dir, now);
+    }
+  }
+
+  // Add a new album to the first artist.
+  const int songs_before = expected_song_count_;
+  if (WriteAlbum(0, options_.albums_per_artist + modify_count_)) {
+    ret += expected_song_count_ - songs_before;
+  }
+
+  ++modify_count_;
+  return ret;
+}
+
+bool SyntheticLibrary::WriteAlbum(int artist, int album) {
+  const QString dir = root_ + "/" + ArtistName(artist) + "/" + AlbumName(album);
+  if (!QDir().mkpath(dir)) {
+    qLog(Error) << "Couldn't create" << dir;
+    return false;
+  }
+
+  const int album_index = artist * options_.albums_per_artist + album;
+
+  if (options_.cover_size > 0 && !WriteCover(dir, album_index)) {
+    return false;
+  }
+
+  if (options_.cue_album_interval > 0 &&
+      album_index % options_.cue_album_interval ==
+          options_.cue_album_interval - 1) {
+    return WriteCueAlbum(dir, artist, album);
+  }
+
+  const QString format = kFormats[album_index % kFormatCount];
+  for (int track = 0; track < options_.tracks_per_album; ++track) {
+    const QString filename =
+        QString("%1/%2 - %3.%4")
+            .arg(dir)
+            .arg(track + 1, 2, 10, QChar('0'))
+            .arg(TrackTitle(track), format);
+
+    if (!WriteTrack(filename, format, artist, album, track,
+                    TrackTitle(track))) {
+      return false;
+    }
+
+    media_files_ << filename;
+    retaggable_files_ << filename;
+    ++expected_song_count_;
+  }
+
+  return true;
+}
+
+bool SyntheticLibrary::WriteCueAlbum(const QString& dir, int artist,
+                                     int album) {
+  const QString basename = AlbumName(album);
+  const QString audio_filename = dir + "/" + basename + ".flac";
+
+  if (!WriteTrack(audio_filename, "flac", artist, album, 0, basename)) {
+    return false;
+  }
+  media_files_ << audio_filename;
+
+  QFile cue(dir + "/" + basename + ".cue");
+  if (!cue.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    qLog(Error) << "Couldn't write" << cue.fileName();
+    return false;
+  }
+
+  QTextStream s(&cue);
+  s.setCodec("UTF-8");
+  s << "PERFORMER \"" << ArtistName(artist) << "\"\n";
+  s << "TITLE \"" << basename << "\"\n";
+  s << "FILE \"" << basename << ".flac\" WAVE\n";
+  for (int track = 0; track < options_.tracks_per_album; ++track) {
+    s << QString("  TRACK %1 AUDIO\n").arg(track + 1, 2, 10, QChar('0'));
+    s << "    TITLE \"" << TrackTitle(track) << "\"\n";
+    s << "    PERFORMER \"" << ArtistName(artist) << "\"\n";
+    s << "    INDEX 01 " << CueTime(track * kCueTrackFrames) << "\n";
+  }
+
+  expected_song_count_ += options_.tracks_per_album;
+  return true;
+}
+
+bool SyntheticLibrary::WriteCover(const QString& dir, int album) {
+  // A different colour for each album so the images don't all compress the
+  // same way.
+  QImage image(options_.cover_size, options_.cover_size, QImage::Format_RGB32);
+  image.fill(QColor::fromHsv((album * 37) % 360, 200, 200).rgb());
+
+  QPainter p(&image);
+  p.setPen(Qt::white);
+  for (int i = 0; i < options_.cover_size; i += 16) {
+    p.drawLine(0, i, i, 0);
+  }
+  p.end();
+
+  const QString filename = dir + "/cover.jpg";
+  if (!image.save(filename, "JPG")) {
+    qLog(Error) << "Couldn't write" << filename;
+    return false;
+  }
+  return true;
+}
+
+bool SyntheticLibrary::WriteTrack(const QString& filename,
+                                  const QString& format, int artist, int album,
+                                  int track, const QString& title) {
+  // Start with a copy of the beep file, then replace its tags.
+  QFile::remove(filename);
+  if (!QFile::copy(":/testdata/beep." + format, filename) ||
+      !QFile::setPermissions(filename, QFile::ReadOwner | QFile::WriteOwner |
+                                           QFile::ReadGroup |
+                                           QFile::ReadOther)) {
+    qLog(Error) << "Couldn't write" << filename;
+    return false;
+  }
+
+  TagLib::FileRef ref(QFile::encodeName(filename).constData());
+  if (ref.isNull() || !ref.tag()) {
+    qLog(Error) << "TagLib couldn't open" << filename;
+    return false;
+  }
+
+  TagLib::Tag* tag = ref.tag();
+  tag->setArtist(ToTagLibString(ArtistName(artist)));
+  tag->setAlbum(ToTagLibString(AlbumName(album)));
+  tag->setTitle(ToTagLibString(title));
+  tag->setTrack(track + 1);
+  tag->setYear(1970 + (artist * 7 + album) % 45);
+  tag->setGenre(kGenres[(artist + album) % kGenreCount]);
+
+  if (!ref.save()) {
+    qLog(Error) << "TagLib couldn't save" << filename;
+    return false;
+  }
+  return true;
+}
+
+void SyntheticLibrary::AgeFiles(const QString& path) {
+  const time_t mtime = QDateTime::currentDateTime().toTime_t() - kAgeSecs;
+
+  // Do the children first - changing their mtimes doesn't touch the
+  // directory's, but it's easier not to have to think about it.
+  QDirIterator it(path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden,
+                  QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    SetMTime(it.next(), mtime);
+  }
+  SetMTime(path, mtime);
+}
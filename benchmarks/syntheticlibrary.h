@@ -0,0 +1,95 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNTHETICLIBRARY_H
+#define SYNTHETICLIBRARY_H
+
+#include <QString>
+#include <QStringList>
+
+// Generates a directory tree that looks like a music library:
+//   root/Artist 001/Album 001/01 - Track 01.mp3
+// The files are copies of the tiny beep files in the test data with their tags
+// rewritten, so they're valid enough for TagLib and the tag reader.  Albums
+// rotate between MP3, FLAC and Ogg Vorbis.  Some albums can be a single FLAC
+// file with a CUE sheet instead, and every album can have a cover image.
+//
+// Every file and directory is given an mtime in the past, so that a later
+// Modify() is always noticed by an incremental scan.
+class SyntheticLibrary {
+ public:
+  struct Options {
+    Options()
+        : artists(10),
+          albums_per_artist(5),
+          tracks_per_album(10),
+          cue_album_interval(10),
+          cover_size(500) {}
+
+    int artists;
+    int albums_per_artist;
+    int tracks_per_album;
+
+    // Every nth album is a single file with a CUE sheet.  0 disables them.
+    int cue_album_interval;
+
+    // The width and height of cover.jpg in each album.  0 disables covers.
+    int cover_size;
+  };
+
+  SyntheticLibrary(const QString& root, const Options& options = Options());
+
+  const QString& root() const { return root_; }
+
+  // Every media file that was written, including the files that CUE sheets
+  // point to.
+  const QStringList& media_files() const { return media_files_; }
+
+  // The number of songs a scan should find - CUE sheets count once per track.
+  int expected_song_count() const { return expected_song_count_; }
+
+  // Writes the library.  Returns false if anything couldn't be written.
+  bool Generate();
+
+  // Retags roughly percent% of the tracks and adds one new album, updating
+  // the mtimes of everything that changed.  Returns the number of files that
+  // were changed or added.
+  int Modify(int percent);
+
+ private:
+  bool WriteAlbum(int artist, int album);
+  bool WriteCueAlbum(const QString& dir, int artist, int album);
+  bool WriteCover(const QString& dir, int album);
+
+  bool WriteTrack(const QString& filename, const QString& format, int artist,
+                  int album, int track, const QString& title);
+
+  // Sets the mtime of everything under root_ to a time in the past.
+  void AgeFiles(const QString& path);
+
+ private:
+  QString root_;
+  Options options_;
+
+  QStringList media_files_;
+  // Files with their own tags - everything except CUE sheet images.
+  QStringList retaggable_files_;
+  int expected_song_count_;
+  int modify_count_;
+};
+
+#endif  // SYNTHETICLIBRARY_H
@@ -0,0 +1,131 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "timedlibrarybackend.h"
+
+#include <QElapsedTimer>
+
+#include "library/librarybackend.h"
+#include "library/librarywatcher.h"
+
+TimedLibraryBackend::TimedLibraryBackend(LibraryBackend* backend,
+                                         QObject* parent)
+    : QObject(parent), backend_(backend), scans_finished_(0) {
+  Reset();
+}
+
+void TimedLibraryBackend::Connect(LibraryWatcher* watcher) {
+  connect(backend_, SIGNAL(DirectoryDiscovered(Directory, SubdirectoryList)),
+          watcher, SLOT(AddDirectory(Directory, SubdirectoryList)));
+  connect(backend_, SIGNAL(DirectoryDeleted(Directory)), watcher,
+          SLOT(RemoveDirectory(Directory)));
+
+  connect(watcher, SIGNAL(NewOrUpdatedSongs(SongList)),
+          SLOT(AddOrUpdateSongs(SongList)));
+  connect(watcher, SIGNAL(SongsMTimeUpdated(SongList)),
+          SLOT(UpdateMTimesOnly(SongList)));
+  connect(watcher, SIGNAL(SongsMoved(SongList)), SLOT(MoveSongs(SongList)));
+  connect(watcher, SIGNAL(SongsDeleted(SongList)),
+          SLOT(MarkSongsUnavailable(SongList)));
+  connect(watcher, SIGNAL(SongsReadded(SongList, bool)),
+          SLOT(MarkSongsUnavailable(SongList, bool)));
+  connect(watcher, SIGNAL(SubdirsDiscovered(SubdirectoryList)),
+          SLOT(AddOrUpdateSubdirs(SubdirectoryList)));
+  connect(watcher, SIGNAL(SubdirsMTimeUpdated(SubdirectoryList)),
+          SLOT(AddOrUpdateSubdirs(SubdirectoryList)));
+  connect(watcher, SIGNAL(CompilationsNeedUpdating()),
+          SLOT(UpdateCompilations()));
+  connect(watcher, SIGNAL(FullScanProgress(int, QStringList)),
+          SLOT(AddFullScanProgress(int, QStringList)));
+  connect(watcher, SIGNAL(FullScanFinished(int)),
+          SLOT(ClearFullScanProgress(int)));
+}
+
+void TimedLibraryBackend::Reset() {
+  add_or_update_nsec_ = 0;
+  mark_unavailable_nsec_ = 0;
+  other_nsec_ = 0;
+  add_or_update_calls_ = 0;
+  add_or_update_songs_ = 0;
+}
+
+qint64 TimedLibraryBackend::total_nsec() const {
+  return add_or_update_nsec_ + mark_unavailable_nsec_ + other_nsec_;
+}
+
+void TimedLibraryBackend::AddOrUpdateSongs(const SongList& songs) {
+  QElapsedTimer t;
+  t.start();
+  backend_->AddOrUpdateSongs(songs);
+  add_or_update_nsec_ += t.nsecsElapsed();
+
+  add_or_update_calls_++;
+  add_or_update_songs_ += songs.count();
+}
+
+void TimedLibraryBackend::UpdateMTimesOnly(const SongList& songs) {
+  QElapsedTimer t;
+  t.start();
+  backend_->UpdateMTimesOnly(songs);
+  other_nsec_ += t.nsecsElapsed();
+}
+
+void TimedLibraryBackend::MoveSongs(const SongList& songs) {
+  QElapsedTimer t;
+  t.start();
+  backend_->MoveSongs(songs);
+  other_nsec_ += t.nsecsElapsed();
+}
+
+void TimedLibraryBackend::MarkSongsUnavailable(const SongList& songs,
+                                               bool unavailable) {
+  QElapsedTimer t;
+  t.start();
+  backend_->MarkSongsUnavailable(songs, unavailable);
+  mark_unavailable_nsec_ += t.nsecsElapsed();
+}
+
+void TimedLibraryBackend::AddOrUpdateSubdirs(const SubdirectoryList& subdirs) {
+  QElapsedTimer t;
+  t.start();
+  backend_->AddOrUpdateSubdirs(subdirs);
+  other_nsec_ += t.nsecsElapsed();
+}
+
+void TimedLibraryBackend::UpdateCompilations() {
+  QElapsedTimer t;
+  t.start();
+  backend_->UpdateCompilations();
+  other_nsec_ += t.nsecsElapsed();
+
+  scans_finished_++;
+}
+
+void TimedLibraryBackend::AddFullScanProgress(int directory,
+                                              const QStringList& finished) {
+  QElapsedTimer t;
+  t.start();
+  backend_->AddFullScanProgress(directory, finished);
+  other_nsec_ += t.nsecsElapsed();
+}
+
+void TimedLibraryBackend::ClearFullScanProgress(int directory) {
+  QElapsedTimer t;
+  t.start();
+  backend_->ClearFullScanProgress(directory);
+  other_nsec_ += t.nsecsElapsed();
+}
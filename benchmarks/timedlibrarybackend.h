@@ -0,0 +1,81 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMEDLIBRARYBACKEND_H
+#define TIMEDLIBRARYBACKEND_H
+
+#include <QObject>
+
+#include "core/song.h"
+#include "library/directory.h"
+
+class LibraryBackend;
+class LibraryWatcher;
+
+// Sits between a LibraryWatcher and a LibraryBackend, forwarding everything
+// the watcher emits to the same slots Library connects it to, and adding up
+// how long the backend spends writing each kind of change to the database.
+class TimedLibraryBackend : public QObject {
+  Q_OBJECT
+
+ public:
+  TimedLibraryBackend(LibraryBackend* backend, QObject* parent = nullptr);
+
+  // Makes the same connections as Library::Init.
+  void Connect(LibraryWatcher* watcher);
+
+  // Totals in nanoseconds since the last Reset().
+  qint64 total_nsec() const;
+  qint64 add_or_update_nsec() const { return add_or_update_nsec_; }
+  qint64 mark_unavailable_nsec() const { return mark_unavailable_nsec_; }
+  qint64 other_nsec() const { return other_nsec_; }
+
+  // The number of calls and songs that went through AddOrUpdateSongs.
+  int add_or_update_calls() const { return add_or_update_calls_; }
+  int add_or_update_songs() const { return add_or_update_songs_; }
+
+  // The watcher asks for compilations to be updated at the end of every scan,
+  // after everything else it found has been sent, so this goes up by one
+  // each time a scan's results have all been written.
+  int scans_finished() const { return scans_finished_; }
+
+  void Reset();
+
+ private slots:
+  void AddOrUpdateSongs(const SongList& songs);
+  void UpdateMTimesOnly(const SongList& songs);
+  void MoveSongs(const SongList& songs);
+  void MarkSongsUnavailable(const SongList& songs, bool unavailable = true);
+  void AddOrUpdateSubdirs(const SubdirectoryList& subdirs);
+  void UpdateCompilations();
+  void AddFullScanProgress(int directory, const QStringList& finished);
+  void ClearFullScanProgress(int directory);
+
+ private:
+  LibraryBackend* backend_;
+
+  qint64 add_or_update_nsec_;
+  qint64 mark_unavailable_nsec_;
+  qint64 other_nsec_;
+
+  int add_or_update_calls_;
+  int add_or_update_songs_;
+
+  int scans_finished_;
+};
+
+#endif  // TIMEDLIBRARYBACKEND_H
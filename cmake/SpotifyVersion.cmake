@@ -1,3 +1,3 @@
 # Increment this whenever the user needs to download a new blob
 # Remember to upload and sign the new version of the blob.
-set(SPOTIFY_BLOB_VERSION 14)
+set(SPOTIFY_BLOB_VERSION 15)
@@ -58,16 +58,32 @@ CREATE TABLE device_%deviceid_songs (
   etag TEXT,
 
   performer TEXT,
-  grouping TEXT
+  grouping TEXT,
+
+  inode INTEGER
 );
 
 CREATE INDEX idx_device_%deviceid_songs_album ON device_%deviceid_songs (album);
 
 CREATE INDEX idx_device_%deviceid_songs_comp_artist ON device_%deviceid_songs (effective_compilation, artist);
 
-CREATE VIRTUAL TABLE device_%deviceid_fts USING fts3(
+CREATE INDEX idx_device_%deviceid_songs_filesize_mtime ON device_%deviceid_songs (filesize, mtime);
+
+CREATE INDEX idx_device_%deviceid_songs_avail_comp_artist_album ON device_%deviceid_songs (unavailable, effective_compilation, artist, album, year);
+
+CREATE INDEX idx_device_%deviceid_songs_avail_comp_albumartist_album ON device_%deviceid_songs (unavailable, effective_compilation, effective_albumartist, album, year);
+
+CREATE INDEX idx_device_%deviceid_songs_avail_genre_comp_artist_album ON device_%deviceid_songs (unavailable, genre, effective_compilation, artist, album);
+
+CREATE INDEX idx_device_%deviceid_songs_avail_album ON device_%deviceid_songs (unavailable, album);
+
+CREATE INDEX idx_device_%deviceid_songs_avail_composer_album ON device_%deviceid_songs (unavailable, composer, album);
+
+CREATE INDEX idx_device_%deviceid_songs_avail_year_album ON device_%deviceid_songs (unavailable, year, album);
+
+CREATE VIRTUAL TABLE device_%deviceid_fts USING fts5(
   ftstitle, ftsalbum, ftsartist, ftsalbumartist, ftscomposer, ftsperformer, ftsgrouping, ftsgenre, ftscomment,
-  tokenize=unicode
+  tokenize='unicode', prefix='2 3'
 );
 
 UPDATE devices SET schema_version=0 WHERE ROWID=%deviceid;
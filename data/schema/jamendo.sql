@@ -45,12 +45,14 @@ CREATE TABLE jamendo.songs (
   etag TEXT,
 
   performer TEXT,
-  grouping TEXT
+  grouping TEXT,
+
+  inode INTEGER
 );
 
-CREATE VIRTUAL TABLE jamendo.songs_fts USING fts3(
+CREATE VIRTUAL TABLE jamendo.songs_fts USING fts5(
   ftstitle, ftsalbum, ftsartist, ftsalbumartist, ftscomposer, ftsperformer, ftsgrouping, ftsgenre, ftscomment,
-  tokenize=unicode
+  tokenize='unicode', prefix='2 3'
 );
 
 CREATE INDEX jamendo.idx_jamendo_comp_artist ON songs (effective_compilation, artist);
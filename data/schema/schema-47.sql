@@ -0,0 +1,5 @@
+ALTER TABLE %allsongstables ADD COLUMN inode INTEGER;
+
+CREATE INDEX idx_filesize_mtime ON songs (filesize, mtime);
+
+UPDATE schema_version SET version=47;
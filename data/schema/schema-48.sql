@@ -0,0 +1,8 @@
+CREATE TABLE full_scan_progress (
+  directory INTEGER NOT NULL,
+  path TEXT
+);
+
+CREATE INDEX idx_full_scan_progress_directory ON full_scan_progress (directory);
+
+UPDATE schema_version SET version=48;
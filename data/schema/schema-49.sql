@@ -0,0 +1,12 @@
+DROP TABLE %allsongstables_fts;
+
+CREATE VIRTUAL TABLE %allsongstables_fts USING fts5(
+  ftstitle, ftsalbum, ftsartist, ftsalbumartist, ftscomposer, ftsperformer, ftsgrouping, ftsgenre, ftscomment,
+  tokenize='unicode', prefix='2 3'
+);
+
+INSERT INTO %allsongstables_fts (ROWID, ftstitle, ftsalbum, ftsartist, ftsalbumartist, ftscomposer, ftsperformer, ftsgrouping, ftsgenre, ftscomment)
+    SELECT ROWID, title, album, artist, albumartist, composer, performer, grouping, genre, comment
+    FROM %allsongstables;
+
+UPDATE schema_version SET version=49;
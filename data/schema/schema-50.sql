@@ -0,0 +1,13 @@
+CREATE INDEX idx_avail_comp_artist_album ON songs (unavailable, effective_compilation, artist, album, year);
+
+CREATE INDEX idx_avail_comp_albumartist_album ON songs (unavailable, effective_compilation, effective_albumartist, album, year);
+
+CREATE INDEX idx_avail_genre_comp_artist_album ON songs (unavailable, genre, effective_compilation, artist, album);
+
+CREATE INDEX idx_avail_album ON songs (unavailable, album);
+
+CREATE INDEX idx_avail_composer_album ON songs (unavailable, composer, album);
+
+CREATE INDEX idx_avail_year_album ON songs (unavailable, year, album);
+
+UPDATE schema_version SET version=50;
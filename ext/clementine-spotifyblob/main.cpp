@@ -39,11 +39,11 @@ int main(int argc, char** argv) {
   const QStringList arguments(a.arguments());
 
   if (arguments.length() != 2) {
-    qFatal("Usage: %s port", argv[0]);
+    qFatal("Usage: %s server_name", argv[0]);
   }
 
   SpotifyClient client;
-  client.Init(arguments[1].toInt());
+  if (!client.Init(arguments[1])) return 1;
 
   return a.exec();
 }
@@ -26,11 +26,11 @@
 #include "spotifymessages.pb.h"
 #include "spotify_utilities.h"
 #include "core/logging.h"
+#include "core/sharedmemorydevice.h"
 
 #include <QCoreApplication>
 #include <QDir>
-#include <QHostAddress>
-#include <QTcpSocket>
+#include <QLocalSocket>
 #include <QTimer>
 
 const int SpotifyClient::kSpotifyImageIDSize = 20;
@@ -39,11 +39,9 @@ const int SpotifyClient::kWaveHeaderSize = 44;
 SpotifyClient::SpotifyClient(QObject* parent)
     : AbstractMessageHandler<pb::spotify::Message>(nullptr, parent),
       api_key_(QByteArray::fromBase64(kSpotifyApiKey)),
-      protocol_socket_(new QTcpSocket(this)),
+      protocol_socket_(new QLocalSocket(this)),
       session_(nullptr),
       events_timer_(new QTimer(this)) {
-  SetDevice(protocol_socket_);
-
   memset(&spotify_callbacks_, 0, sizeof(spotify_callbacks_));
   memset(&spotify_config_, 0, sizeof(spotify_config_));
   memset(&playlistcontainer_callbacks_, 0,
@@ -106,10 +104,26 @@ SpotifyClient::~SpotifyClient() {
   free(const_cast<char*>(spotify_config_.settings_location));
 }
 
-void SpotifyClient::Init(quint16 port) {
-  qLog(Debug) << "Connecting to port" << port;
+bool SpotifyClient::Init(const QString& server_name) {
+  qLog(Debug) << "Connecting to" << server_name;
+
+  protocol_socket_->connectToServer(server_name);
+  if (!protocol_socket_->waitForConnected(2000)) {
+    qLog(Error) << "Failed to connect to" << server_name;
+    return false;
+  }
 
-  protocol_socket_->connectToHost(QHostAddress::LocalHost, port);
+  // Clementine sends the shared memory before anything else, so this has to
+  // happen before the event loop starts reading from the socket.
+  SharedMemoryDevice* shared_memory =
+      SharedMemoryDevice::Receive(protocol_socket_, this);
+  if (shared_memory) {
+    SetDevice(shared_memory);
+  } else {
+    qLog(Warning) << "Shared memory not available, using the socket instead";
+    SetDevice(protocol_socket_);
+  }
+  return true;
 }
 
 void SpotifyClient::LoggedInCallback(sp_session* session, sp_error error) {
@@ -29,7 +29,7 @@
 
 #include <libspotify/api.h>
 
-class QTcpSocket;
+class QLocalSocket;
 class QTimer;
 
 class MediaPipeline;
@@ -45,7 +45,8 @@ class SpotifyClient : public AbstractMessageHandler<pb::spotify::Message> {
   static const int kSpotifyImageIDSize;
   static const int kWaveHeaderSize;
 
-  void Init(quint16 port);
+  // Connects to Clementine.  Returns false if it couldn't.
+  bool Init(const QString& server_name);
 
  protected:
   void MessageArrived(const pb::spotify::Message& message);
@@ -171,7 +172,7 @@ class SpotifyClient : public AbstractMessageHandler<pb::spotify::Message> {
 
   QByteArray api_key_;
 
-  QTcpSocket* protocol_socket_;
+  QLocalSocket* protocol_socket_;
 
   sp_session_config spotify_config_;
   sp_session_callbacks spotify_callbacks_;
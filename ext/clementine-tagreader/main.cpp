@@ -17,6 +17,8 @@
 
 #include "tagreaderworker.h"
 #include "core/logging.h"
+#include "core/sharedmemorydevice.h"
+#include "core/workerpool.h"
 
 #include <QCoreApplication>
 #include <QLocalSocket>
@@ -30,7 +32,11 @@ int main(int argc, char** argv) {
   QCoreApplication a(argc, argv);
   QStringList args(a.arguments());
 
-  if (args.count() != 2) {
+  const bool use_shared_memory =
+      args.count() == 3 &&
+      args[2] == _WorkerPoolBase::kSharedMemoryArgument;
+
+  if (args.count() != 2 && !use_shared_memory) {
     std::cerr << "This program is used internally by Clementine to parse tags "
                  "in music files\n"
                  "without exposing the whole application to crashes caused by "
@@ -58,7 +64,18 @@ int main(int argc, char** argv) {
   QSslSocket::addDefaultCaCertificates(
       QSslCertificate::fromPath(":/certs/godaddy-root.pem", QSsl::Pem));
 
-  TagReaderWorker worker(&socket);
+  // The parent sends the shared memory before anything else, so this has to
+  // happen before the event loop starts reading from the socket.
+  SharedMemoryDevice* shared_memory = nullptr;
+  if (use_shared_memory) {
+    shared_memory = SharedMemoryDevice::Receive(&socket, &socket);
+    if (!shared_memory) {
+      qLog(Warning) << "Shared memory not available, using the socket instead";
+    }
+  }
+
+  TagReaderWorker worker(shared_memory ? static_cast<QIODevice*>(shared_memory)
+                                       : &socket);
 
   return a.exec();
 }
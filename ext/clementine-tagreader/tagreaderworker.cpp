@@ -42,6 +42,14 @@ void TagReaderWorker::MessageArrived(const pb::tagreader::Message& message) {
     tag_reader_.ReadFile(
         QStringFromStdString(message.read_file_request().filename()),
         reply.mutable_read_file_response()->mutable_metadata());
+  } else if (message.has_read_files_request()) {
+    const pb::tagreader::ReadFilesRequest& req = message.read_files_request();
+    pb::tagreader::ReadFilesResponse* response =
+        reply.mutable_read_files_response();
+    for (int i = 0; i < req.filenames_size(); ++i) {
+      tag_reader_.ReadFile(QStringFromStdString(req.filenames(i)),
+                           response->add_metadata());
+    }
   } else if (message.has_save_file_request()) {
     reply.mutable_save_file_response()->set_success(tag_reader_.SaveFile(
         QStringFromStdString(message.save_file_request().filename()),
@@ -66,6 +74,13 @@ void TagReaderWorker::MessageArrived(const pb::tagreader::Message& message) {
         QStringFromStdString(message.load_embedded_art_request().filename()));
     reply.mutable_load_embedded_art_response()->set_data(data.constData(),
                                                          data.size());
+  } else if (message.has_load_embedded_art_thumbnail_request()) {
+    const pb::tagreader::LoadEmbeddedArtThumbnailRequest& req =
+        message.load_embedded_art_thumbnail_request();
+    QByteArray data = tag_reader_.LoadEmbeddedArtThumbnail(
+        QStringFromStdString(req.filename()), req.size());
+    reply.mutable_load_embedded_art_response()->set_data(data.constData(),
+                                                         data.size());
   } else if (message.has_read_cloud_file_request()) {
 #ifdef HAVE_GOOGLE_DRIVE
     const pb::tagreader::ReadCloudFileRequest& req =
@@ -20,6 +20,7 @@
 
 #include "messagehandler.h"
 #include "core/logging.h"
+#include "core/sharedmemorydevice.h"
 
 #include <QAbstractSocket>
 #include <QLocalSocket>
@@ -51,6 +52,10 @@ void _MessageHandlerBase::SetDevice(QIODevice* device) {
   } else if (QLocalSocket* socket = qobject_cast<QLocalSocket*>(device)) {
     flush_local_socket_ = &QLocalSocket::flush;
     connect(socket, SIGNAL(disconnected()), SLOT(DeviceClosed()));
+  } else if (SharedMemoryDevice* shm =
+                 qobject_cast<SharedMemoryDevice*>(device)) {
+    // Writes go straight into shared memory, so there's nothing to flush.
+    connect(shm, SIGNAL(disconnected()), SLOT(DeviceClosed()));
   } else {
     qFatal("Unsupported device type passed to _MessageHandlerBase");
   }
@@ -59,7 +64,10 @@ void _MessageHandlerBase::SetDevice(QIODevice* device) {
 void _MessageHandlerBase::DeviceReadyRead() {
   while (device_->bytesAvailable()) {
     if (!reading_protobuf_) {
-      // Read the length of the next message
+      // Read the length of the next message.  It might not have all arrived
+      // yet if the device doesn't deliver writes in one piece.
+      if (device_->bytesAvailable() < qint64(sizeof(quint32))) break;
+
       QDataStream s(device_);
       s >> expected_length_;
 
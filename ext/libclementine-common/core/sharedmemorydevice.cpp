@@ -0,0 +1,416 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Note: this file is licensed under the Apache License instead of GPL because
+// it is used by the Spotify blob which links against libspotify and is not GPL
+// compatible.
+
+#include "sharedmemorydevice.h"
+#include "core/logging.h"
+
+#include <QLocalSocket>
+#include <QSocketNotifier>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// memfd_create was added in glibc 2.27.
+#ifdef MFD_CLOEXEC
+#define HAVE_SHARED_MEMORY
+#endif
+#endif
+
+const int SharedMemoryDevice::kRingSize = 1024 * 1024;  // Must be a power of 2
+
+namespace {
+
+// The ring headers are padded so the two processes aren't fighting over the
+// same cache line.
+const int kHeaderSize = 64;
+const int kMemorySize = (kHeaderSize + SharedMemoryDevice::kRingSize) * 2;
+
+const int kReceiveTimeoutMsec = 2000;
+
+// The memfd, the parent's eventfd and the child's eventfd.
+const int kDescriptorCount = 3;
+
+}  // namespace
+
+// Lives at the start of each ring buffer in the shared memory.  The positions
+// only ever increase and wrap around at 2^32, which is fine because kRingSize
+// divides it.
+struct SharedMemoryDevice::Ring {
+  std::atomic<quint32> write_pos;
+  std::atomic<quint32> read_pos;
+
+  // Set by the writer when the ring is full, so the reader knows to wake it up
+  // when it's made some space.
+  std::atomic<quint32> writer_waiting;
+
+  uchar* data() { return reinterpret_cast<uchar*>(this) + kHeaderSize; }
+};
+
+#ifdef HAVE_SHARED_MEMORY
+
+namespace {
+
+bool SendDescriptors(int socket, const int* fds, int count) {
+  char ok = count ? '1' : '0';
+  iovec iov;
+  iov.iov_base = &ok;
+  iov.iov_len = 1;
+
+  char control[CMSG_SPACE(sizeof(int) * kDescriptorCount)];
+  memset(control, 0, sizeof(control));
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (count) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+  }
+
+  ssize_t ret;
+  do {
+    ret = sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (ret == -1 && errno == EINTR);
+
+  return ret == 1;
+}
+
+bool ReceiveDescriptors(int socket, int* fds) {
+  // The socket is non-blocking, so wait for the parent to send something.
+  pollfd pfd;
+  pfd.fd = socket;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if (poll(&pfd, 1, kReceiveTimeoutMsec) != 1) {
+    qLog(Warning) << "Timed out waiting for shared memory descriptors";
+    return false;
+  }
+
+  char ok = 0;
+  iovec iov;
+  iov.iov_base = &ok;
+  iov.iov_len = 1;
+
+  char control[CMSG_SPACE(sizeof(int) * kDescriptorCount)];
+  memset(control, 0, sizeof(control));
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t ret;
+  do {
+    ret = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret != 1 || ok != '1') {
+    return false;
+  }
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int) * kDescriptorCount)) {
+    return false;
+  }
+
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * kDescriptorCount);
+  return true;
+}
+
+}  // namespace
+
+#endif  // HAVE_SHARED_MEMORY
+
+SharedMemoryDevice* SharedMemoryDevice::Create(QLocalSocket* control,
+                                               QObject* parent) {
+#ifdef HAVE_SHARED_MEMORY
+  const int socket = control->socketDescriptor();
+
+  const int memfd = memfd_create("clementine-ipc", MFD_CLOEXEC);
+  const int parent_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  const int child_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (memfd == -1 || parent_wake_fd == -1 || child_wake_fd == -1 ||
+      ftruncate(memfd, kMemorySize) == -1) {
+    qLog(Warning) << "Failed to create shared memory:" << strerror(errno);
+    if (memfd != -1) ::close(memfd);
+    if (parent_wake_fd != -1) ::close(parent_wake_fd);
+    if (child_wake_fd != -1) ::close(child_wake_fd);
+
+    // Tell the child to use the socket instead.
+    SendDescriptors(socket, nullptr, 0);
+    return nullptr;
+  }
+
+  const int fds[kDescriptorCount] = {memfd, parent_wake_fd, child_wake_fd};
+  if (!SendDescriptors(socket, fds, kDescriptorCount)) {
+    qLog(Warning) << "Failed to send shared memory descriptors:"
+                  << strerror(errno);
+    ::close(memfd);
+    ::close(parent_wake_fd);
+    ::close(child_wake_fd);
+    return nullptr;
+  }
+
+  SharedMemoryDevice* ret = new SharedMemoryDevice(
+      control, memfd, parent_wake_fd, child_wake_fd, true, parent);
+  if (!ret->isOpen()) {
+    delete ret;
+    return nullptr;
+  }
+  return ret;
+#else
+  Q_UNUSED(control);
+  Q_UNUSED(parent);
+  return nullptr;
+#endif
+}
+
+SharedMemoryDevice* SharedMemoryDevice::Receive(QLocalSocket* control,
+                                                QObject* parent) {
+#ifdef HAVE_SHARED_MEMORY
+  int fds[kDescriptorCount];
+  if (!ReceiveDescriptors(control->socketDescriptor(), fds)) {
+    return nullptr;
+  }
+
+  SharedMemoryDevice* ret =
+      new SharedMemoryDevice(control, fds[0], fds[2], fds[1], false, parent);
+  if (!ret->isOpen()) {
+    delete ret;
+    return nullptr;
+  }
+  return ret;
+#else
+  Q_UNUSED(control);
+  Q_UNUSED(parent);
+  return nullptr;
+#endif
+}
+
+SharedMemoryDevice::SharedMemoryDevice(QLocalSocket* control, int memfd,
+                                       int wake_fd, int peer_wake_fd,
+                                       bool is_parent, QObject* parent)
+    : QIODevice(parent),
+      control_(control),
+      memfd_(memfd),
+      memory_(nullptr),
+      wake_fd_(wake_fd),
+      peer_wake_fd_(peer_wake_fd),
+      notifier_(nullptr),
+      read_ring_(nullptr),
+      write_ring_(nullptr) {
+#ifdef HAVE_SHARED_MEMORY
+  void* memory = mmap(nullptr, kMemorySize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, memfd_, 0);
+  if (memory == MAP_FAILED) {
+    qLog(Warning) << "Failed to map shared memory:" << strerror(errno);
+    close();
+    return;
+  }
+  memory_ = reinterpret_cast<uchar*>(memory);
+
+  Ring* first = reinterpret_cast<Ring*>(memory_);
+  Ring* second = reinterpret_cast<Ring*>(memory_ + kHeaderSize + kRingSize);
+
+  if (is_parent) {
+    // The memfd starts off zeroed, but construct the atomics properly anyway.
+    new (first) Ring();
+    new (second) Ring();
+    first->write_pos = first->read_pos = first->writer_waiting = 0;
+    second->write_pos = second->read_pos = second->writer_waiting = 0;
+
+    write_ring_ = first;
+    read_ring_ = second;
+  } else {
+    write_ring_ = second;
+    read_ring_ = first;
+  }
+
+  notifier_ = new QSocketNotifier(wake_fd_, QSocketNotifier::Read, this);
+  connect(notifier_, SIGNAL(activated(int)), SLOT(WakeUp()));
+  connect(control_, SIGNAL(disconnected()), SLOT(ControlDisconnected()));
+
+  open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+#else
+  Q_UNUSED(is_parent);
+#endif
+}
+
+SharedMemoryDevice::~SharedMemoryDevice() { close(); }
+
+void SharedMemoryDevice::close() {
+  QIODevice::close();
+
+#ifdef HAVE_SHARED_MEMORY
+  delete notifier_;
+  notifier_ = nullptr;
+
+  if (memory_) {
+    munmap(memory_, kMemorySize);
+    memory_ = nullptr;
+    read_ring_ = nullptr;
+    write_ring_ = nullptr;
+  }
+
+  if (memfd_ != -1) ::close(memfd_);
+  if (wake_fd_ != -1) ::close(wake_fd_);
+  if (peer_wake_fd_ != -1) ::close(peer_wake_fd_);
+  memfd_ = wake_fd_ = peer_wake_fd_ = -1;
+#endif
+
+  pending_writes_.clear();
+}
+
+qint64 SharedMemoryDevice::bytesAvailable() const {
+  qint64 ret = QIODevice::bytesAvailable();
+  if (read_ring_) {
+    ret += read_ring_->write_pos.load(std::memory_order_acquire) -
+           read_ring_->read_pos.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+qint64 SharedMemoryDevice::bytesToWrite() const {
+  return pending_writes_.size();
+}
+
+qint64 SharedMemoryDevice::readData(char* data, qint64 max_size) {
+  if (!read_ring_) return -1;
+
+  const quint32 write_pos =
+      read_ring_->write_pos.load(std::memory_order_acquire);
+  const quint32 read_pos = read_ring_->read_pos.load(std::memory_order_relaxed);
+  const quint32 count = qMin(quint64(write_pos - read_pos), quint64(max_size));
+  if (count == 0) return 0;
+
+  // Copy up to the end of the ring, and then the rest from the start.
+  const quint32 offset = read_pos & (kRingSize - 1);
+  const quint32 first = qMin(count, quint32(kRingSize) - offset);
+  memcpy(data, read_ring_->data() + offset, first);
+  memcpy(data + first, read_ring_->data(), count - first);
+
+  // These are sequentially consistent so that they can't be reordered with
+  // the writer setting writer_waiting and checking read_pos again.
+  read_ring_->read_pos.store(read_pos + count);
+
+  // Wake the writer if it was waiting for some space.
+  if (read_ring_->writer_waiting.exchange(0)) {
+    WakePeer();
+  }
+
+  return count;
+}
+
+qint64 SharedMemoryDevice::writeData(const char* data, qint64 size) {
+  if (!write_ring_) return -1;
+
+  // Anything that doesn't fit now gets written when the reader wakes us up.
+  pending_writes_.append(data, size);
+  WritePending();
+
+  return size;
+}
+
+void SharedMemoryDevice::WritePending() {
+  if (!write_ring_ || pending_writes_.isEmpty()) return;
+
+  const quint32 read_pos =
+      write_ring_->read_pos.load(std::memory_order_acquire);
+  const quint32 write_pos =
+      write_ring_->write_pos.load(std::memory_order_relaxed);
+  const quint32 space = kRingSize - (write_pos - read_pos);
+  const quint32 count = qMin(space, quint32(pending_writes_.size()));
+
+  if (count) {
+    const quint32 offset = write_pos & (kRingSize - 1);
+    const quint32 first = qMin(count, quint32(kRingSize) - offset);
+    memcpy(write_ring_->data() + offset, pending_writes_.constData(), first);
+    memcpy(write_ring_->data(), pending_writes_.constData() + first,
+           count - first);
+
+    write_ring_->write_pos.store(write_pos + count, std::memory_order_release);
+    pending_writes_.remove(0, count);
+
+    WakePeer();
+    emit bytesWritten(count);
+  }
+
+  if (!pending_writes_.isEmpty()) {
+    write_ring_->writer_waiting.store(1);
+
+    // The reader might have made some space before it saw the flag.
+    if (write_ring_->read_pos.load() != read_pos) {
+      WritePending();
+    }
+  }
+}
+
+void SharedMemoryDevice::WakePeer() {
+#ifdef HAVE_SHARED_MEMORY
+  const quint64 value = 1;
+  ssize_t ret;
+  do {
+    ret = write(peer_wake_fd_, &value, sizeof(value));
+  } while (ret == -1 && errno == EINTR);
+#endif
+}
+
+void SharedMemoryDevice::WakeUp() {
+#ifdef HAVE_SHARED_MEMORY
+  quint64 value;
+  ssize_t ret;
+  do {
+    ret = read(wake_fd_, &value, sizeof(value));
+  } while (ret == -1 && errno == EINTR);
+#endif
+
+  WritePending();
+
+  if (bytesAvailable()) {
+    emit readyRead();
+  }
+}
+
+void SharedMemoryDevice::ControlDisconnected() {
+  close();
+  emit disconnected();
+}
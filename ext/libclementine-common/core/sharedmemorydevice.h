@@ -0,0 +1,106 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Note: this file is licensed under the Apache License instead of GPL because
+// it is used by the Spotify blob which links against libspotify and is not GPL
+// compatible.
+
+#ifndef SHAREDMEMORYDEVICE_H
+#define SHAREDMEMORYDEVICE_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+class QLocalSocket;
+class QSocketNotifier;
+
+// A byte stream between two processes that goes through a pair of ring buffers
+// in shared memory instead of through a socket, so large messages don't have
+// to be copied in and out of the kernel.  Each process has an eventfd that the
+// other one writes to when there's new data to read or new space to write.
+//
+// A QLocalSocket is still needed to pass the file descriptors to the other
+// process, and to find out when it goes away.  Nothing else is sent over it.
+//
+// The parent process calls Create(), which sends the file descriptors over the
+// socket, and the child calls Receive() straight after it connects.  Both
+// return NULL if shared memory isn't available - only Linux supports it - and
+// the socket should be used directly instead.
+class SharedMemoryDevice : public QIODevice {
+  Q_OBJECT
+
+ public:
+  ~SharedMemoryDevice();
+
+  // The size of each of the two ring buffers.
+  static const int kRingSize;
+
+  // Must be called before anything else is written to the socket.
+  static SharedMemoryDevice* Create(QLocalSocket* control,
+                                    QObject* parent = nullptr);
+  // Must be called before anything else is read from the socket.  Blocks until
+  // the parent process has called Create().
+  static SharedMemoryDevice* Receive(QLocalSocket* control,
+                                     QObject* parent = nullptr);
+
+  // QIODevice
+  bool isSequential() const { return true; }
+  qint64 bytesAvailable() const;
+  qint64 bytesToWrite() const;
+  void close();
+
+signals:
+  // Emitted when the other process closes the control socket.
+  void disconnected();
+
+ protected:
+  // QIODevice
+  qint64 readData(char* data, qint64 max_size);
+  qint64 writeData(const char* data, qint64 size);
+
+ private slots:
+  void WakeUp();
+  void ControlDisconnected();
+
+ private:
+  struct Ring;
+
+  SharedMemoryDevice(QLocalSocket* control, int memfd, int wake_fd,
+                     int peer_wake_fd, bool is_parent, QObject* parent);
+
+  // Copies as much of pending_writes_ into the ring as will fit.
+  void WritePending();
+  void WakePeer();
+
+  QLocalSocket* control_;
+
+  int memfd_;
+  uchar* memory_;
+
+  // We're woken up through wake_fd_, and we wake the other process through
+  // peer_wake_fd_.
+  int wake_fd_;
+  int peer_wake_fd_;
+  QSocketNotifier* notifier_;
+
+  Ring* read_ring_;
+  Ring* write_ring_;
+
+  // Data that didn't fit in the write ring yet.
+  QByteArray pending_writes_;
+};
+
+#endif  // SHAREDMEMORYDEVICE_H
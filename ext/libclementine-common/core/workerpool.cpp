@@ -17,4 +17,6 @@
 
 #include "workerpool.h"
 
+const char* _WorkerPoolBase::kSharedMemoryArgument = "--shared-memory";
+
 _WorkerPoolBase::_WorkerPoolBase(QObject* parent) : QObject(parent) {}
@@ -31,6 +31,7 @@
 
 #include "core/closure.h"
 #include "core/logging.h"
+#include "core/sharedmemorydevice.h"
 
 // Base class containing signals and slots - required because moc doesn't do
 // templated objects.
@@ -40,6 +41,9 @@ class _WorkerPoolBase : public QObject {
  public:
   _WorkerPoolBase(QObject* parent = nullptr);
 
+  // Passed to workers as argv[2] when they should use shared memory.
+  static const char* kSharedMemoryArgument;
+
 signals:
   // Emitted when a worker failed to start.  This usually happens when the
   // worker wasn't found, or couldn't be executed.
@@ -56,6 +60,10 @@ signals:
 // started for each process, and the address is passed to the process as
 // argv[1].  The process is expected to connect back to the socket server, and
 // when it does a HandlerType is created for it.
+// If SetUseSharedMemory(true) is called the process is also passed
+// --shared-memory as argv[2], and it should call SharedMemoryDevice::Receive
+// on the socket straight after it connects.  Messages are then sent through
+// shared memory instead of through the socket.
 // Instances of HandlerType are created in the WorkerPool's thread.
 template <typename HandlerType>
 class WorkerPool : public _WorkerPoolBase {
@@ -71,8 +79,8 @@ class WorkerPool : public _WorkerPoolBase {
   // Start().
   void SetExecutableName(const QString& executable_name);
 
-  // Sets the number of worker process to use.  Defaults to
-  // 1 <= (processors / 2) <= 2.
+  // Sets the number of worker process to use.  Defaults to the number of
+  // processors.
   void SetWorkerCount(int count);
 
   // Sets the prefix to use for the local server (on unix this is a named pipe
@@ -80,6 +88,11 @@ class WorkerPool : public _WorkerPoolBase {
   // is appended to this name when creating each server.
   void SetLocalServerName(const QString& local_server_name);
 
+  // Sets whether messages are sent to the workers through shared memory
+  // instead of through the local socket.  Defaults to false.  Falls back to
+  // the socket on platforms that don't support it.
+  void SetUseSharedMemory(bool use_shared_memory);
+
   // Starts all workers.
   void Start();
 
@@ -101,11 +114,13 @@ class WorkerPool : public _WorkerPoolBase {
     Worker()
         : local_server_(NULL),
           local_socket_(NULL),
+          shared_memory_(NULL),
           process_(NULL),
           handler_(NULL) {}
 
     QLocalServer* local_server_;
     QLocalSocket* local_socket_;
+    SharedMemoryDevice* shared_memory_;
     QProcess* process_;
     HandlerType* handler_;
   };
@@ -147,6 +162,7 @@ class WorkerPool : public _WorkerPoolBase {
   QString executable_path_;
 
   int worker_count_;
+  bool use_shared_memory_;
   mutable int next_worker_;
   QList<Worker> workers_;
 
@@ -158,8 +174,11 @@ class WorkerPool : public _WorkerPoolBase {
 
 template <typename HandlerType>
 WorkerPool<HandlerType>::WorkerPool(QObject* parent)
-    : _WorkerPoolBase(parent), next_worker_(0), next_id_(0) {
-  worker_count_ = qBound(1, QThread::idealThreadCount() / 2, 2);
+    : _WorkerPoolBase(parent),
+      use_shared_memory_(false),
+      next_worker_(0),
+      next_id_(0) {
+  worker_count_ = qMax(1, QThread::idealThreadCount());
   local_server_name_ = qApp->applicationName().toLower();
 
   if (local_server_name_.isEmpty()) local_server_name_ = "workerpool";
@@ -206,6 +225,12 @@ void WorkerPool<HandlerType>::SetLocalServerName(
   local_server_name_ = local_server_name;
 }
 
+template <typename HandlerType>
+void WorkerPool<HandlerType>::SetUseSharedMemory(bool use_shared_memory) {
+  Q_ASSERT(workers_.isEmpty());
+  use_shared_memory_ = use_shared_memory;
+}
+
 template <typename HandlerType>
 void WorkerPool<HandlerType>::SetExecutableName(
     const QString& executable_name) {
@@ -256,6 +281,7 @@ void WorkerPool<HandlerType>::StartOneWorker(Worker* worker) {
 
   DeleteQObjectPointerLater(&worker->local_server_);
   DeleteQObjectPointerLater(&worker->local_socket_);
+  DeleteQObjectPointerLater(&worker->shared_memory_);
   DeleteQObjectPointerLater(&worker->process_);
   DeleteQObjectPointerLater(&worker->handler_);
 
@@ -282,10 +308,14 @@ void WorkerPool<HandlerType>::StartOneWorker(Worker* worker) {
               << worker->local_server_->fullServerName();
 
   // Start the process
+  QStringList args;
+  args << worker->local_server_->fullServerName();
+  if (use_shared_memory_) {
+    args << kSharedMemoryArgument;
+  }
+
   worker->process_->setProcessChannelMode(QProcess::ForwardedChannels);
-  worker->process_->start(executable_path_,
-                          QStringList()
-                              << worker->local_server_->fullServerName());
+  worker->process_->start(executable_path_, args);
 }
 
 template <typename HandlerType>
@@ -309,8 +339,18 @@ void WorkerPool<HandlerType>::NewConnection() {
   worker->local_server_->deleteLater();
   worker->local_server_ = NULL;
 
+  // Hand the worker some shared memory if it's going to use it.
+  if (use_shared_memory_) {
+    worker->shared_memory_ =
+        SharedMemoryDevice::Create(worker->local_socket_, this);
+  }
+
   // Create the handler.
-  worker->handler_ = new HandlerType(worker->local_socket_, this);
+  if (worker->shared_memory_) {
+    worker->handler_ = new HandlerType(worker->shared_memory_, this);
+  } else {
+    worker->handler_ = new HandlerType(worker->local_socket_, this);
+  }
 
   SendQueuedMessages();
 }
@@ -19,9 +19,16 @@
 
 #include <memory>
 
+#include <sys/stat.h>
+
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QDateTime>
+#include <QFile>
 #include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
 #include <QNetworkAccessManager>
 #include <QTextCodec>
 #include <QUrl>
@@ -97,6 +104,28 @@ TagLib::String StdStringToTaglibString(const std::string& s) {
 TagLib::String QStringToTaglibString(const QString& s) {
   return TagLib::String(s.toUtf8().constData(), TagLib::String::UTF8);
 }
+
+// Extensions of files that commonly sit next to music but are never music.
+const char* kNotMediaExtensions[] = {
+    "accurip", "bmp", "cue", "db", "gif", "htm", "html", "ini", "jpeg", "jpg",
+    "log", "m3u", "m3u8", "md5", "nfo", "pdf", "pls", "png", "sfv", "txt",
+    "url", "xml", "xspf", nullptr};
+
+// Magic numbers at the start of files that are never music.
+struct FileMagic {
+  const char* bytes;
+  int length;
+};
+const FileMagic kNotMediaMagic[] = {
+    {"\x89PNG", 4},                 // PNG
+    {"\xFF\xD8\xFF", 3},            // JPEG
+    {"GIF8", 4},                    // GIF
+    {"%PDF", 4},                    // PDF
+    {"PK\x03\x04", 4},              // Zip
+    {"\xEF\xBB\xBF", 3},            // UTF-8 byte order mark - a text file
+    {"<?xml", 5},                   // XML
+    {"SQLite format 3", 15},        // SQLite database
+    {nullptr, 0}};
 }
 
 const char* TagReader::kMP4_FMPS_Rating_ID =
@@ -124,6 +153,19 @@ void TagReader::ReadFile(const QString& filename,
   song->set_mtime(info.lastModified().toTime_t());
   song->set_ctime(info.created().toTime_t());
 
+#ifndef Q_OS_WIN32
+  // Lets LibraryWatcher recognise the file if it's moved or renamed.
+  struct stat stat_buf;
+  if (stat(QFile::encodeName(filename).constData(), &stat_buf) == 0) {
+    song->set_inode(stat_buf.st_ino);
+  }
+#endif
+
+  if (IsObviouslyNotMedia(filename)) {
+    qLog(Debug) << "Not reading tags from" << filename << "- not a media file";
+    return;
+  }
+
   std::unique_ptr<TagLib::FileRef> fileref(factory_->GetFileRef(filename));
   if (fileref->isNull()) {
     qLog(Info) << "TagLib hasn't been able to read " << filename << " file";
@@ -834,10 +876,40 @@ void TagReader::SetTextFrame(const char* id, const std::string& value,
 bool TagReader::IsMediaFile(const QString& filename) const {
   qLog(Debug) << "Checking for valid file" << filename;
 
+  if (IsObviouslyNotMedia(filename)) return false;
+
   std::unique_ptr<TagLib::FileRef> fileref(factory_->GetFileRef(filename));
   return !fileref->isNull() && fileref->tag();
 }
 
+bool TagReader::IsObviouslyNotMedia(const QString& filename) {
+  const QString extension = QFileInfo(filename).suffix().toLower();
+  for (const char** ext = kNotMediaExtensions; *ext; ++ext) {
+    if (extension == QLatin1String(*ext)) return true;
+  }
+
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) {
+    // Let TagLib decide what to do with it.
+    return false;
+  }
+
+  const QByteArray header = file.read(16);
+  if (header.size() < 4) {
+    // Too small to be anything interesting.
+    return true;
+  }
+
+  for (const FileMagic* magic = kNotMediaMagic; magic->bytes; ++magic) {
+    if (header.startsWith(QByteArray::fromRawData(magic->bytes,
+                                                  magic->length))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 QByteArray TagReader::LoadEmbeddedArt(const QString& filename) const {
   if (filename.isEmpty()) return QByteArray();
 
@@ -938,6 +1010,60 @@ QByteArray TagReader::LoadEmbeddedArt(const QString& filename) const {
   return QByteArray();
 }
 
+QByteArray TagReader::LoadEmbeddedArtThumbnail(const QString& filename,
+                                               int size) const {
+  const QByteArray data = LoadEmbeddedArt(filename);
+  if (data.isEmpty() || size <= 0) return data;
+
+  QBuffer buffer;
+  buffer.setData(data);
+  buffer.open(QIODevice::ReadOnly);
+
+  QImageReader reader(&buffer);
+  const QSize original_size = reader.size();
+  if (original_size.isValid() && original_size.width() <= size &&
+      original_size.height() <= size) {
+    return data;
+  }
+
+  QImage image;
+  if (original_size.isValid() &&
+      reader.supportsOption(QImageIOHandler::ScaledSize)) {
+    // The JPEG reader uses libjpeg's DCT scaling to do this, so it only ever
+    // decodes the smaller image.
+    reader.setScaledSize(
+        original_size.scaled(size, size, Qt::KeepAspectRatio));
+    image = reader.read();
+  } else {
+    image = reader.read();
+    if (!image.isNull()) {
+      image = image.scaled(size, size, Qt::KeepAspectRatio,
+                           Qt::SmoothTransformation);
+    }
+  }
+
+  if (image.isNull()) {
+    qLog(Warning) << "Failed to decode embedded art in" << filename << ":"
+                  << reader.errorString();
+    return QByteArray();
+  }
+
+  // Keep transparency if the image had any, otherwise JPEG is much smaller.
+  QByteArray ret;
+  QBuffer output(&ret);
+  output.open(QIODevice::WriteOnly);
+
+  QImageWriter writer(&output, image.hasAlphaChannel() ? "png" : "jpg");
+  writer.setQuality(90);
+  if (!writer.write(image)) {
+    qLog(Warning) << "Failed to encode embedded art thumbnail for" << filename
+                  << ":" << writer.errorString();
+    return QByteArray();
+  }
+
+  return ret;
+}
+
 #ifdef HAVE_GOOGLE_DRIVE
 bool TagReader::ReadCloudFile(const QUrl& download_url, const QString& title,
                               int size, const QString& mime_type,
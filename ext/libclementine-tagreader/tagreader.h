@@ -64,7 +64,16 @@ class TagReader {
                             const pb::tagreader::SongMetadata& song) const;
 
   bool IsMediaFile(const QString& filename) const;
+  // A cheap check that rejects files that obviously aren't music - text files,
+  // images, playlists and so on - by looking at their extension and their first
+  // few bytes, without asking TagLib to parse them.
+  static bool IsObviouslyNotMedia(const QString& filename);
   QByteArray LoadEmbeddedArt(const QString& filename) const;
+  // Like LoadEmbeddedArt, but scales the image down to fit in a size x size
+  // square and re-encodes it.  JPEGs are decoded at a reduced resolution where
+  // possible, so the full size image is never held in memory.  Images that are
+  // already small enough are returned unchanged.
+  QByteArray LoadEmbeddedArtThumbnail(const QString& filename, int size) const;
 
 #ifdef HAVE_GOOGLE_DRIVE
   bool ReadCloudFile(const QUrl& download_url, const QString& title, int size,
@@ -59,7 +59,9 @@ const char* CommandlineOptions::kHelpText =
     "      --quiet               %27\n"
     "      --verbose             %28\n"
     "      --log-levels <levels> %29\n"
-    "      --version             %30\n";
+    "      --audit-query-plans   %30\n"
+    "      --db-stats <msec>     %31\n"
+    "      --version             %32\n";
 
 const char* CommandlineOptions::kVersionText = "Clementine %1";
 
@@ -75,7 +77,9 @@ CommandlineOptions::CommandlineOptions(int argc, char** argv)
       play_track_at_(-1),
       show_osd_(false),
       toggle_pretty_osd_(false),
-      log_levels_(logging::kDefaultLogLevels) {
+      log_levels_(logging::kDefaultLogLevels),
+      audit_query_plans_(false),
+      db_stats_msec_(-1) {
 #ifdef Q_OS_DARWIN
   // Remove -psn_xxx option that Mac passes when opened from Finder.
   RemoveArg("-psn", 1);
@@ -124,6 +128,8 @@ bool CommandlineOptions::Parse() {
       {"quiet", no_argument, 0, Quiet},
       {"verbose", no_argument, 0, Verbose},
       {"log-levels", required_argument, 0, LogLevels},
+      {"audit-query-plans", no_argument, 0, AuditQueryPlans},
+      {"db-stats", required_argument, 0, DbStats},
       {"version", no_argument, 0, Version},
       {0, 0, 0, 0}};
 
@@ -167,7 +173,10 @@ bool CommandlineOptions::Parse() {
                      tr("Equivalent to --log-levels *:1"),
                      tr("Equivalent to --log-levels *:3"),
                      tr("Comma separated list of class:level, level is 0-3"))
-                .arg(tr("Print out version information"));
+                .arg(tr("Log library queries that scan a whole table"),
+                     tr("Time database queries, logging any slower than "
+                        "<msec>"),
+                     tr("Print out version information"));
 
         std::cout << translated_help_text.toLocal8Bit().constData();
         return false;
@@ -221,6 +230,13 @@ bool CommandlineOptions::Parse() {
       case LogLevels:
         log_levels_ = QString(optarg);
         break;
+      case AuditQueryPlans:
+        audit_query_plans_ = true;
+        break;
+      case DbStats:
+        db_stats_msec_ = QString(optarg).toInt(&ok);
+        if (!ok) db_stats_msec_ = -1;
+        break;
       case Version: {
         QString version_text =
             QString(kVersionText).arg(CLEMENTINE_VERSION_DISPLAY);
@@ -66,6 +66,8 @@ class CommandlineOptions {
   QList<QUrl> urls() const { return urls_; }
   QString language() const { return language_; }
   QString log_levels() const { return log_levels_; }
+  bool audit_query_plans() const { return audit_query_plans_; }
+  int db_stats_msec() const { return db_stats_msec_; }
 
   QByteArray Serialize() const;
   void Load(const QByteArray& serialized);
@@ -84,7 +86,9 @@ class CommandlineOptions {
     Version,
     VolumeIncreaseBy,
     VolumeDecreaseBy,
-    RestartOrPrevious
+    RestartOrPrevious,
+    AuditQueryPlans,
+    DbStats
   };
 
   QString tr(const char* source_text);
@@ -108,6 +112,10 @@ class CommandlineOptions {
   QString language_;
   QString log_levels_;
 
+  // Only used by the instance they're passed to, so they aren't serialised.
+  bool audit_query_plans_;
+  int db_stats_msec_;
+
   QList<QUrl> urls_;
 };
 
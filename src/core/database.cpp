@@ -20,34 +20,45 @@
 #include "scopedtransaction.h"
 #include "utilities.h"
 #include "core/application.h"
+#include "core/databasestats.h"
 #include "core/logging.h"
 #include "core/taskmanager.h"
 
 #include <boost/scope_exit.hpp>
 
+#include <cstring>
+
 #include <sqlite3.h>
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
 #include <QLibrary>
 #include <QLibraryInfo>
+#include <QSettings>
 #include <QSqlDriver>
 #include <QSqlQuery>
+#include <QtConcurrentRun>
 #include <QtDebug>
 #include <QThread>
 #include <QUrl>
 #include <QVariant>
 
 const char* Database::kDatabaseFilename = "clementine.db";
-const int Database::kSchemaVersion = 46;
+const int Database::kSchemaVersion = 50;
 const char* Database::kMagicAllSongsTables = "%allsongstables";
+const char* Database::kSettingsGroup = "Database";
+const int Database::kBackupPagesPerStep = 64;
+const int Database::kBackupStepPauseMsec = 10;
+const int Database::kMaxCachedQueries = 100;
+
+DatabaseStats* Database::sStats = nullptr;
 
 int Database::sNextConnectionId = 1;
 QMutex Database::sNextConnectionIdMutex;
 
-Database::Token::Token(const QString& token, int start, int end)
-    : token(token), start_offset(start), end_offset(end) {}
-
 struct sqlite3_tokenizer_module {
   int iVersion;
   int (*xCreate)(int argc,                /* Size of argv array */
@@ -97,60 +108,134 @@ int Database::FTSDestroy(sqlite3_tokenizer* tokenizer) {
   return SQLITE_OK;
 }
 
-int Database::FTSOpen(sqlite3_tokenizer* pTokenizer, const char* input,
-                      int bytes, sqlite3_tokenizer_cursor** cursor) {
-  UnicodeTokenizerCursor* new_cursor = new UnicodeTokenizerCursor;
-  new_cursor->pTokenizer = pTokenizer;
-  new_cursor->position = 0;
-
-  QString str = QString::fromUtf8(input, bytes).toLower();
-  QChar* data = str.data();
-  // Decompose and strip punctuation.
-  QList<Token> tokens;
-  QString token;
-  int start_offset = 0;
-  int offset = 0;
-  for (int i = 0; i < str.length(); ++i) {
-    QChar c = data[i];
-    ushort unicode = c.unicode();
-    if (unicode <= 0x007f) {
-      offset += 1;
-    } else if (unicode >= 0x0080 && unicode <= 0x07ff) {
-      offset += 2;
-    } else if (unicode >= 0x0800) {
-      offset += 3;
-    }
-    // Unicode astral planes unsupported in Qt?
-    /*else if (unicode >= 0x010000 && unicode <= 0x10ffff) {
-      offset += 4;
-    }*/
-
-    if (!data[i].isLetterOrNumber()) {
-      // Token finished.
-      if (token.length() != 0) {
-        tokens << Token(token, start_offset, offset - 1);
-        start_offset = offset;
-        token.clear();
+namespace {
+
+// Maps every UTF-16 code unit to what the tokenizer turns it into - lower
+// case, with any diacritics removed - or to 0 if it separates tokens.
+const ushort* FoldingTable() {
+  static const ushort* table = []() {
+    ushort* ret = new ushort[0x10000];
+    for (int i = 0; i < 0x10000; ++i) {
+      const QChar c = QChar(ushort(i)).toLower();
+      if (!c.isLetterOrNumber()) {
+        ret[i] = 0;
+      } else if (c.decompositionTag() != QChar::NoDecomposition) {
+        ret[i] = c.decomposition()[0].unicode();
       } else {
-        ++start_offset;
-      }
-    } else {
-      if (data[i].decompositionTag() != QChar::NoDecomposition) {
-        token.push_back(data[i].decomposition()[0]);
-      } else {
-        token.push_back(data[i]);
+        ret[i] = c.unicode();
       }
     }
+    return ret;
+  }();
+  return table;
+}
 
-    if (i == str.length() - 1) {
-      if (token.length() != 0) {
-        tokens << Token(token, start_offset, offset);
-        token.clear();
-      }
+// Decodes the UTF-8 character at the start of input and returns how many
+// bytes it took up.  Invalid sequences and characters outside the Basic
+// Multilingual Plane come back as 0, which is always a separator.
+int DecodeUtf8(const uchar* input, int bytes, ushort* code) {
+  const uchar b0 = input[0];
+  *code = 0;
+
+  if (b0 < 0x80) {
+    *code = b0;
+    return 1;
+  }
+  if ((b0 & 0xe0) == 0xc0) {
+    if (bytes < 2 || (input[1] & 0xc0) != 0x80) return 1;
+    const ushort c = ((b0 & 0x1f) << 6) | (input[1] & 0x3f);
+    if (c >= 0x80) *code = c;
+    return 2;
+  }
+  if ((b0 & 0xf0) == 0xe0) {
+    if (bytes < 3 || (input[1] & 0xc0) != 0x80 || (input[2] & 0xc0) != 0x80) {
+      return 1;
     }
+    const ushort c =
+        ((b0 & 0x0f) << 12) | ((input[1] & 0x3f) << 6) | (input[2] & 0x3f);
+    if (c >= 0x800 && (c < 0xd800 || c > 0xdfff)) *code = c;
+    return 3;
+  }
+  if ((b0 & 0xf8) == 0xf0 && bytes >= 4) {
+    return 4;
   }
+  return 1;
+}
+
+}  // namespace
+
+void Database::FoldedToken::Clear() {
+  size_ = 0;
+  overflow_.clear();
+}
+
+void Database::FoldedToken::Append(ushort code) {
+  char utf8[3];
+  int length;
+  if (code < 0x80) {
+    utf8[0] = code;
+    length = 1;
+  } else if (code < 0x800) {
+    utf8[0] = 0xc0 | (code >> 6);
+    utf8[1] = 0x80 | (code & 0x3f);
+    length = 2;
+  } else {
+    utf8[0] = 0xe0 | (code >> 12);
+    utf8[1] = 0x80 | ((code >> 6) & 0x3f);
+    utf8[2] = 0x80 | (code & 0x3f);
+    length = 3;
+  }
+
+  if (overflow_.empty() && size_ + length <= kInlineSize) {
+    memcpy(data_ + size_, utf8, length);
+  } else {
+    if (overflow_.empty()) overflow_.assign(data_, size_);
+    overflow_.append(utf8, length);
+  }
+  size_ += length;
+}
+
+bool Database::NextToken(const char* input, int bytes, int* offset,
+                         FoldedToken* token) {
+  const uchar* data = reinterpret_cast<const uchar*>(input);
+  const ushort* table = FoldingTable();
+
+  token->Clear();
+
+  int i = *offset;
+  int start = -1;
+  while (i < bytes) {
+    ushort code;
+    const int length = DecodeUtf8(data + i, bytes - i, &code);
+    const ushort folded = table[code];
+
+    if (folded) {
+      if (start == -1) start = i;
+      token->Append(folded);
+    } else if (start != -1) {
+      // Token finished.
+      break;
+    }
+    i += length;
+  }
+
+  *offset = i;
+  if (start == -1) return false;
+
+  token->start_offset = start;
+  token->end_offset = i;
+  return true;
+}
+
+int Database::FTSOpen(sqlite3_tokenizer* pTokenizer, const char* input,
+                      int bytes, sqlite3_tokenizer_cursor** cursor) {
+  UnicodeTokenizerCursor* new_cursor = new UnicodeTokenizerCursor;
+  new_cursor->pTokenizer = pTokenizer;
+  new_cursor->input = input;
+  new_cursor->bytes = bytes < 0 ? strlen(input) : bytes;
+  new_cursor->offset = 0;
+  new_cursor->position = 0;
 
-  new_cursor->tokens = tokens;
   *cursor = reinterpret_cast<sqlite3_tokenizer_cursor*>(new_cursor);
 
   return SQLITE_OK;
@@ -170,25 +255,75 @@ int Database::FTSNext(sqlite3_tokenizer_cursor* cursor, const char** token,
   UnicodeTokenizerCursor* real_cursor =
       reinterpret_cast<UnicodeTokenizerCursor*>(cursor);
 
-  QList<Token> tokens = real_cursor->tokens;
-  if (real_cursor->position >= tokens.size()) {
+  FoldedToken* current = &real_cursor->current;
+  if (!NextToken(real_cursor->input, real_cursor->bytes, &real_cursor->offset,
+                 current)) {
     return SQLITE_DONE;
   }
 
-  Token t = tokens[real_cursor->position];
-  QByteArray utf8 = t.token.toUtf8();
-  *token = utf8.constData();
-  *bytes = utf8.size();
-  *start_offset = t.start_offset;
-  *end_offset = t.end_offset;
+  *token = current->data();
+  *bytes = current->size();
+  *start_offset = current->start_offset;
+  *end_offset = current->end_offset;
   *position = real_cursor->position++;
 
-  real_cursor->current_utf8 = utf8;
+  return SQLITE_OK;
+}
 
+// FTS5 tokenizers don't need any state of their own, but SQLite wants a
+// non-NULL pointer back from xCreate.
+int Database::FTS5Create(void*, const char**, int, Fts5Tokenizer** tokenizer) {
+  static int sDummy;
+  *tokenizer = reinterpret_cast<Fts5Tokenizer*>(&sDummy);
   return SQLITE_OK;
 }
 
+void Database::FTS5Delete(Fts5Tokenizer*) {}
+
+int Database::FTS5Tokenize(Fts5Tokenizer*, void* context, int, const char* text,
+                           int bytes, Fts5TokenCallback callback) {
+  FoldedToken token;
+  int offset = 0;
+  while (NextToken(text, bytes, &offset, &token)) {
+    const int ret = callback(context, 0, token.data(), token.size(),
+                             token.start_offset, token.end_offset);
+    if (ret != SQLITE_OK) return ret;
+  }
+  return SQLITE_OK;
+}
+
+bool Database::RegisterFts5Tokenizer(QSqlDatabase& db) {
+  QVariant handle = db.driver()->handle();
+  if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0) {
+    return false;
+  }
+  sqlite3* connection = *static_cast<sqlite3**>(handle.data());
+  if (!connection) return false;
+
+  // This is the only way to get hold of the FTS5 API - see "Extending FTS5"
+  // in the SQLite documentation.
+  fts5_api* api = nullptr;
+  sqlite3_stmt* statement = nullptr;
+  if (sqlite3_prepare_v2(connection, "SELECT fts5(?1)", -1, &statement,
+                         nullptr) != SQLITE_OK) {
+    return false;
+  }
+  sqlite3_bind_pointer(statement, 1, &api, "fts5_api_ptr", nullptr);
+  sqlite3_step(statement);
+  sqlite3_finalize(statement);
+  if (!api) return false;
+
+  fts5_tokenizer tokenizer = {&Database::FTS5Create, &Database::FTS5Delete,
+                              &Database::FTS5Tokenize};
+  return api->xCreateTokenizer(api, "unicode", nullptr, &tokenizer,
+                               nullptr) == SQLITE_OK;
+}
+
 void Database::StaticInit() {
+  // Build the tokenizer's lookup table now rather than in the middle of a
+  // query.
+  FoldingTable();
+
   sFTSTokenizer = new sqlite3_tokenizer_module;
   sFTSTokenizer->iVersion = 0;
   sFTSTokenizer->xCreate = &Database::FTSCreate;
@@ -205,6 +340,9 @@ Database::Database(Application* app, QObject* parent,
       app_(app),
       mutex_(QMutex::Recursive),
       injected_database_name_(database_name),
+      wal_enabled_(false),
+      wal_checked_(false),
+      backup_cancelled_(0),
       query_hash_(0),
       startup_schema_version_(-1) {
   {
@@ -222,6 +360,65 @@ Database::Database(Application* app, QObject* parent,
   Connect();
 }
 
+void Database::EnableStats(int slow_query_msec) {
+  if (!sStats) sStats = new DatabaseStats(slow_query_msec);
+}
+
+QByteArray Database::FoldText(const QString& text) {
+  const QByteArray utf8 = text.toUtf8();
+
+  QByteArray ret;
+  FoldedToken token;
+  int offset = 0;
+  while (NextToken(utf8.constData(), utf8.size(), &offset, &token)) {
+    if (!ret.isEmpty()) ret.append(' ');
+    ret.append(token.data(), token.size());
+  }
+  return ret;
+}
+
+Database::Locker::Locker(QMutex* mutex, const QString& subsystem)
+    : mutex_(mutex) {
+  if (!mutex_) return;
+
+  if (!sStats) {
+    mutex_->lock();
+    return;
+  }
+
+  // Only record the times somebody else was holding it.
+  if (mutex_->tryLock()) return;
+
+  QElapsedTimer t;
+  t.start();
+  mutex_->lock();
+  sStats->RecordMutexWait(subsystem, t.nsecsElapsed());
+}
+
+Database::~Database() {
+  // Don't wait for a backup to finish copying - the previous one is left where
+  // it was.
+  backup_cancelled_ = 1;
+  backup_future_.waitForFinished();
+}
+
+QString Database::ConnectionName() const {
+  return QString("%1_thread_%2").arg(connection_id_).arg(
+      reinterpret_cast<quint64>(QThread::currentThread()));
+}
+
+void Database::CloseConnection() {
+  const QString connection_id = ConnectionName();
+
+  {
+    QMutexLocker l(&query_cache_mutex_);
+    prepared_queries_.remove(connection_id);
+  }
+
+  QMutexLocker l(&connect_mutex_);
+  QSqlDatabase::removeDatabase(connection_id);
+}
+
 QSqlDatabase Database::Connect() {
   QMutexLocker l(&connect_mutex_);
 
@@ -232,8 +429,7 @@ QSqlDatabase Database::Connect() {
     }
   }
 
-  const QString connection_id = QString("%1_thread_%2").arg(connection_id_).arg(
-      reinterpret_cast<quint64>(QThread::currentThread()));
+  const QString connection_id = ConnectionName();
 
   // Try to find an existing connection for this thread
   QSqlDatabase db = QSqlDatabase::database(connection_id);
@@ -256,6 +452,25 @@ QSqlDatabase Database::Connect() {
   // Find Sqlite3 functions in the Qt plugin.
   StaticInit();
 
+  if (sStats) {
+    QVariant handle = db.driver()->handle();
+    if (handle.isValid() && qstrcmp(handle.typeName(), "sqlite3*") == 0) {
+      sStats->Attach(*static_cast<sqlite3**>(handle.data()));
+    }
+  }
+
+  // Let this connection read while another one is writing.  The journal mode
+  // is remembered in the database file, but setting it again is cheap.
+  const bool wal = EnableWal(db, "main");
+  if (!wal_checked_) {
+    wal_enabled_ = wal;
+    wal_checked_ = true;
+  } else if (wal_enabled_ && !wal) {
+    qLog(Warning) << "Couldn't enable WAL on a new connection, readers will"
+                  << "lock the database from now on";
+    wal_enabled_ = false;
+  }
+
   {
     QSqlQuery set_fts_tokenizer("SELECT fts3_tokenizer(:name, :pointer)", db);
     set_fts_tokenizer.bindValue(":name", "unicode");
@@ -269,6 +484,13 @@ QSqlDatabase Database::Connect() {
     // to release any remaining database locks!
   }
 
+  // The library's FTS tables use FTS5 from schema version 49 on.  The FTS3
+  // tokenizer is still needed to upgrade older databases up to that point.
+  if (!RegisterFts5Tokenizer(db)) {
+    qLog(Warning) << "Couldn't register FTS5 tokenizer - SQLite needs to be"
+                  << "3.20 or later and built with FTS5";
+  }
+
   if (db.tables().count() == 0) {
     // Set up initial schema
     qLog(Info) << "Creating initial database schema";
@@ -289,6 +511,10 @@ QSqlDatabase Database::Connect() {
       qFatal("Couldn't attach external database '%s'",
              key.toAscii().constData());
     }
+
+    if (injected_database_name_.isNull()) {
+      EnableWal(db, key);
+    }
   }
 
   if (startup_schema_version_ == -1) {
@@ -315,6 +541,25 @@ QSqlDatabase Database::Connect() {
   return db;
 }
 
+bool Database::EnableWal(QSqlDatabase& db, const QString& database_name) {
+  QSqlQuery q(QString("PRAGMA %1.journal_mode = WAL").arg(database_name), db);
+  if (!q.exec() || !q.next()) return false;
+
+  if (q.value(0).toString().toLower() != "wal") {
+    qLog(Debug) << "Database" << database_name << "is using journal mode"
+                << q.value(0).toString();
+    return false;
+  }
+  q.finish();
+
+  // With WAL this can only lose the last few commits on power loss, never
+  // corrupt the database, and it saves an fsync on every commit.
+  QSqlQuery sync(QString("PRAGMA %1.synchronous = NORMAL").arg(database_name),
+                 db);
+  sync.exec();
+  return true;
+}
+
 void Database::UpdateMainSchema(QSqlDatabase* db) {
   // Get the database's schema version
   int schema_version = 0;
@@ -362,11 +607,16 @@ void Database::RecreateAttachedDb(const QString& database_name) {
     if (!QFile::remove(filename)) {
       qLog(Warning) << "Failed to remove file" << filename;
     }
+
+    // Don't let SQLite replay the old database's log into the new one.
+    QFile::remove(filename + "-wal");
+    QFile::remove(filename + "-shm");
   }
 
   // We can't just re-attach the database now because it needs to be done for
   // each thread.  Close all the database connections, so each thread will
   // re-attach it when they next connect.
+  ClearQueryCache();
   for (const QString& name : QSqlDatabase::connectionNames()) {
     QSqlDatabase::removeDatabase(name);
   }
@@ -415,7 +665,32 @@ void Database::UpdateDatabaseSchema(int version, QSqlDatabase& db) {
   else
     filename = QString(":/schema/schema-%1.sql").arg(version);
 
-  if (version == 31) {
+  if (version == 49) {
+    // Device FTS tables are called device_*_fts rather than
+    // device_*_songs_fts, so %allsongstables in the schema file doesn't reach
+    // them.
+    ScopedTransaction t(&db);
+
+    for (const QString& table : db.tables()) {
+      if (table.startsWith("device_") && table.endsWith("_fts")) {
+        RecreateFtsTable(table, table.section('_', 0, 1) + "_songs", db);
+      }
+    }
+    qLog(Debug) << "Applying database schema update" << version << "from"
+                << filename;
+    ExecSchemaCommandsFromFile(db, filename, version - 1, true);
+    t.Commit();
+  } else if (version == 47 || version == 50) {
+    // %allsongstables can't be used for indexes, which need a different name
+    // on each table.
+    ScopedTransaction t(&db);
+
+    qLog(Debug) << "Applying database schema update" << version << "from"
+                << filename;
+    ExecSchemaCommandsFromFile(db, filename, version - 1, true);
+    CreateDeviceSongsIndexes(filename, db);
+    t.Commit();
+  } else if (version == 31) {
     // This version used to do a bad job of converting filenames in the songs
     // table to file:// URLs.  Now we do it properly here instead.
     ScopedTransaction t(&db);
@@ -439,6 +714,57 @@ void Database::UpdateDatabaseSchema(int version, QSqlDatabase& db) {
   }
 }
 
+void Database::RecreateFtsTable(const QString& fts_table,
+                                const QString& songs_table, QSqlDatabase& db) {
+  qLog(Info) << "Moving" << fts_table << "to FTS5";
+
+  const QStringList commands =
+      QStringList()
+      << QString("DROP TABLE %1").arg(fts_table)
+      << QString(
+             "CREATE VIRTUAL TABLE %1 USING fts5("
+             "  ftstitle, ftsalbum, ftsartist, ftsalbumartist, ftscomposer,"
+             "  ftsperformer, ftsgrouping, ftsgenre, ftscomment,"
+             "  tokenize='unicode', prefix='2 3')").arg(fts_table)
+      << QString(
+             "INSERT INTO %1 (ROWID, ftstitle, ftsalbum, ftsartist,"
+             "  ftsalbumartist, ftscomposer, ftsperformer, ftsgrouping,"
+             "  ftsgenre, ftscomment)"
+             " SELECT ROWID, title, album, artist, albumartist, composer,"
+             "  performer, grouping, genre, comment"
+             " FROM %2").arg(fts_table, songs_table);
+
+  for (const QString& command : commands) {
+    QSqlQuery query(db.exec(command));
+    if (CheckErrors(query)) qFatal("Unable to update music library database");
+  }
+}
+
+void Database::CreateDeviceSongsIndexes(const QString& filename,
+                                        QSqlDatabase& db) {
+  QFile schema_file(filename);
+  if (!schema_file.open(QIODevice::ReadOnly))
+    qFatal("Couldn't open schema file %s", filename.toUtf8().constData());
+  const QStringList commands(
+      QString::fromUtf8(schema_file.readAll()).split(QRegExp("; *\n\n")));
+
+  // Device tables name their indexes like device-schema.sql does:
+  // idx_device_1_songs_foo for idx_foo.
+  QRegExp index_re("CREATE INDEX idx_(\\w+) ON songs (\\(.*\\))");
+  for (const QString& table : db.tables()) {
+    if (!table.startsWith("device_") || !table.endsWith("_songs")) continue;
+
+    for (const QString& command : commands) {
+      if (!index_re.exactMatch(command.trimmed())) continue;
+
+      QSqlQuery query(db.exec(QString("CREATE INDEX idx_%1_%2 ON %1 %3")
+                                  .arg(table, index_re.cap(1),
+                                       index_re.cap(2))));
+      if (CheckErrors(query)) qFatal("Unable to update music library database");
+    }
+  }
+}
+
 void Database::UrlEncodeFilenameColumn(const QString& table, QSqlDatabase& db) {
   QSqlQuery select(QString("SELECT ROWID, filename FROM %1").arg(table), db);
   QSqlQuery update(
@@ -572,6 +898,85 @@ bool Database::CheckErrors(const QSqlQuery& query) {
   return false;
 }
 
+Database::PreparedQuery::PreparedQuery(const QSqlQuery& query,
+                                       Database* database,
+                                       const QString& connection,
+                                       const QString& sql)
+    : QSqlQuery(query),
+      database_(database),
+      connection_(connection),
+      sql_(sql) {}
+
+Database::PreparedQuery::PreparedQuery(PreparedQuery&& other)
+    : QSqlQuery(other),
+      database_(other.database_),
+      connection_(other.connection_),
+      sql_(other.sql_) {
+  other.database_ = nullptr;
+}
+
+Database::PreparedQuery::~PreparedQuery() {
+  if (database_) database_->ReturnCachedQuery(connection_, sql_, this);
+}
+
+Database::PreparedQuery Database::CachedQuery(const QString& sql,
+                                              QSqlDatabase& db) {
+  const QString connection = db.connectionName();
+
+  {
+    QMutexLocker l(&query_cache_mutex_);
+    QueryCache& cache = prepared_queries_[connection];
+
+    QHash<QString, QSqlQuery>::iterator it = cache.queries_.find(sql);
+    if (it != cache.queries_.end()) {
+      const QSqlQuery q(*it);
+      cache.queries_.erase(it);
+      cache.lru_.removeOne(sql);
+      return PreparedQuery(q, this, connection, sql);
+    }
+  }
+
+  // Nobody's asked for this SQL before, or somebody's still using the cached
+  // query, so prepare another.
+  QSqlQuery q(db);
+  q.setForwardOnly(true);
+  if (!q.prepare(sql)) {
+    // Don't cache it - the caller will see the error when it runs exec().
+    return PreparedQuery(q, nullptr, QString(), QString());
+  }
+
+  return PreparedQuery(q, this, connection, sql);
+}
+
+void Database::ReturnCachedQuery(const QString& connection,
+                                 const QString& sql, QSqlQuery* query) {
+  // Let go of anything the last caller didn't read.
+  query->finish();
+
+  QMutexLocker l(&query_cache_mutex_);
+
+  // The connection might have been closed since.
+  QHash<QString, QueryCache>::iterator cache =
+      prepared_queries_.find(connection);
+  if (cache == prepared_queries_.end()) return;
+
+  // If a nested caller had its own copy, one is enough.
+  if (cache->queries_.contains(sql)) return;
+
+  cache->queries_.insert(sql, *query);
+  cache->lru_ << sql;
+
+  // Callers that build SQL with values in it would fill the cache forever.
+  while (cache->lru_.count() > kMaxCachedQueries) {
+    cache->queries_.remove(cache->lru_.takeFirst());
+  }
+}
+
+void Database::ClearQueryCache() {
+  QMutexLocker l(&query_cache_mutex_);
+  prepared_queries_.clear();
+}
+
 bool Database::IntegrityCheck(QSqlDatabase db) {
   qLog(Debug) << "Starting database integrity check";
   int task_id = app_->task_manager()->StartTask(tr("Integrity check"));
@@ -606,15 +1011,72 @@ bool Database::IntegrityCheck(QSqlDatabase db) {
 }
 
 void Database::DoBackup() {
+  if (backup_future_.isRunning()) return;
+
   QSqlDatabase db(this->Connect());
+  backup_future_ = QtConcurrent::run(this, &Database::BackupInBackground,
+                                     db.databaseName());
+}
 
-  // Before we overwrite anything, make sure the database is not corrupt
-  QMutexLocker l(&mutex_);
-  const bool ok = IntegrityCheck(db);
+void Database::BackupInBackground(const QString& filename) {
+  const QString dest_filename = filename + ".bak";
+  const QString temp_filename = dest_filename + ".tmp";
+
+  // Take the fingerprint first, so anything written while the backup runs
+  // makes the next one happen too.
+  const QString fingerprint = BackupFingerprint(filename);
+
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  if (QFile::exists(dest_filename) &&
+      s.value("backup_fingerprint").toString() == fingerprint) {
+    qLog(Debug) << "Database hasn't changed since the last backup";
+    return;
+  }
+
+  // Before we overwrite anything, make sure the database is not corrupt.
+  // This is a QtConcurrent thread that mightn't run a backup again, so don't
+  // leave its connection open.
+  bool ok = false;
+  {
+    QMutexLocker l(ReadMutex());
+    ok = IntegrityCheck(Connect());
+  }
+  CloseConnection();
+  if (!ok) return;
 
-  if (ok) {
-    BackupFile(db.databaseName());
+  QFile::remove(temp_filename);
+  if (!BackupFile(filename, temp_filename)) {
+    QFile::remove(temp_filename);
+    return;
   }
+
+  QFile::remove(dest_filename);
+  if (!QFile::rename(temp_filename, dest_filename)) {
+    qLog(Error) << "Failed to replace database backup" << dest_filename;
+    return;
+  }
+
+  s.setValue("backup_fingerprint", fingerprint);
+}
+
+QString Database::BackupFingerprint(const QString& filename) const {
+  // In WAL mode SQLite doesn't bump the change counter in the database header
+  // on every commit, and PRAGMA data_version only counts changes made since
+  // its own connection was opened, so neither survives a restart.  Every
+  // commit does write to the WAL though, and checkpoints write to the
+  // database file.
+  QStringList ret;
+  for (const QString& name : QStringList() << filename << filename + "-wal") {
+    QFileInfo info(name);
+    if (info.exists()) {
+      ret << QString::number(info.size())
+          << QString::number(info.lastModified().toTime_t());
+    } else {
+      ret << "-";
+    }
+  }
+  return ret.join(":");
 }
 
 bool Database::OpenDatabase(const QString& filename,
@@ -633,9 +1095,9 @@ bool Database::OpenDatabase(const QString& filename,
   return true;
 }
 
-void Database::BackupFile(const QString& filename) {
+bool Database::BackupFile(const QString& filename,
+                          const QString& dest_filename) {
   qLog(Debug) << "Starting database backup";
-  QString dest_filename = QString("%1.bak").arg(filename);
   const int task_id =
       app_->task_manager()->StartTask(tr("Backing up database"));
 
@@ -652,12 +1114,21 @@ void Database::BackupFile(const QString& filename) {
 
   bool success = OpenDatabase(filename, &source_connection);
   if (!success) {
-    return;
+    return false;
   }
 
   success = OpenDatabase(dest_filename, &dest_connection);
   if (!success) {
-    return;
+    return false;
+  }
+
+  // Writes from other connections between steps would make SQLite start the
+  // backup again from the first page.  In WAL mode an open read transaction
+  // gives the backup a snapshot of its own instead, without blocking writers.
+  if (wal_enabled_) {
+    sqlite3_exec(source_connection,
+                 "BEGIN; SELECT COUNT(*) FROM sqlite_master;", nullptr,
+                 nullptr, nullptr);
   }
 
   sqlite3_backup* backup =
@@ -665,20 +1136,29 @@ void Database::BackupFile(const QString& filename) {
   if (!backup) {
     const char* error_message = sqlite3_errmsg(dest_connection);
     qLog(Error) << "Failed to start database backup:" << error_message;
-    return;
+    return false;
   }
 
   int ret = SQLITE_OK;
-  do {
-    ret = sqlite3_backup_step(backup, 16);
+  forever {
+    if (backup_cancelled_) {
+      qLog(Info) << "Database backup cancelled";
+      break;
+    }
+
+    ret = sqlite3_backup_step(backup, kBackupPagesPerStep);
     const int page_count = sqlite3_backup_pagecount(backup);
     app_->task_manager()->SetTaskProgress(
         task_id, page_count - sqlite3_backup_remaining(backup), page_count);
-  } while (ret == SQLITE_OK);
 
-  if (ret != SQLITE_DONE) {
+    if (ret != SQLITE_OK && ret != SQLITE_BUSY && ret != SQLITE_LOCKED) break;
+    sqlite3_sleep(kBackupStepPauseMsec);
+  }
+
+  if (ret != SQLITE_DONE && !backup_cancelled_) {
     qLog(Error) << "Database backup failed";
   }
 
   sqlite3_backup_finish(backup);
+  return ret == SQLITE_DONE;
 }
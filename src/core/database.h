@@ -18,15 +18,21 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <QAtomicInt>
+#include <QFuture>
+#include <QHash>
 #include <QMap>
 #include <QMutex>
 #include <QObject>
 #include <QSqlDatabase>
 #include <QSqlError>
+#include <QSqlQuery>
 #include <QStringList>
 
 #include <sqlite3.h>
 
+#include <string>
+
 #include "gtest/gtest_prod.h"
 
 extern "C" {
@@ -37,6 +43,7 @@ struct sqlite3_tokenizer_module;
 }
 
 class Application;
+class DatabaseStats;
 
 class Database : public QObject {
   Q_OBJECT
@@ -44,6 +51,7 @@ class Database : public QObject {
  public:
   Database(Application* app, QObject* parent = nullptr,
            const QString& database_name = QString());
+  ~Database();
 
   struct AttachedDatabase {
     AttachedDatabase() {}
@@ -59,11 +67,85 @@ class Database : public QObject {
   static const int kSchemaVersion;
   static const char* kDatabaseFilename;
   static const char* kMagicAllSongsTables;
+  static const char* kSettingsGroup;
+
+  // Backups copy this many pages at a time, pausing in between so the rest of
+  // the app can still get to the disk.
+  static const int kBackupPagesPerStep;
+  static const int kBackupStepPauseMsec;
+
+  // Locks a mutex like QMutexLocker, and if stats are being recorded adds the
+  // time spent waiting for it to the subsystem's total.
+  class Locker {
+   public:
+    Locker(QMutex* mutex, const QString& subsystem);
+    ~Locker() {
+      if (mutex_) mutex_->unlock();
+    }
+
+   private:
+    Q_DISABLE_COPY(Locker);
+    QMutex* mutex_;
+  };
+
+  // A query handed out by CachedQuery().  It's checked out of the cache until
+  // it's destroyed, so anyone who asks for the same SQL meanwhile - a nested
+  // loop, say - gets a statement of their own.  Use it like any QSqlQuery.
+  class PreparedQuery : public QSqlQuery {
+   public:
+    PreparedQuery(PreparedQuery&& other);
+    ~PreparedQuery();
+
+   private:
+    friend class Database;
+    PreparedQuery(const QSqlQuery& query, Database* database,
+                  const QString& connection, const QString& sql);
+    Q_DISABLE_COPY(PreparedQuery);
+
+    Database* database_;
+    QString connection_;
+    QString sql_;
+  };
+
+  // Starts recording timings for every statement run on connections opened
+  // after this is called.  Statements slower than slow_query_msec are logged.
+  static void EnableStats(int slow_query_msec);
+  // NULL unless EnableStats() has been called.
+  static DatabaseStats* stats() { return sStats; }
 
+  // Splits the text into words the same way as the FTS tokenizer - lower
+  // case, without diacritics or punctuation - and joins them with single
+  // spaces.
+  static QByteArray FoldText(const QString& text);
+
+  // Returns this thread's connection to the database, opening it if needed.
+  // Every connection can read and write - writers take turns by holding
+  // Mutex() rather than handing their work to a single writer thread.
   QSqlDatabase Connect();
   bool CheckErrors(const QSqlQuery& query);
+
+  // Returns a forward-only query on db that has already been prepared with
+  // the given SQL.  Each connection keeps the queries it has prepared, so
+  // code that runs the same statement over and over doesn't pay for
+  // sqlite3_prepare_v2 every time.  Bind every value before calling exec().
+  // The query goes back to the cache, finished, when it's destroyed.
+  PreparedQuery CachedQuery(const QString& sql, QSqlDatabase& db);
+
+  // Finalizes every cached query.  Must be called before a connection that
+  // has used CachedQuery() is closed.
+  void ClearQueryCache();
+
+  // Anything that writes to the database must hold this mutex, so only one
+  // thread writes at a time.
   QMutex* Mutex() { return &mutex_; }
 
+  // Anything that only reads from the database should hold this one instead.
+  // The database is in WAL mode, so each thread's connection can read while
+  // another thread is writing and this returns NULL - QMutexLocker does
+  // nothing with it.  In-memory databases can't use WAL, and there this is
+  // the same as Mutex().
+  QMutex* ReadMutex() { return wal_enabled_ ? nullptr : &mutex_; }
+
   void RecreateAttachedDb(const QString& database_name);
   void ExecSchemaCommands(QSqlDatabase& db, const QString& schema,
                           int schema_version, bool in_transaction = false);
@@ -82,6 +164,8 @@ signals:
   void Error(const QString& message);
 
  public slots:
+  // Backs up the database to clementine.db.bak on a worker thread, unless it
+  // hasn't changed since the last backup.
   void DoBackup();
 
  private:
@@ -94,11 +178,31 @@ signals:
                               const QStringList& commands);
 
   void UpdateDatabaseSchema(int version, QSqlDatabase& db);
+  // Replaces an FTS3 table with an FTS5 one indexing the same songs.
+  void RecreateFtsTable(const QString& fts_table, const QString& songs_table,
+                        QSqlDatabase& db);
+  // Creates the indexes that a schema file adds to the songs table on every
+  // device's songs table as well.
+  void CreateDeviceSongsIndexes(const QString& filename, QSqlDatabase& db);
   void UrlEncodeFilenameColumn(const QString& table, QSqlDatabase& db);
   QStringList SongsTables(QSqlDatabase& db, int schema_version) const;
+  // The name of this thread's connection.
+  QString ConnectionName() const;
+  // Closes this thread's connection and throws away its prepared queries.
+  // For threads that won't use the database again.
+  void CloseConnection();
   bool IntegrityCheck(QSqlDatabase db);
-  void BackupFile(const QString& filename);
+  // Puts a query from CachedQuery() back in the cache when it's destroyed.
+  void ReturnCachedQuery(const QString& connection, const QString& sql,
+                         QSqlQuery* query);
+  void BackupInBackground(const QString& filename);
+  // Something that changes whenever the database file or its WAL is written.
+  QString BackupFingerprint(const QString& filename) const;
+  bool BackupFile(const QString& filename, const QString& dest_filename);
   bool OpenDatabase(const QString& filename, sqlite3** connection) const;
+  // Switches the given database on this connection to WAL mode.  Returns
+  // false if SQLite refused, which it does for in-memory databases.
+  bool EnableWal(QSqlDatabase& db, const QString& database_name);
 
   Application* app_;
 
@@ -109,10 +213,34 @@ signals:
   QMutex connect_mutex_;
   QMutex mutex_;
 
+  // The prepared queries on one connection that nobody's using right now.
+  struct QueryCache {
+    // SQL -> prepared query.
+    QHash<QString, QSqlQuery> queries_;
+    // The SQL of those queries, least recently used first.
+    QStringList lru_;
+  };
+  static const int kMaxCachedQueries;
+  QMutex query_cache_mutex_;
+  // Connection name -> cache.
+  QHash<QString, QueryCache> prepared_queries_;
+
+  // Whether the main database on every connection is in WAL mode, so readers
+  // don't need to lock mutex_.  Set when the first connection is opened.
+  bool wal_enabled_;
+  bool wal_checked_;
+
+  QFuture<void> backup_future_;
+  QAtomicInt backup_cancelled_;
+
   // This ID makes the QSqlDatabase name unique to the object as well as the
   // thread
   int connection_id_;
 
+  // Shared by every Database, and never deleted because connections can outlive
+  // the Database that opened them.
+  static DatabaseStats* sStats;
+
   static QMutex sNextConnectionIdMutex;
   static int sNextConnectionId;
 
@@ -130,6 +258,7 @@ signals:
   FRIEND_TEST(DatabaseTest, FTSOpenParsesMultipleTokens);
   FRIEND_TEST(DatabaseTest, FTSCursorWorks);
   FRIEND_TEST(DatabaseTest, FTSOpenLeavesCyrillicQueries);
+  FRIEND_TEST(DatabaseTest, FTSOpenParsesLongTokens);
 
   // Do static initialisation like loading sqlite functions.
   static void StaticInit();
@@ -152,13 +281,51 @@ signals:
   static int FTSNext(sqlite3_tokenizer_cursor* cursor, const char** token,
                      int* bytes, int* start_offset, int* end_offset,
                      int* position);
-  struct Token {
-    Token(const QString& token, int start, int end);
-    QString token;
+
+  // The same tokenizer for FTS5, which has a different API.
+  typedef int (*Fts5TokenCallback)(void* context, int flags, const char* token,
+                                   int bytes, int start_offset,
+                                   int end_offset);
+  static bool RegisterFts5Tokenizer(QSqlDatabase& db);
+  static int FTS5Create(void* context, const char** argv, int argc,
+                        Fts5Tokenizer** tokenizer);
+  static void FTS5Delete(Fts5Tokenizer* tokenizer);
+  static int FTS5Tokenize(Fts5Tokenizer* tokenizer, void* context, int flags,
+                          const char* text, int bytes,
+                          Fts5TokenCallback callback);
+
+  // One token, lower cased and with its diacritics removed, as UTF-8.  Tokens
+  // that fit in data_ don't need any memory allocating at all, and longer
+  // ones reuse overflow_'s memory.
+  class FoldedToken {
+   public:
+    FoldedToken() : size_(0), start_offset(0), end_offset(0) {}
+
+    void Clear();
+    void Append(ushort code);
+    const char* data() const {
+      return overflow_.empty() ? data_ : overflow_.data();
+    }
+    int size() const { return size_; }
+
+   private:
+    static const int kInlineSize = 128;
+    char data_[kInlineSize];
+    std::string overflow_;
+    int size_;
+
+   public:
+    // Byte offsets of the token in the input.  end_offset is one past the
+    // last byte.
     int start_offset;
     int end_offset;
   };
 
+  // Finds the next token in the UTF-8 input, starting at *offset, and moves
+  // *offset past it.  Returns false if there aren't any more.
+  static bool NextToken(const char* input, int bytes, int* offset,
+                        FoldedToken* token);
+
   // Based on sqlite3_tokenizer.
   struct UnicodeTokenizer {
     const sqlite3_tokenizer_module* pModule;
@@ -167,9 +334,11 @@ signals:
   struct UnicodeTokenizerCursor {
     const sqlite3_tokenizer* pTokenizer;
 
-    QList<Token> tokens;
+    const char* input;
+    int bytes;
+    int offset;
     int position;
-    QByteArray current_utf8;
+    FoldedToken current;
   };
 };
 
@@ -179,6 +348,7 @@ class MemoryDatabase : public Database {
       : Database(app, parent, ":memory:") {}
   ~MemoryDatabase() {
     // Make sure Qt doesn't reuse the same database
+    ClearQueryCache();
     QSqlDatabase::removeDatabase(Connect().connectionName());
   }
 };
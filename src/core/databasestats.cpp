@@ -0,0 +1,240 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "databasestats.h"
+
+#include <QRegExp>
+#include <QStringList>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+
+#include "core/logging.h"
+
+const qint64 DatabaseStats::kBucketLimitsNsec[] = {
+    100000ll, 1000000ll, 10000000ll, 100000000ll, 1000000000ll};
+const int DatabaseStats::kBucketCount =
+    sizeof(kBucketLimitsNsec) / sizeof(kBucketLimitsNsec[0]) + 1;
+const int DatabaseStats::kMaxSlowQueries = 100;
+
+namespace {
+
+// Statements with literal lists of IDs are all different, so don't let the
+// cache of normalised SQL grow forever.
+const int kMaxNormalisedStatements = 1000;
+
+double Msec(qint64 nsec) { return nsec / 1000000.0; }
+
+}  // namespace
+
+DatabaseStats::DatabaseStats(int slow_query_msec)
+    : slow_query_nsec_(qint64(slow_query_msec) * 1000000) {}
+
+void DatabaseStats::Attach(sqlite3* connection) {
+  sqlite3_trace_v2(connection, SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW,
+                   &DatabaseStats::TraceCallback, this);
+}
+
+int DatabaseStats::TraceCallback(unsigned int type, void* context, void* p,
+                                 void* x) {
+  DatabaseStats* me = reinterpret_cast<DatabaseStats*>(context);
+  sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(p);
+
+  // SQLite runs some statements of its own while creating tables, which
+  // don't have any SQL.
+  if (!sqlite3_sql(statement)) return 0;
+
+  switch (type) {
+    case SQLITE_TRACE_ROW: {
+      QMutexLocker l(&me->mutex_);
+      me->pending_rows_[statement]++;
+      break;
+    }
+
+    case SQLITE_TRACE_PROFILE:
+      me->StatementFinished(statement,
+                            *reinterpret_cast<sqlite3_int64*>(x));
+      break;
+  }
+  return 0;
+}
+
+void DatabaseStats::StatementFinished(sqlite3_stmt* statement, qint64 nsec) {
+  const QString sql = QString::fromUtf8(sqlite3_sql(statement));
+
+  // Get the values before the statement is reset, in case it's a slow one.
+  QString expanded_sql;
+  if (nsec >= slow_query_nsec_) {
+    char* expanded = sqlite3_expanded_sql(statement);
+    expanded_sql = QString::fromUtf8(expanded);
+    sqlite3_free(expanded);
+  }
+
+  Key key;
+  qint64 rows = 0;
+  {
+    QMutexLocker l(&mutex_);
+    rows = pending_rows_.take(statement);
+
+    if (normalised_.contains(sql)) {
+      key = normalised_[sql];
+    } else {
+      const QString normalised = NormaliseSql(sql);
+      key = Key(Subsystem(normalised), normalised);
+      if (normalised_.count() >= kMaxNormalisedStatements) normalised_.clear();
+      normalised_[sql] = key;
+    }
+  }
+
+  RecordStatement(key.first, key.second, nsec, rows);
+
+  if (!expanded_sql.isNull()) {
+    SlowQuery slow;
+    slow.when_ = QDateTime::currentDateTime();
+    slow.subsystem_ = key.first;
+    slow.sql_ = expanded_sql;
+    slow.nsec_ = nsec;
+
+    qLog(Info) << "Slow query on" << slow.subsystem_ << "took" << Msec(nsec)
+               << "ms:" << slow.sql_;
+
+    QMutexLocker l(&mutex_);
+    slow_queries_ << slow;
+    while (slow_queries_.count() > kMaxSlowQueries) {
+      slow_queries_.removeFirst();
+    }
+  }
+}
+
+void DatabaseStats::RecordStatement(const QString& subsystem,
+                                    const QString& sql, qint64 nsec,
+                                    qint64 rows) {
+  QMutexLocker l(&mutex_);
+  Statement& s = statements_[Key(subsystem, sql)];
+  if (s.histogram_.isEmpty()) {
+    for (int i = 0; i < kBucketCount; ++i) s.histogram_ << 0;
+  }
+
+  s.count_++;
+  s.rows_ += rows;
+  s.total_nsec_ += nsec;
+  s.max_nsec_ = qMax(s.max_nsec_, nsec);
+  s.histogram_[BucketForNsec(nsec)]++;
+}
+
+void DatabaseStats::RecordMutexWait(const QString& subsystem, qint64 nsec) {
+  QMutexLocker l(&mutex_);
+  QPair<int, qint64>& wait = mutex_waits_[subsystem];
+  wait.first++;
+  wait.second += nsec;
+}
+
+DatabaseStats::Statement DatabaseStats::statement(const QString& subsystem,
+                                                  const QString& sql) const {
+  QMutexLocker l(&mutex_);
+  return statements_.value(Key(subsystem, sql));
+}
+
+QList<DatabaseStats::SlowQuery> DatabaseStats::slow_queries() const {
+  QMutexLocker l(&mutex_);
+  return slow_queries_;
+}
+
+qint64 DatabaseStats::mutex_wait_nsec(const QString& subsystem) const {
+  QMutexLocker l(&mutex_);
+  return mutex_waits_.value(subsystem).second;
+}
+
+int DatabaseStats::BucketForNsec(qint64 nsec) {
+  for (int i = 0; i < kBucketCount - 1; ++i) {
+    if (nsec < kBucketLimitsNsec[i]) return i;
+  }
+  return kBucketCount - 1;
+}
+
+QString DatabaseStats::NormaliseSql(const QString& sql) {
+  QString ret = sql.simplified();
+  if (ret.endsWith(';')) ret.chop(1);
+  ret.replace(QRegExp("'([^']|'')*'"), "?");
+  ret.replace(QRegExp("\\b\\d+(\\.\\d+)?\\b"), "?");
+  ret.replace(QRegExp("[:@$]\\w+"), "?");
+  ret.replace(QRegExp("\\(\\s*\\?(\\s*,\\s*\\?)+\\s*\\)"), "(?, ...)");
+  return ret;
+}
+
+QString DatabaseStats::Subsystem(const QString& normalised_sql) {
+  QRegExp table("\\b(FROM|INTO|UPDATE|TABLE)\\s+([\\w.]+)",
+                Qt::CaseInsensitive);
+
+  if (table.indexIn(normalised_sql) == -1) return "other";
+  return table.cap(2);
+}
+
+QStringList DatabaseStats::Dump() const {
+  QMutexLocker l(&mutex_);
+
+  // Slowest in total first.
+  QList<Key> keys = statements_.keys();
+  std::sort(keys.begin(), keys.end(), [this](const Key& a, const Key& b) {
+    return statements_[a].total_nsec_ > statements_[b].total_nsec_;
+  });
+
+  QStringList buckets;
+  for (int i = 0; i < kBucketCount - 1; ++i) {
+    buckets << QString("<%1ms").arg(Msec(kBucketLimitsNsec[i]));
+  }
+  buckets << QString(">=%1ms").arg(Msec(kBucketLimitsNsec[kBucketCount - 2]));
+
+  QStringList ret;
+  ret << "Database statements, slowest first.  Columns are count, total ms,"
+         " max ms, rows and a histogram of " + buckets.join(" ");
+
+  for (const Key& key : keys) {
+    const Statement& s = statements_[key];
+    QStringList histogram;
+    for (int count : s.histogram_) histogram << QString::number(count);
+
+    ret << QString("  %1 %2 %3 %4 %5 [%6] %7")
+               .arg(key.first, -20)
+               .arg(s.count_, 7)
+               .arg(Msec(s.total_nsec_), 10, 'f', 1)
+               .arg(Msec(s.max_nsec_), 8, 'f', 1)
+               .arg(s.rows_, 8)
+               .arg(histogram.join(" "), key.second);
+  }
+
+  ret << "Time spent waiting for the database mutex:";
+  for (auto it = mutex_waits_.constBegin(); it != mutex_waits_.constEnd();
+       ++it) {
+    ret << QString("  %1 %2 waits, %3 ms")
+               .arg(it.key(), -20)
+               .arg(it.value().first, 7)
+               .arg(Msec(it.value().second), 10, 'f', 1);
+  }
+
+  ret << QString("Statements slower than %1 ms:").arg(Msec(slow_query_nsec_));
+  for (const SlowQuery& slow : slow_queries_) {
+    ret << QString("  %1 %2 %3 ms %4")
+               .arg(slow.when_.toString(Qt::ISODate))
+               .arg(slow.subsystem_, -20)
+               .arg(Msec(slow.nsec_), 8, 'f', 1)
+               .arg(slow.sql_);
+  }
+
+  return ret;
+}
@@ -0,0 +1,113 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASESTATS_H
+#define DATABASESTATS_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// Records how long each database statement takes, how many rows it returns
+// and how long callers wait for the database mutex.  Statements are grouped by
+// their SQL with the literals taken out, and by the subsystem that ran them -
+// the table the statement is about, which tells the library, devices,
+// playlists and internet services apart.
+//
+// Statements slower than the threshold are logged as they finish and the
+// last few are kept for Dump().  All the functions are thread-safe.
+class DatabaseStats {
+ public:
+  DatabaseStats(int slow_query_msec);
+
+  // Upper bounds of each bucket in the latency histograms.  The last bucket
+  // has everything slower than that.
+  static const qint64 kBucketLimitsNsec[];
+  static const int kBucketCount;
+  static const int kMaxSlowQueries;
+
+  struct Statement {
+    Statement() : count_(0), rows_(0), total_nsec_(0), max_nsec_(0) {}
+
+    int count_;
+    qint64 rows_;
+    qint64 total_nsec_;
+    qint64 max_nsec_;
+    QList<int> histogram_;
+  };
+
+  struct SlowQuery {
+    QDateTime when_;
+    QString subsystem_;
+    QString sql_;
+    qint64 nsec_;
+  };
+
+  // Starts recording every statement run on this connection.
+  void Attach(sqlite3* connection);
+
+  void RecordStatement(const QString& subsystem, const QString& sql,
+                       qint64 nsec, qint64 rows);
+  void RecordMutexWait(const QString& subsystem, qint64 nsec);
+
+  // Returns a copy of what's been recorded for this statement.
+  Statement statement(const QString& subsystem, const QString& sql) const;
+  QList<SlowQuery> slow_queries() const;
+  qint64 mutex_wait_nsec(const QString& subsystem) const;
+
+  // A human readable report of everything recorded so far.
+  QStringList Dump() const;
+
+  // Replaces string and number literals and lists of values with ?, collapses
+  // whitespace and drops any trailing semicolon, so the same statement with
+  // different values is only recorded once.
+  static QString NormaliseSql(const QString& sql);
+
+  // The first table the statement reads or writes, or "other".
+  static QString Subsystem(const QString& normalised_sql);
+
+  static int BucketForNsec(qint64 nsec);
+
+ private:
+  static int TraceCallback(unsigned int type, void* context, void* p, void* x);
+  void StatementFinished(sqlite3_stmt* statement, qint64 nsec);
+
+  typedef QPair<QString, QString> Key;
+
+  const qint64 slow_query_nsec_;
+
+  mutable QMutex mutex_;
+  QHash<Key, Statement> statements_;
+  QHash<QString, QPair<int, qint64> > mutex_waits_;
+  QList<SlowQuery> slow_queries_;
+
+  // Rows returned so far by statements that are still running.
+  QHash<sqlite3_stmt*, qint64> pending_rows_;
+
+  // Raw SQL -> normalised SQL and subsystem, so the regular expressions only
+  // run once for each statement.
+  QHash<QString, Key> normalised_;
+};
+
+#endif  // DATABASESTATS_H
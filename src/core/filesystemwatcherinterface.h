@@ -19,6 +19,7 @@
 #define FILESYSTEMWATCHERINTERFACE_H
 
 #include <QObject>
+#include <QStringList>
 
 class FileSystemWatcherInterface : public QObject {
   Q_OBJECT
@@ -33,6 +34,20 @@ class FileSystemWatcherInterface : public QObject {
 
 signals:
   void PathChanged(const QString& path);
+
+  // Emitted instead of PathChanged by listeners that know which files in a
+  // directory were created, modified, moved or deleted.  files are absolute
+  // paths directly inside path.
+  void FilesChanged(const QString& path, const QStringList& files);
+
+  // Emitted when a path couldn't be watched, for example because the system's
+  // limit on the number of watches was reached.  Changes to it won't be
+  // reported.
+  void PathNotWatched(const QString& path);
+
+  // Emitted when the listener missed some events and changes to any of the
+  // paths might not have been reported.
+  void EventsLost();
 };
 
 #endif
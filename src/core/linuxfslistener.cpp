@@ -0,0 +1,417 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "linuxfslistener.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QSocketNotifier>
+#include <QStringList>
+
+#include "core/logging.h"
+
+const int LinuxFSListener::kCoalesceIntervalMsec = 500;
+
+namespace {
+
+const uint32_t kInotifyMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB |
+                              IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+#ifdef FAN_REPORT_DFID_NAME
+const uint64_t kFanotifyMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM |
+                               FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ATTRIB |
+                               FAN_ONDIR;
+#endif
+
+quint64 FilesystemId(const void* fsid) {
+  // fsid_t and __kernel_fsid_t are both two ints.
+  quint64 ret;
+  memcpy(&ret, fsid, sizeof(ret));
+  return ret;
+}
+
+#ifdef FAN_REPORT_DFID_NAME
+QByteArray HandleKey(quint64 fsid, const file_handle* handle) {
+  QByteArray ret(reinterpret_cast<const char*>(&fsid), sizeof(fsid));
+  ret.append(reinterpret_cast<const char*>(&handle->handle_type),
+             sizeof(handle->handle_type));
+  ret.append(reinterpret_cast<const char*>(handle->f_handle),
+             handle->handle_bytes);
+  return ret;
+}
+#endif
+
+}  // namespace
+
+LinuxFSListener::LinuxFSListener(QObject* parent)
+    : FileSystemWatcherInterface(parent),
+      backend_(Backend_None),
+      fd_(-1),
+      notifier_(nullptr),
+      watch_limit_reached_(false),
+      coalesce_timer_(new QTimer(this)) {
+  coalesce_timer_->setSingleShot(true);
+  coalesce_timer_->setInterval(kCoalesceIntervalMsec);
+  connect(coalesce_timer_, SIGNAL(timeout()), SLOT(EmitPendingChanges()));
+}
+
+LinuxFSListener::~LinuxFSListener() { Close(); }
+
+void LinuxFSListener::Init() {
+  if (InitFanotify()) {
+    qLog(Info) << "Watching the library with fanotify";
+  } else if (InitInotify()) {
+    qLog(Info) << "Watching the library with inotify";
+  } else {
+    qLog(Warning) << "Couldn't initialise fanotify or inotify:"
+                  << strerror(errno);
+  }
+}
+
+bool LinuxFSListener::InitFanotify() {
+#ifdef FAN_REPORT_DFID_NAME
+  // This fails with EPERM unless we have CAP_SYS_ADMIN.
+  fd_ = fanotify_init(
+      FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+      O_RDONLY | O_LARGEFILE);
+  if (fd_ == -1) return false;
+
+  backend_ = Backend_Fanotify;
+  CreateNotifier();
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool LinuxFSListener::InitInotify() {
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ == -1) return false;
+
+  backend_ = Backend_Inotify;
+  CreateNotifier();
+  return true;
+}
+
+void LinuxFSListener::CreateNotifier() {
+  notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, this);
+  connect(notifier_, SIGNAL(activated(int)), SLOT(ReadEvents()));
+}
+
+void LinuxFSListener::SwitchToInotify() {
+  qLog(Info) << "Can't use fanotify here, falling back to inotify";
+
+  Close();
+  if (!InitInotify()) {
+    qLog(Warning) << "Couldn't initialise inotify:" << strerror(errno);
+  }
+
+  for (const QString& path : paths_) {
+    if (backend_ != Backend_Inotify || !AddInotifyWatch(path)) {
+      emit PathNotWatched(path);
+    }
+  }
+}
+
+void LinuxFSListener::Close() {
+  delete notifier_;
+  notifier_ = nullptr;
+
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  marked_filesystems_.clear();
+  handle_paths_.clear();
+  path_handles_.clear();
+  watch_paths_.clear();
+  path_watches_.clear();
+  watch_limit_reached_ = false;
+
+  backend_ = Backend_None;
+}
+
+void LinuxFSListener::AddPath(const QString& path) {
+  paths_.insert(path);
+
+  switch (backend_) {
+    case Backend_Fanotify:
+      // Marking the filesystem can fail even though fanotify_init worked, for
+      // example on filesystems that don't support file handles.  inotify
+      // watches the paths that have already been added too.
+      if (!AddFanotifyMark(path)) SwitchToInotify();
+      break;
+
+    case Backend_Inotify:
+      if (!AddInotifyWatch(path)) emit PathNotWatched(path);
+      break;
+
+    case Backend_None:
+      emit PathNotWatched(path);
+      break;
+  }
+}
+
+void LinuxFSListener::RemovePath(const QString& path) {
+  paths_.remove(path);
+
+  // fanotify marks stay on the filesystem, events for directories we don't
+  // know about any more are ignored.
+  if (backend_ == Backend_Inotify) RemoveInotifyWatch(path);
+  handle_paths_.remove(path_handles_.take(path));
+}
+
+void LinuxFSListener::Clear() {
+  if (backend_ == Backend_Inotify) {
+    for (const QString& path : path_watches_.keys()) {
+      RemoveInotifyWatch(path);
+    }
+  }
+
+  paths_.clear();
+  handle_paths_.clear();
+  path_handles_.clear();
+  pending_paths_.clear();
+  pending_files_.clear();
+}
+
+bool LinuxFSListener::AddFanotifyMark(const QString& path) {
+#ifdef FAN_REPORT_DFID_NAME
+  const QByteArray encoded_path = QFile::encodeName(path);
+
+  struct statfs stats;
+  if (statfs(encoded_path.constData(), &stats) == -1) {
+    // The path probably doesn't exist any more - this isn't fanotify's fault.
+    return true;
+  }
+  const quint64 fsid = FilesystemId(&stats.f_fsid);
+
+  union {
+    file_handle handle;
+    char buffer[sizeof(file_handle) + MAX_HANDLE_SZ];
+  } handle;
+  handle.handle.handle_bytes = MAX_HANDLE_SZ;
+  int mount_id = 0;
+  if (name_to_handle_at(AT_FDCWD, encoded_path.constData(), &handle.handle,
+                        &mount_id, 0) == -1) {
+    // Without file handles the events can't be matched to directories.
+    return errno != EOPNOTSUPP;
+  }
+
+  if (!marked_filesystems_.contains(fsid)) {
+    if (fanotify_mark(fd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, kFanotifyMask,
+                      AT_FDCWD, encoded_path.constData()) == -1) {
+      qLog(Warning) << "Couldn't add an fanotify mark for" << path << ":"
+                    << strerror(errno);
+      return false;
+    }
+    marked_filesystems_.insert(fsid);
+  }
+
+  const QByteArray key = HandleKey(fsid, &handle.handle);
+  handle_paths_.remove(path_handles_.value(path));
+  handle_paths_[key] = path;
+  path_handles_[path] = key;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool LinuxFSListener::AddInotifyWatch(const QString& path) {
+  if (path_watches_.contains(path)) return true;
+
+  // Don't bother asking again until a watch has been removed.
+  if (watch_limit_reached_) return false;
+
+  const int wd = inotify_add_watch(fd_, QFile::encodeName(path).constData(),
+                                   kInotifyMask);
+  if (wd == -1) {
+    if (errno == ENOSPC) {
+      watch_limit_reached_ = true;
+      qLog(Warning) << "Reached the inotify watch limit after"
+                    << path_watches_.count()
+                    << "directories - increase fs.inotify.max_user_watches "
+                       "to watch the rest of the library";
+    } else {
+      qLog(Debug) << "Couldn't watch" << path << ":" << strerror(errno);
+    }
+    return false;
+  }
+
+  watch_paths_[wd] = path;
+  path_watches_[path] = wd;
+  return true;
+}
+
+void LinuxFSListener::RemoveInotifyWatch(const QString& path) {
+  QHash<QString, int>::iterator it = path_watches_.find(path);
+  if (it == path_watches_.end()) return;
+
+  inotify_rm_watch(fd_, it.value());
+  watch_paths_.remove(it.value());
+  path_watches_.erase(it);
+  watch_limit_reached_ = false;
+}
+
+void LinuxFSListener::ReadEvents() {
+  switch (backend_) {
+    case Backend_Fanotify:
+      ReadFanotifyEvents();
+      break;
+
+    case Backend_Inotify:
+      ReadInotifyEvents();
+      break;
+
+    case Backend_None:
+      break;
+  }
+}
+
+void LinuxFSListener::ReadFanotifyEvents() {
+#ifdef FAN_REPORT_DFID_NAME
+  char buffer[8192] __attribute__((aligned(8)));
+
+  forever {
+    ssize_t length = read(fd_, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    const fanotify_event_metadata* metadata =
+        reinterpret_cast<const fanotify_event_metadata*>(buffer);
+    for (; FAN_EVENT_OK(metadata, length);
+         metadata = FAN_EVENT_NEXT(metadata, length)) {
+      if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+        qLog(Warning) << "Unexpected fanotify metadata version"
+                      << metadata->vers;
+        return;
+      }
+
+      if (metadata->mask & FAN_Q_OVERFLOW) {
+        qLog(Warning) << "fanotify event queue overflowed";
+        emit EventsLost();
+        continue;
+      }
+
+      const fanotify_event_info_fid* info =
+          reinterpret_cast<const fanotify_event_info_fid*>(metadata + 1);
+      if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) continue;
+
+      // The event has a handle for the parent directory followed by the name
+      // of the file inside it.
+      const file_handle* handle =
+          reinterpret_cast<const file_handle*>(info->handle);
+      const char* name = reinterpret_cast<const char*>(handle->f_handle) +
+                         handle->handle_bytes;
+
+      // The mark covers the whole filesystem, so most events aren't for us.
+      // Look the handle up rather than resolving it to a path, so they're
+      // dropped without any more system calls.
+      const QString path =
+          handle_paths_.value(HandleKey(FilesystemId(&info->fsid), handle));
+      if (path.isEmpty()) continue;
+
+      if (metadata->mask & FAN_ONDIR) {
+        DirectoryChanged(path);
+      } else {
+        FileChanged(path, QFile::decodeName(name));
+      }
+    }
+  }
+#endif
+}
+
+void LinuxFSListener::ReadInotifyEvents() {
+  char buffer[4096] __attribute__((aligned(__alignof__(inotify_event))));
+
+  forever {
+    const ssize_t length = read(fd_, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    for (const char* p = buffer; p < buffer + length;) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+      p += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        qLog(Warning) << "inotify event queue overflowed";
+        emit EventsLost();
+        continue;
+      }
+
+      const QString path = watch_paths_.value(event->wd);
+      if (path.isEmpty()) continue;
+
+      if (event->mask & IN_IGNORED) {
+        // The directory was deleted or unmounted.
+        watch_paths_.remove(event->wd);
+        path_watches_.remove(path);
+        watch_limit_reached_ = false;
+        continue;
+      }
+
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        DirectoryChanged(path);
+      } else if (event->len == 0) {
+        continue;
+      } else if (event->mask & IN_ISDIR) {
+        // A subdirectory was added or removed - the whole directory needs to
+        // be rescanned to find it.
+        DirectoryChanged(path);
+      } else {
+        FileChanged(path, QFile::decodeName(event->name));
+      }
+    }
+  }
+}
+
+void LinuxFSListener::FileChanged(const QString& path, const QString& name) {
+  pending_files_[path].insert(path + "/" + name);
+  if (!coalesce_timer_->isActive()) coalesce_timer_->start();
+}
+
+void LinuxFSListener::DirectoryChanged(const QString& path) {
+  pending_paths_.insert(path);
+  if (!coalesce_timer_->isActive()) coalesce_timer_->start();
+}
+
+void LinuxFSListener::EmitPendingChanges() {
+  const QSet<QString> paths = pending_paths_;
+  const QMap<QString, QSet<QString> > files = pending_files_;
+  pending_paths_.clear();
+  pending_files_.clear();
+
+  for (const QString& path : paths) {
+    emit PathChanged(path);
+  }
+
+  // Directories that are being rescanned anyway don't need their files
+  // reported separately.
+  for (QMap<QString, QSet<QString> >::const_iterator it = files.constBegin();
+       it != files.constEnd(); ++it) {
+    if (paths.contains(it.key())) continue;
+    emit FilesChanged(it.key(), it.value().toList());
+  }
+}
@@ -0,0 +1,102 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINUXFSLISTENER_H
+#define LINUXFSLISTENER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QTimer>
+
+#include "filesystemwatcherinterface.h"
+
+class QSocketNotifier;
+
+// Watches directories with fanotify if the process is allowed to, otherwise
+// with inotify.  Unlike QFileSystemWatcher it reports which files in a
+// directory changed, and bursts of events are coalesced before they're
+// emitted.
+// fanotify marks whole filesystems so there's no limit on the number of
+// directories, but it needs CAP_SYS_ADMIN.  inotify needs a watch for every
+// directory - once fs.inotify.max_user_watches is reached PathNotWatched is
+// emitted for the paths that couldn't be watched.
+class LinuxFSListener : public FileSystemWatcherInterface {
+  Q_OBJECT
+
+ public:
+  explicit LinuxFSListener(QObject* parent = nullptr);
+  ~LinuxFSListener();
+
+  static const int kCoalesceIntervalMsec;
+
+  void Init();
+  void AddPath(const QString& path);
+  void RemovePath(const QString& path);
+  void Clear();
+
+ private slots:
+  void ReadEvents();
+  void EmitPendingChanges();
+
+ private:
+  enum Backend { Backend_None, Backend_Fanotify, Backend_Inotify };
+
+  bool InitFanotify();
+  bool InitInotify();
+  void SwitchToInotify();
+  void CreateNotifier();
+  void Close();
+
+  bool AddFanotifyMark(const QString& path);
+  bool AddInotifyWatch(const QString& path);
+  void RemoveInotifyWatch(const QString& path);
+
+  void ReadFanotifyEvents();
+  void ReadInotifyEvents();
+
+  void FileChanged(const QString& path, const QString& name);
+  void DirectoryChanged(const QString& path);
+
+ private:
+  Backend backend_;
+  int fd_;
+  QSocketNotifier* notifier_;
+
+  // Every path that's been added, whether it's being watched or not.
+  QSet<QString> paths_;
+
+  // inotify watch descriptor -> path, and back again.
+  QHash<int, QString> watch_paths_;
+  QHash<QString, int> path_watches_;
+  bool watch_limit_reached_;
+
+  // The filesystems that have an fanotify mark.
+  QSet<quint64> marked_filesystems_;
+  // The filesystem ID and file handle of each watched directory -> its path,
+  // and back again.  fanotify events name the directory by its handle.
+  QHash<QByteArray, QString> handle_paths_;
+  QHash<QString, QByteArray> path_handles_;
+
+  // Changes waiting for coalesce_timer_.
+  QSet<QString> pending_paths_;
+  QMap<QString, QSet<QString> > pending_files_;
+  QTimer* coalesce_timer_;
+};
+
+#endif  // LINUXFSLISTENER_H
@@ -31,6 +31,9 @@ class SimpleTreeItem {
   SimpleTreeItem(int _type, T* _parent = nullptr);
   virtual ~SimpleTreeItem();
 
+  // Adds this item to the end of the parent's children.  Insert() doesn't tell
+  // the model, so the caller must have called beginInsertRows already.
+  void Insert(T* _parent);
   void InsertNotify(T* _parent);
   void DeleteNotify(int child_row);
   void ClearNotify();
@@ -95,6 +98,14 @@ SimpleTreeItem<T>::SimpleTreeItem(int _type, T* _parent)
   }
 }
 
+template <typename T>
+void SimpleTreeItem<T>::Insert(T* _parent) {
+  parent = _parent;
+  model = parent->model;
+  row = parent->children.count();
+  parent->children << static_cast<T*>(this);
+}
+
 template <typename T>
 void SimpleTreeItem<T>::InsertNotify(T* _parent) {
   parent = _parent;
@@ -31,6 +31,8 @@
 #include <QVariant>
 #include <QtConcurrentRun>
 
+#include <sqlite3.h>
+
 #ifdef HAVE_LIBLASTFM
 #include "internet/fixlastfm.h"
 #ifdef HAVE_LIBLASTFM1
@@ -54,6 +56,7 @@
 #include "core/logging.h"
 #include "core/messagehandler.h"
 #include "core/mpris_common.h"
+#include "core/stringpool.h"
 #include "core/timeconstants.h"
 #include "core/utilities.h"
 #include "covers/albumcoverloader.h"
@@ -100,7 +103,8 @@ const QStringList Song::kColumns = QStringList() << "title"
                                                  << "effective_albumartist"
                                                  << "etag"
                                                  << "performer"
-                                                 << "grouping";
+                                                 << "grouping"
+                                                 << "inode";
 
 const QString Song::kColumnSpec = Song::kColumns.join(", ");
 const QString Song::kBindSpec =
@@ -186,6 +190,8 @@ struct Song::Private : public QSharedData {
   int mtime_;
   int ctime_;
   int filesize_;
+  // Used to recognise the file if it's moved or renamed.
+  qint64 inode_;
   FileType filetype_;
 
   // If the song has a CUE, this contains it's path.
@@ -235,6 +241,7 @@ Song::Private::Private()
       mtime_(-1),
       ctime_(-1),
       filesize_(-1),
+      inode_(-1),
       filetype_(Type_Unknown),
       init_from_file_(false),
       suspicious_tags_(false),
@@ -296,6 +303,7 @@ const QString& Song::basefilename() const { return d->basefilename_; }
 uint Song::mtime() const { return d->mtime_; }
 uint Song::ctime() const { return d->ctime_; }
 int Song::filesize() const { return d->filesize_; }
+qint64 Song::inode() const { return d->inode_; }
 Song::FileType Song::filetype() const { return d->filetype_; }
 bool Song::is_stream() const { return d->filetype_ == Type_Stream; }
 bool Song::is_cdda() const { return d->filetype_ == Type_Cdda; }
@@ -337,6 +345,7 @@ void Song::set_samplerate(int v) { d->samplerate_ = v; }
 void Song::set_mtime(int v) { d->mtime_ = v; }
 void Song::set_ctime(int v) { d->ctime_ = v; }
 void Song::set_filesize(int v) { d->filesize_ = v; }
+void Song::set_inode(qint64 v) { d->inode_ = v; }
 void Song::set_filetype(FileType v) { d->filetype_ = v; }
 void Song::set_art_automatic(const QString& v) { d->art_automatic_ = v; }
 void Song::set_art_manual(const QString& v) { d->art_manual_ = v; }
@@ -458,17 +467,17 @@ void Song::InitFromProtobuf(const pb::tagreader::SongMetadata& pb) {
   d->init_from_file_ = true;
   d->valid_ = pb.valid();
   d->title_ = QStringFromStdString(pb.title());
-  d->album_ = QStringFromStdString(pb.album());
-  d->artist_ = QStringFromStdString(pb.artist());
-  d->albumartist_ = QStringFromStdString(pb.albumartist());
-  d->composer_ = QStringFromStdString(pb.composer());
-  d->performer_ = QStringFromStdString(pb.performer());
-  d->grouping_ = QStringFromStdString(pb.grouping());
+  d->album_ = StringPool::Intern(pb.album());
+  d->artist_ = StringPool::Intern(pb.artist());
+  d->albumartist_ = StringPool::Intern(pb.albumartist());
+  d->composer_ = StringPool::Intern(pb.composer());
+  d->performer_ = StringPool::Intern(pb.performer());
+  d->grouping_ = StringPool::Intern(pb.grouping());
   d->track_ = pb.track();
   d->disc_ = pb.disc();
   d->bpm_ = pb.bpm();
   d->year_ = pb.year();
-  d->genre_ = QStringFromStdString(pb.genre());
+  d->genre_ = StringPool::Intern(pb.genre());
   d->comment_ = QStringFromStdString(pb.comment());
   d->compilation_ = pb.compilation();
   d->playcount_ = pb.playcount();
@@ -483,6 +492,7 @@ void Song::InitFromProtobuf(const pb::tagreader::SongMetadata& pb) {
   d->mtime_ = pb.mtime();
   d->ctime_ = pb.ctime();
   d->filesize_ = pb.filesize();
+  d->inode_ = pb.has_inode() ? pb.inode() : -1;
   d->suspicious_tags_ = pb.suspicious_tags();
   d->filetype_ = static_cast<FileType>(pb.type());
   d->etag_ = QStringFromStdString(pb.etag());
@@ -529,80 +539,173 @@ void Song::ToProtobuf(pb::tagreader::SongMetadata* pb) const {
   pb->set_mtime(d->mtime_);
   pb->set_ctime(d->ctime_);
   pb->set_filesize(d->filesize_);
+  if (d->inode_ != -1) pb->set_inode(d->inode_);
   pb->set_suspicious_tags(d->suspicious_tags_);
   pb->set_art_automatic(DataCommaSizeFromQString(d->art_automatic_));
   pb->set_type(static_cast< ::pb::tagreader::SongMetadata_Type>(d->filetype_));
 }
 
+namespace {
+
+// Reads the columns of a SqlRow, where every value has already been copied
+// into a QVariant.
+class VariantRow {
+ public:
+  explicit VariantRow(const SqlRow& row) : row_(row) {}
+
+  bool IsNull(int i) const { return row_.value(i).isNull(); }
+  QString String(int i) const {
+    return IsNull(i) ? QString::null : row_.value(i).toString();
+  }
+  QString Interned(int i) const { return StringPool::Intern(String(i)); }
+  QByteArray Utf8(int i) const { return String(i).toUtf8(); }
+  int Int(int i) const { return row_.value(i).toInt(); }
+  qint64 LongLong(int i) const { return row_.value(i).toLongLong(); }
+  double Double(int i) const { return row_.value(i).toDouble(); }
+  bool Bool(int i) const { return row_.value(i).toBool(); }
+
+ private:
+  const SqlRow& row_;
+};
+
+// Reads the columns of the row a sqlite3_stmt is positioned on without going
+// through QVariant at all.
+class StatementRow {
+ public:
+  explicit StatementRow(sqlite3_stmt* stmt) : stmt_(stmt) {}
+
+  bool IsNull(int i) const {
+    return sqlite3_column_type(stmt_, i) == SQLITE_NULL;
+  }
+  QString String(int i) const {
+    const char* text =
+        reinterpret_cast<const char*>(sqlite3_column_text(stmt_, i));
+    if (!text) return QString::null;
+    return QString::fromUtf8(text, sqlite3_column_bytes(stmt_, i));
+  }
+  QString Interned(int i) const {
+    // Ask for UTF-16 so the pool can look the string up in place.
+    const QChar* text =
+        reinterpret_cast<const QChar*>(sqlite3_column_text16(stmt_, i));
+    if (!text) return QString::null;
+    return StringPool::Intern(text,
+                              sqlite3_column_bytes16(stmt_, i) / sizeof(QChar));
+  }
+  QByteArray Utf8(int i) const {
+    const char* text =
+        reinterpret_cast<const char*>(sqlite3_column_text(stmt_, i));
+    return QByteArray(text, sqlite3_column_bytes(stmt_, i));
+  }
+  int Int(int i) const { return sqlite3_column_int(stmt_, i); }
+  qint64 LongLong(int i) const { return sqlite3_column_int64(stmt_, i); }
+  double Double(int i) const { return sqlite3_column_double(stmt_, i); }
+  bool Bool(int i) const { return sqlite3_column_int(stmt_, i) != 0; }
+
+ private:
+  sqlite3_stmt* stmt_;
+};
+
+}  // namespace
+
 void Song::InitFromQuery(const SqlRow& q, bool reliable_metadata, int col) {
+  // The row might have been read by a SqlRowReader that decoded this song
+  // already.
+  const Song* decoded = q.song(col);
+  if (decoded) {
+    *this = *decoded;
+    if (d.constData()->init_from_file_ != reliable_metadata) {
+      d->init_from_file_ = reliable_metadata;
+    }
+    return;
+  }
+
+  InitFromRow(VariantRow(q), reliable_metadata, col);
+}
+
+void Song::InitFromQuery(const SqlRowReader& reader, bool reliable_metadata,
+                         int col) {
+  sqlite3_stmt* stmt = reader.statement();
+  if (stmt) {
+    InitFromRow(StatementRow(stmt), reliable_metadata, col);
+  } else {
+    InitFromQuery(SqlRow(reader.query()), reliable_metadata, col);
+  }
+}
+
+template <typename Row>
+void Song::InitFromRow(const Row& q, bool reliable_metadata, int col) {
   d->valid_ = true;
   d->init_from_file_ = reliable_metadata;
 
-#define tostr(n) (q.value(n).isNull() ? QString::null : q.value(n).toString())
-#define toint(n) (q.value(n).isNull() ? -1 : q.value(n).toInt())
-#define tolonglong(n) (q.value(n).isNull() ? -1 : q.value(n).toLongLong())
-#define tofloat(n) (q.value(n).isNull() ? -1 : q.value(n).toDouble())
+#define tostr(n) q.String(n)
+#define tointerned(n) q.Interned(n)
+#define toint(n) (q.IsNull(n) ? -1 : q.Int(n))
+#define tolonglong(n) (q.IsNull(n) ? -1 : q.LongLong(n))
+#define tofloat(n) (q.IsNull(n) ? -1 : q.Double(n))
 
   d->id_ = toint(col + 0);
   d->title_ = tostr(col + 1);
-  d->album_ = tostr(col + 2);
-  d->artist_ = tostr(col + 3);
-  d->albumartist_ = tostr(col + 4);
-  d->composer_ = tostr(col + 5);
+  d->album_ = tointerned(col + 2);
+  d->artist_ = tointerned(col + 3);
+  d->albumartist_ = tointerned(col + 4);
+  d->composer_ = tointerned(col + 5);
   d->track_ = toint(col + 6);
   d->disc_ = toint(col + 7);
   d->bpm_ = tofloat(col + 8);
   d->year_ = toint(col + 9);
-  d->genre_ = tostr(col + 10);
+  d->genre_ = tointerned(col + 10);
   d->comment_ = tostr(col + 11);
-  d->compilation_ = q.value(col + 12).toBool();
+  d->compilation_ = q.Bool(col + 12);
 
   d->bitrate_ = toint(col + 13);
   d->samplerate_ = toint(col + 14);
 
   d->directory_id_ = toint(col + 15);
-  set_url(QUrl::fromEncoded(tostr(col + 16).toUtf8()));
+  set_url(QUrl::fromEncoded(q.Utf8(col + 16)));
   d->basefilename_ = QFileInfo(d->url_.toLocalFile()).fileName();
   d->mtime_ = toint(col + 17);
   d->ctime_ = toint(col + 18);
   d->filesize_ = toint(col + 19);
 
-  d->sampler_ = q.value(col + 20).toBool();
+  d->sampler_ = q.Bool(col + 20);
 
-  d->art_automatic_ = q.value(col + 21).toString();
-  d->art_manual_ = q.value(col + 22).toString();
+  // Cover and cue paths are different for nearly every album, so they
+  // aren't worth pooling.
+  d->art_automatic_ = tostr(col + 21);
+  d->art_manual_ = tostr(col + 22);
 
-  d->filetype_ = FileType(q.value(col + 23).toInt());
-  d->playcount_ = q.value(col + 24).isNull() ? 0 : q.value(col + 24).toInt();
+  d->filetype_ = FileType(q.Int(col + 23));
+  d->playcount_ = q.IsNull(col + 24) ? 0 : q.Int(col + 24);
   d->lastplayed_ = toint(col + 25);
   d->rating_ = tofloat(col + 26);
 
-  d->forced_compilation_on_ = q.value(col + 27).toBool();
-  d->forced_compilation_off_ = q.value(col + 28).toBool();
+  d->forced_compilation_on_ = q.Bool(col + 27);
+  d->forced_compilation_off_ = q.Bool(col + 28);
 
   // effective_compilation = 29
 
-  d->skipcount_ = q.value(col + 30).isNull() ? 0 : q.value(col + 30).toInt();
-  d->score_ = q.value(col + 31).isNull() ? 0 : q.value(col + 31).toInt();
+  d->skipcount_ = q.IsNull(col + 30) ? 0 : q.Int(col + 30);
+  d->score_ = q.IsNull(col + 31) ? 0 : q.Int(col + 31);
 
   // do not move those statements - beginning must be initialized before
   // length is!
-  d->beginning_ =
-      q.value(col + 32).isNull() ? 0 : q.value(col + 32).toLongLong();
+  d->beginning_ = q.IsNull(col + 32) ? 0 : q.LongLong(col + 32);
   set_length_nanosec(tolonglong(col + 33));
 
   d->cue_path_ = tostr(col + 34);
-  d->unavailable_ = q.value(col + 35).toBool();
+  d->unavailable_ = q.Bool(col + 35);
 
   // effective_albumartist = 36
   // etag = 37
 
-  d->performer_ = tostr(col + 38);
-  d->grouping_ = tostr(col + 39);
+  d->performer_ = tointerned(col + 38);
+  d->grouping_ = tointerned(col + 39);
+  d->inode_ = tolonglong(col + 40);
 
   InitArtManual();
 
 #undef tostr
+#undef tointerned
 #undef toint
 #undef tolonglong
 #undef tofloat
@@ -923,6 +1026,7 @@ void Song::BindToQuery(QSqlQuery* query) const {
 
   query->bindValue(":performer", strval(d->performer_));
   query->bindValue(":grouping", strval(d->grouping_));
+  query->bindValue(":inode", notnullintval(d->inode_));
 
 #undef intval
 #undef notnullintval
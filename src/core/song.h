@@ -51,6 +51,7 @@ class Track;
 #endif
 
 class SqlRow;
+class SqlRowReader;
 
 class Song {
  public:
@@ -105,6 +106,8 @@ class Song {
             qint64 beginning, qint64 end);
   void InitFromProtobuf(const pb::tagreader::SongMetadata& pb);
   void InitFromQuery(const SqlRow& query, bool reliable_metadata, int col = 0);
+  void InitFromQuery(const SqlRowReader& reader, bool reliable_metadata,
+                     int col = 0);
   void InitFromFilePartial(
       const QString& filename);  // Just store the filename: incomplete but fast
   void InitArtManual();  // Check if there is already a art in the cache and
@@ -189,6 +192,7 @@ class Song {
   uint mtime() const;
   uint ctime() const;
   int filesize() const;
+  qint64 inode() const;
   FileType filetype() const;
   bool is_stream() const;
   bool is_cdda() const;
@@ -252,6 +256,7 @@ class Song {
   void set_mtime(int v);
   void set_ctime(int v);
   void set_filesize(int v);
+  void set_inode(qint64 v);
   void set_filetype(FileType v);
   void set_art_automatic(const QString& v);
   void set_art_manual(const QString& v);
@@ -286,6 +291,11 @@ class Song {
 
   Song& operator=(const Song& other);
 
+ private:
+  // Row is either a SqlRow or the current row of a sqlite3_stmt, see song.cpp
+  template <typename Row>
+  void InitFromRow(const Row& row, bool reliable_metadata, int col);
+
  private:
   struct Private;
   QSharedDataPointer<Private> d;
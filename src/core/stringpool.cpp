@@ -0,0 +1,96 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stringpool.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+
+namespace {
+
+const int kMinSweepSize = 1024;
+
+struct Pool {
+  Pool() : sweep_size(kMinSweepSize) {}
+
+  QMutex mutex;
+  QSet<QString> strings;
+  // The pool is swept when it gets this big.
+  int sweep_size;
+};
+
+Pool* ThePool() {
+  static Pool pool;
+  return &pool;
+}
+
+// Must be called with the pool's mutex held.
+void Insert(Pool* pool, const QString& str) {
+  pool->strings.insert(str);
+  if (pool->strings.count() < pool->sweep_size) return;
+
+  // Drop the strings that only the pool holds.  Nobody else can get at them
+  // without going through the mutex, so they can't be copied meanwhile.
+  for (QSet<QString>::iterator it = pool->strings.begin();
+       it != pool->strings.end();) {
+    if (it->isDetached()) {
+      it = pool->strings.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  pool->sweep_size = qMax(kMinSweepSize, pool->strings.count() * 2);
+}
+
+}  // namespace
+
+QString StringPool::Intern(const QString& str) {
+  if (str.isEmpty()) return str;
+
+  Pool* pool = ThePool();
+  QMutexLocker l(&pool->mutex);
+
+  QSet<QString>::const_iterator it = pool->strings.constFind(str);
+  if (it != pool->strings.constEnd()) return *it;
+
+  Insert(pool, str);
+  return str;
+}
+
+QString StringPool::Intern(const QChar* unicode, int size) {
+  if (size <= 0) return QString(unicode, size);
+
+  // fromRawData doesn't copy, so this key is only good for the lookup.
+  const QString key = QString::fromRawData(unicode, size);
+
+  Pool* pool = ThePool();
+  QMutexLocker l(&pool->mutex);
+
+  QSet<QString>::const_iterator it = pool->strings.constFind(key);
+  if (it != pool->strings.constEnd()) return *it;
+
+  const QString str(unicode, size);
+  Insert(pool, str);
+  return str;
+}
+
+int StringPool::size() {
+  Pool* pool = ThePool();
+  QMutexLocker l(&pool->mutex);
+  return pool->strings.count();
+}
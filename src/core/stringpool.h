@@ -0,0 +1,50 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+
+#include <string>
+
+// Keeps one copy of each string that gets repeated across lots of songs -
+// artists, albums, genres and so on.  Songs decoded from the database or from
+// the tag reader share that copy instead of each holding their own, and so do
+// the library model, playlists and the global search index that copy those
+// songs around.
+//
+// The pool doesn't keep strings alive by itself - whenever it doubles in size
+// it drops the ones that nobody else holds any more.  All the functions are
+// thread-safe.
+class StringPool {
+ public:
+  // Returns the pool's copy of the string, adding it if it wasn't there
+  // already.  Null and empty strings are returned as they are.
+  static QString Intern(const QString& str);
+  // The same, for UTF-16 that hasn't been copied into a QString yet.  Nothing
+  // is allocated if the string is already in the pool.
+  static QString Intern(const QChar* unicode, int size);
+  static QString Intern(const std::string& utf8) {
+    return Intern(QString::fromUtf8(utf8.data(), utf8.size()));
+  }
+
+  // The number of distinct strings in the pool.
+  static int size();
+};
+
+#endif  // STRINGPOOL_H
@@ -20,11 +20,13 @@
 #include <QCoreApplication>
 #include <QFile>
 #include <QProcess>
+#include <QQueue>
 #include <QTcpServer>
 #include <QThread>
 #include <QUrl>
 
 const char* TagReaderClient::kWorkerExecutableName = "clementine-tagreader";
+const int TagReaderClient::kReadFilesBatchSize = 64;
 TagReaderClient* TagReaderClient::sInstance = nullptr;
 
 TagReaderClient::TagReaderClient(QObject* parent)
@@ -33,6 +35,9 @@ TagReaderClient::TagReaderClient(QObject* parent)
 
   worker_pool_->SetExecutableName(kWorkerExecutableName);
   worker_pool_->SetWorkerCount(QThread::idealThreadCount());
+  // Album art and batched ReadFiles responses can be large, so don't copy them
+  // through the socket.
+  worker_pool_->SetUseSharedMemory(true);
   connect(worker_pool_, SIGNAL(WorkerFailedToStart()),
           SLOT(WorkerFailedToStart()));
 }
@@ -54,6 +59,17 @@ TagReaderReply* TagReaderClient::ReadFile(const QString& filename) {
   return worker_pool_->SendMessageWithReply(&message);
 }
 
+TagReaderReply* TagReaderClient::ReadFiles(const QStringList& filenames) {
+  pb::tagreader::Message message;
+  pb::tagreader::ReadFilesRequest* req = message.mutable_read_files_request();
+
+  for (const QString& filename : filenames) {
+    req->add_filenames(DataCommaSizeFromQString(filename));
+  }
+
+  return worker_pool_->SendMessageWithReply(&message);
+}
+
 TagReaderReply* TagReaderClient::SaveFile(const QString& filename,
                                           const Song& metadata) {
   pb::tagreader::Message message;
@@ -121,6 +137,18 @@ TagReaderReply* TagReaderClient::LoadEmbeddedArt(const QString& filename) {
   return worker_pool_->SendMessageWithReply(&message);
 }
 
+TagReaderReply* TagReaderClient::LoadEmbeddedArtThumbnail(
+    const QString& filename, int size) {
+  pb::tagreader::Message message;
+  pb::tagreader::LoadEmbeddedArtThumbnailRequest* req =
+      message.mutable_load_embedded_art_thumbnail_request();
+
+  req->set_filename(DataCommaSizeFromQString(filename));
+  req->set_size(size);
+
+  return worker_pool_->SendMessageWithReply(&message);
+}
+
 TagReaderReply* TagReaderClient::ReadCloudFile(
     const QUrl& download_url, const QString& title, int size,
     const QString& mime_type, const QString& authorisation_header) {
@@ -148,6 +176,41 @@ void TagReaderClient::ReadFileBlocking(const QString& filename, Song* song) {
   reply->deleteLater();
 }
 
+void TagReaderClient::ReadFilesBlocking(const QStringList& filenames,
+                                        SongList* songs) {
+  Q_ASSERT(QThread::currentThread() != thread());
+
+  // Keep a couple of batches queued for each worker, so they can get on with
+  // the next ones while we process the results of the first.  Queueing them
+  // all at once would hold every reply for a big directory in memory.
+  const int max_in_flight = QThread::idealThreadCount() * 2;
+  int next = 0;
+  QQueue<TagReaderReply*> replies;
+
+  while (next < filenames.count() || !replies.isEmpty()) {
+    while (next < filenames.count() && replies.count() < max_in_flight) {
+      replies.enqueue(ReadFiles(filenames.mid(next, kReadFilesBatchSize)));
+      next += kReadFilesBatchSize;
+    }
+
+    TagReaderReply* reply = replies.dequeue();
+    const int count =
+        reply->request_message().read_files_request().filenames_size();
+    const bool success = reply->WaitForFinished();
+    const pb::tagreader::ReadFilesResponse& response =
+        reply->message().read_files_response();
+
+    for (int i = 0; i < count; ++i) {
+      Song song;
+      if (success && i < response.metadata_size()) {
+        song.InitFromProtobuf(response.metadata(i));
+      }
+      *songs << song;
+    }
+    reply->deleteLater();
+  }
+}
+
 bool TagReaderClient::SaveFileBlocking(const QString& filename,
                                        const Song& metadata) {
   Q_ASSERT(QThread::currentThread() != thread());
@@ -208,9 +271,19 @@ bool TagReaderClient::IsMediaFileBlocking(const QString& filename) {
 QImage TagReaderClient::LoadEmbeddedArtBlocking(const QString& filename) {
   Q_ASSERT(QThread::currentThread() != thread());
 
+  return WaitForEmbeddedArt(LoadEmbeddedArt(filename));
+}
+
+QImage TagReaderClient::LoadEmbeddedArtThumbnailBlocking(
+    const QString& filename, int size) {
+  Q_ASSERT(QThread::currentThread() != thread());
+
+  return WaitForEmbeddedArt(LoadEmbeddedArtThumbnail(filename, size));
+}
+
+QImage TagReaderClient::WaitForEmbeddedArt(ReplyType* reply) {
   QImage ret;
 
-  TagReaderReply* reply = LoadEmbeddedArt(filename);
   if (reply->WaitForFinished()) {
     const std::string& data_str =
         reply->message().load_embedded_art_response().data();
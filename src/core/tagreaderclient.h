@@ -39,14 +39,21 @@ class TagReaderClient : public QObject {
 
   static const char* kWorkerExecutableName;
 
+  // The maximum number of files sent to a worker in one ReadFilesRequest.
+  static const int kReadFilesBatchSize;
+
   void Start();
 
   ReplyType* ReadFile(const QString& filename);
+  ReplyType* ReadFiles(const QStringList& filenames);
   ReplyType* SaveFile(const QString& filename, const Song& metadata);
   ReplyType* UpdateSongStatistics(const Song& metadata);
   ReplyType* UpdateSongRating(const Song& metadata);
   ReplyType* IsMediaFile(const QString& filename);
   ReplyType* LoadEmbeddedArt(const QString& filename);
+  // The worker scales the image down to fit in a size x size square, so only
+  // the small image is sent back.
+  ReplyType* LoadEmbeddedArtThumbnail(const QString& filename, int size);
   ReplyType* ReadCloudFile(const QUrl& download_url, const QString& title,
                            int size, const QString& mime_type,
                            const QString& authorisation_header);
@@ -55,11 +62,18 @@ class TagReaderClient : public QObject {
   // response.  These block the calling thread with a semaphore, and must NOT
   // be called from the TagReaderClient's thread.
   void ReadFileBlocking(const QString& filename, Song* song);
+  // Reads the tags from all the given files.  The files are split into batches
+  // of kReadFilesBatchSize, and a couple of batches per worker are kept
+  // queued, so they're spread across the workers and only cost one round trip
+  // per batch.  One song is appended to songs for each filename, in the same
+  // order - songs that couldn't be read are not valid.
+  void ReadFilesBlocking(const QStringList& filenames, SongList* songs);
   bool SaveFileBlocking(const QString& filename, const Song& metadata);
   bool UpdateSongStatisticsBlocking(const Song& metadata);
   bool UpdateSongRatingBlocking(const Song& metadata);
   bool IsMediaFileBlocking(const QString& filename);
   QImage LoadEmbeddedArtBlocking(const QString& filename);
+  QImage LoadEmbeddedArtThumbnailBlocking(const QString& filename, int size);
 
   // TODO: Make this not a singleton
   static TagReaderClient* Instance() { return sInstance; }
@@ -74,6 +88,10 @@ class TagReaderClient : public QObject {
  private:
   static TagReaderClient* sInstance;
 
+  // Waits for a LoadEmbeddedArt or LoadEmbeddedArtThumbnail reply and decodes
+  // the image in it.
+  static QImage WaitForEmbeddedArt(ReplyType* reply);
+
   WorkerPool<HandlerType>* worker_pool_;
   QList<pb::tagreader::Message> message_queue_;
 };
@@ -337,6 +337,9 @@ QString GetConfigPath(ConfigPath config) {
     case Path_MoodbarCache:
       return GetConfigPath(Path_CacheRoot) + "/moodbarcache";
 
+    case Path_ThumbnailCache:
+      return GetConfigPath(Path_CacheRoot) + "/thumbnails";
+
     case Path_GstreamerRegistry:
       return GetConfigPath(Path_Root) +
              QString("/gst-registry-%1-bin")
@@ -122,6 +122,7 @@ enum ConfigPath {
   Path_LocalSpotifyBlob,
   Path_MoodbarCache,
   Path_CacheRoot,
+  Path_ThumbnailCache,
 };
 QString GetConfigPath(ConfigPath config);
 
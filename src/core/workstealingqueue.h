@@ -0,0 +1,138 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKSTEALINGQUEUE_H
+#define WORKSTEALINGQUEUE_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+// A queue of tasks shared by a fixed number of worker threads.  Each worker
+// thread has its own deque: tasks it pushes go on the back of its own deque
+// and it takes tasks from the back too, so a task and the tasks it creates tend
+// to stay on the same thread.  When a worker's deque is empty it steals the
+// oldest task from the front of another worker's deque.
+//
+// Tasks can push more tasks while they run, so Pop() blocks while the queue is
+// empty but other tasks are still running.  It returns false once every deque
+// is empty and no tasks are running - at that point all the work is done.
+//
+// Tasks pushed from a thread that isn't a worker (for example the initial
+// tasks) are spread over the deques round-robin.
+template <typename T>
+class WorkStealingQueue {
+ public:
+  WorkStealingQueue(int thread_count)
+      : deques_(qMax(1, thread_count)),
+        next_push_deque_(0),
+        running_tasks_(0),
+        aborted_(false) {}
+
+  int thread_count() const { return deques_.count(); }
+
+  void Push(const T& task) {
+    QMutexLocker l(&mutex_);
+
+    int deque = threads_.value(QThread::currentThread(), -1);
+    if (deque == -1) {
+      deque = next_push_deque_;
+      next_push_deque_ = (next_push_deque_ + 1) % deques_.count();
+    }
+
+    deques_[deque].append(task);
+    wait_condition_.wakeOne();
+  }
+
+  // Takes the next task for the calling thread.  You must call TaskDone() once
+  // you've finished processing the task.
+  bool Pop(T* task) {
+    QMutexLocker l(&mutex_);
+
+    const int own = DequeForWorkerThread();
+    forever {
+      if (aborted_) return false;
+
+      if (!deques_[own].isEmpty()) {
+        *task = deques_[own].takeLast();
+        running_tasks_++;
+        return true;
+      }
+
+      for (int i = 1; i < deques_.count(); ++i) {
+        QList<T>& victim = deques_[(own + i) % deques_.count()];
+        if (!victim.isEmpty()) {
+          *task = victim.takeFirst();
+          running_tasks_++;
+          return true;
+        }
+      }
+
+      if (running_tasks_ == 0) {
+        // Nothing left to do, and nothing running that could add more work.
+        wait_condition_.wakeAll();
+        return false;
+      }
+
+      wait_condition_.wait(&mutex_);
+    }
+  }
+
+  void TaskDone() {
+    QMutexLocker l(&mutex_);
+    running_tasks_--;
+    if (running_tasks_ == 0) {
+      wait_condition_.wakeAll();
+    }
+  }
+
+  // Makes every current and future call to Pop() return false.  Tasks still in
+  // the queue are dropped.
+  void Abort() {
+    QMutexLocker l(&mutex_);
+    aborted_ = true;
+    wait_condition_.wakeAll();
+  }
+
+ private:
+  // Must be called with mutex_ held.
+  int DequeForWorkerThread() {
+    QThread* thread = QThread::currentThread();
+    typename QHash<QThread*, int>::const_iterator it = threads_.constFind(thread);
+    if (it != threads_.constEnd()) return it.value();
+
+    const int deque = threads_.count() % deques_.count();
+    threads_[thread] = deque;
+    return deque;
+  }
+
+  QMutex mutex_;
+  QWaitCondition wait_condition_;
+
+  QVector<QList<T> > deques_;
+  QHash<QThread*, int> threads_;
+  int next_push_deque_;
+
+  int running_tasks_;
+  bool aborted_;
+};
+
+#endif  // WORKSTEALINGQUEUE_H
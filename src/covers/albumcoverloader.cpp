@@ -19,10 +19,12 @@
 
 #include <QPainter>
 #include <QDir>
+#include <QFileInfo>
 #include <QCoreApplication>
 #include <QUrl>
 #include <QNetworkReply>
 
+#include "albumcoverthumbnailcache.h"
 #include "config.h"
 #include "core/closure.h"
 #include "core/logging.h"
@@ -39,6 +41,8 @@ AlbumCoverLoader::AlbumCoverLoader(QObject* parent)
       network_(new NetworkAccessManager(this)),
       connected_spotify_(false) {}
 
+AlbumCoverLoader::~AlbumCoverLoader() {}
+
 QString AlbumCoverLoader::ImageCacheDir() {
   return Utilities::GetConfigPath(Utilities::Path_AlbumCovers);
 }
@@ -153,14 +157,38 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
   if (filename == Song::kManuallyUnsetCover)
     return TryLoadResult(false, true, task.options.default_output_image_);
 
+  // Use the thumbnail if this version of the file has been seen before.
+  const QString thumbnail_path = ThumbnailPath(task, filename);
+  uint thumbnail_mtime = 0;
+  if (!thumbnail_path.isEmpty()) {
+    thumbnail_mtime = QFileInfo(thumbnail_path).lastModified().toTime_t();
+    const QImage thumbnail = thumbnail_cache()->Load(
+        thumbnail_path, thumbnail_mtime, task.options.desired_height_);
+    if (!thumbnail.isNull()) return TryLoadResult(false, true, thumbnail);
+  }
+
   if (filename == Song::kEmbeddedCover && !task.song_filename.isEmpty()) {
+    // If the image is going to be scaled down anyway, let the tag reader do it
+    // so the full size image never has to be sent over or decoded here.  Ask
+    // for the largest thumbnail if it's going in the cache, so it can be used
+    // for every size.
+    const int height = thumbnail_path.isEmpty()
+                           ? task.options.desired_height_
+                           : AlbumCoverThumbnailCache::kLargestSize;
     const QImage taglib_image =
-        TagReaderClient::Instance()->LoadEmbeddedArtBlocking(
-            task.song_filename);
-
-    if (!taglib_image.isNull())
+        task.options.scale_output_image_
+            ? TagReaderClient::Instance()->LoadEmbeddedArtThumbnailBlocking(
+                  task.song_filename, height)
+            : TagReaderClient::Instance()->LoadEmbeddedArtBlocking(
+                  task.song_filename);
+
+    if (!taglib_image.isNull()) {
+      if (!thumbnail_path.isEmpty()) {
+        thumbnail_cache()->Save(thumbnail_path, thumbnail_mtime, taglib_image);
+      }
       return TryLoadResult(false, true,
                            ScaleAndPad(task.options, taglib_image));
+    }
   }
 
   if (filename.toLower().startsWith("http://") ||
@@ -195,11 +223,46 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
   }
 
   QImage image(filename);
+  if (!image.isNull() && !thumbnail_path.isEmpty()) {
+    thumbnail_cache()->Save(thumbnail_path, thumbnail_mtime, image);
+  }
   return TryLoadResult(
       false, !image.isNull(),
       image.isNull() ? task.options.default_output_image_ : image);
 }
 
+QString AlbumCoverLoader::ThumbnailPath(const Task& task,
+                                        const QString& filename) const {
+  // Images that are going to be shown at full size, or bigger than the
+  // largest thumbnail, always come from the original.
+  if (!task.options.use_thumbnail_cache_ ||
+      !task.options.scale_output_image_ ||
+      task.options.desired_height_ > AlbumCoverThumbnailCache::kLargestSize) {
+    return QString();
+  }
+
+  // Remote images aren't cached - they don't have a modification time.
+  QString path = filename;
+  if (filename == Song::kEmbeddedCover) {
+    path = task.song_filename;
+  } else if (filename.isEmpty() || filename == Song::kManuallyUnsetCover ||
+             filename.contains("://")) {
+    return QString();
+  }
+
+  if (path.isEmpty() || !QFile::exists(path)) return QString();
+  return path;
+}
+
+AlbumCoverThumbnailCache* AlbumCoverLoader::thumbnail_cache() {
+  // Only ever used from this object's thread.
+  if (!thumbnail_cache_) {
+    thumbnail_cache_.reset(new AlbumCoverThumbnailCache(
+        Utilities::GetConfigPath(Utilities::Path_ThumbnailCache)));
+  }
+  return thumbnail_cache_.get();
+}
+
 void AlbumCoverLoader::SpotifyImageLoaded(const QString& id,
                                           const QImage& image) {
   if (!remote_spotify_tasks_.contains(id)) return;
@@ -27,6 +27,9 @@
 #include <QQueue>
 #include <QUrl>
 
+#include <memory>
+
+class AlbumCoverThumbnailCache;
 class NetworkAccessManager;
 class QNetworkReply;
 
@@ -35,6 +38,7 @@ class AlbumCoverLoader : public QObject {
 
  public:
   AlbumCoverLoader(QObject* parent = nullptr);
+  ~AlbumCoverLoader();
 
   void Stop() { stop_requested_ = true; }
 
@@ -95,6 +99,11 @@ signals:
   void NextState(Task* task);
   TryLoadResult TryLoadImage(const Task& task);
 
+  // The file a thumbnail of this image would be saved under, or an empty
+  // string if it shouldn't be cached.
+  QString ThumbnailPath(const Task& task, const QString& filename) const;
+  AlbumCoverThumbnailCache* thumbnail_cache();
+
   bool stop_requested_;
 
   QMutex mutex_;
@@ -107,6 +116,8 @@ signals:
 
   bool connected_spotify_;
 
+  std::unique_ptr<AlbumCoverThumbnailCache> thumbnail_cache_;
+
   static const int kMaxRedirects = 3;
 };
 
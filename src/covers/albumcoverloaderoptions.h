@@ -24,11 +24,17 @@ struct AlbumCoverLoaderOptions {
   AlbumCoverLoaderOptions()
       : desired_height_(120),
         scale_output_image_(true),
-        pad_output_image_(true) {}
+        pad_output_image_(true),
+        use_thumbnail_cache_(false) {}
 
   int desired_height_;
   bool scale_output_image_;
   bool pad_output_image_;
+
+  // Keep a small copy of local and embedded covers on disk, and use it
+  // instead of the original next time.  Only for images that are scaled
+  // down to AlbumCoverThumbnailCache::kLargestSize or smaller.
+  bool use_thumbnail_cache_;
   QImage default_output_image_;
 };
 
@@ -0,0 +1,295 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "albumcoverthumbnailcache.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDir>
+#include <QPair>
+
+#include "core/logging.h"
+
+const int AlbumCoverThumbnailCache::kSizes[] = {32, 64, 128};
+const int AlbumCoverThumbnailCache::kSizeCount =
+    sizeof(kSizes) / sizeof(kSizes[0]);
+const int AlbumCoverThumbnailCache::kLargestSize = 128;
+
+const char* AlbumCoverThumbnailCache::kPackFilename = "thumbnails.pack";
+const char* AlbumCoverThumbnailCache::kIndexFilename = "thumbnails.index";
+const quint32 AlbumCoverThumbnailCache::kIndexMagic = 0x434c5448;  // CLTH
+const int AlbumCoverThumbnailCache::kIndexVersion = 1;
+const int AlbumCoverThumbnailCache::kSavesBetweenFlushes = 20;
+const qint64 AlbumCoverThumbnailCache::kMaxUnusedBytes = 16 * 1024 * 1024;
+
+AlbumCoverThumbnailCache::AlbumCoverThumbnailCache(const QString& directory)
+    : directory_(directory),
+      opened_(false),
+      map_(nullptr),
+      map_size_(0),
+      unsaved_entries_(0) {}
+
+AlbumCoverThumbnailCache::~AlbumCoverThumbnailCache() { Flush(); }
+
+void AlbumCoverThumbnailCache::Open() {
+  // Opening it reads the whole index, so don't do it until it's used.
+  if (opened_) return;
+  opened_ = true;
+
+  QDir().mkpath(directory_);
+  pack_.setFileName(directory_ + "/" + kPackFilename);
+  if (!pack_.open(QIODevice::ReadWrite)) {
+    qLog(Warning) << "Couldn't open" << pack_.fileName();
+    return;
+  }
+
+  if (!ReadIndex()) {
+    Reset();
+    return;
+  }
+
+  // Thumbnails of covers that have changed since are still in the pack file,
+  // as are any that were saved after the index was last written.  Get rid of
+  // them if that's most of it, or if there's a lot of them.
+  qint64 used = 0;
+  for (const Entry& entry : entries_) {
+    for (const Thumbnail& thumbnail : entry.thumbnails_) {
+      used += thumbnail.length_;
+    }
+  }
+  const qint64 unused = pack_.size() - used;
+  if (unused > pack_.size() / 2 || unused > kMaxUnusedBytes) {
+    qLog(Debug) << "Compacting thumbnail cache," << unused << "of"
+                << pack_.size() << "bytes are unused";
+    Compact();
+  }
+}
+
+void AlbumCoverThumbnailCache::Compact() {
+  const QString filename = pack_.fileName();
+  QFile compacted(filename + ".new");
+  if (!compacted.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qLog(Warning) << "Couldn't write" << compacted.fileName();
+    Reset();
+    return;
+  }
+
+  // Copy the thumbnails in the index to a new pack file.
+  QHash<QString, Entry> entries;
+  for (auto it = entries_.constBegin(); it != entries_.constEnd(); ++it) {
+    Entry entry = it.value();
+    for (Thumbnail& thumbnail : entry.thumbnails_) {
+      QByteArray data;
+      if (pack_.seek(thumbnail.offset_)) data = pack_.read(thumbnail.length_);
+
+      thumbnail.offset_ = compacted.pos();
+      if (data.size() != thumbnail.length_ ||
+          compacted.write(data) != thumbnail.length_) {
+        qLog(Warning) << "Couldn't compact" << filename;
+        compacted.remove();
+        Reset();
+        return;
+      }
+    }
+    entries[it.key()] = entry;
+  }
+  compacted.close();
+
+  // Remove the old index first, so it never points into the new pack file.
+  if (map_) pack_.unmap(map_);
+  map_ = nullptr;
+  map_size_ = 0;
+  pack_.close();
+  QFile::remove(directory_ + "/" + kIndexFilename);
+  QFile::remove(filename);
+  compacted.rename(filename);
+
+  entries_ = entries;
+  if (!pack_.open(QIODevice::ReadWrite)) {
+    qLog(Warning) << "Couldn't open" << pack_.fileName();
+    entries_.clear();
+    return;
+  }
+  WriteIndex();
+}
+
+void AlbumCoverThumbnailCache::Reset() {
+  if (map_) pack_.unmap(map_);
+  map_ = nullptr;
+  map_size_ = 0;
+
+  entries_.clear();
+  unsaved_entries_ = 0;
+  if (pack_.isOpen()) pack_.resize(0);
+  QFile::remove(directory_ + "/" + kIndexFilename);
+}
+
+bool AlbumCoverThumbnailCache::ReadIndex() {
+  QFile file(directory_ + "/" + kIndexFilename);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+
+  QDataStream s(&file);
+  quint32 magic = 0;
+  qint32 version = 0;
+  qint32 count = 0;
+  s >> magic >> version >> count;
+  if (magic != kIndexMagic || version != kIndexVersion) return false;
+
+  const qint64 pack_size = pack_.size();
+  for (int i = 0; i < count && s.status() == QDataStream::Ok; ++i) {
+    QString path;
+    Entry entry;
+    qint32 thumbnails = 0;
+    s >> path >> entry.mtime_ >> thumbnails;
+
+    for (int j = 0; j < thumbnails; ++j) {
+      Thumbnail thumbnail;
+      s >> thumbnail.size_ >> thumbnail.offset_ >> thumbnail.length_;
+
+      // The pack file might have been truncated.
+      if (thumbnail.offset_ + thumbnail.length_ > pack_size) return false;
+      entry.thumbnails_ << thumbnail;
+    }
+    entries_[path] = entry;
+  }
+
+  return s.status() == QDataStream::Ok;
+}
+
+void AlbumCoverThumbnailCache::WriteIndex() {
+  // Write a new file and move it over the old one, so the index is never
+  // half written.
+  const QString filename = directory_ + "/" + kIndexFilename;
+  QFile file(filename + ".new");
+  if (!file.open(QIODevice::WriteOnly)) {
+    qLog(Warning) << "Couldn't write" << file.fileName();
+    return;
+  }
+
+  QDataStream s(&file);
+  s << kIndexMagic << qint32(kIndexVersion) << qint32(entries_.count());
+  for (auto it = entries_.constBegin(); it != entries_.constEnd(); ++it) {
+    s << it.key() << it.value().mtime_
+      << qint32(it.value().thumbnails_.count());
+    for (const Thumbnail& thumbnail : it.value().thumbnails_) {
+      s << thumbnail.size_ << thumbnail.offset_ << thumbnail.length_;
+    }
+  }
+  file.close();
+
+  // The pack file has to be on disk before an index that points into it.
+  pack_.flush();
+
+  QFile::remove(filename);
+  file.rename(filename);
+  unsaved_entries_ = 0;
+}
+
+void AlbumCoverThumbnailCache::Flush() {
+  QMutexLocker l(&mutex_);
+  if (opened_ && pack_.isOpen() && unsaved_entries_) WriteIndex();
+}
+
+bool AlbumCoverThumbnailCache::EnsureMapped(qint64 end) {
+  if (map_ && end <= map_size_) return true;
+
+  // Thumbnails have been added since the file was mapped.
+  if (map_) pack_.unmap(map_);
+  pack_.flush();
+  map_size_ = pack_.size();
+  map_ = pack_.map(0, map_size_);
+  if (!map_) map_size_ = 0;
+
+  return map_ && end <= map_size_;
+}
+
+QImage AlbumCoverThumbnailCache::Load(const QString& path, uint mtime,
+                                      int size) {
+  QMutexLocker l(&mutex_);
+  Open();
+
+  QHash<QString, Entry>::const_iterator it = entries_.constFind(path);
+  if (it == entries_.constEnd() || it->mtime_ != mtime) return QImage();
+
+  for (const Thumbnail& thumbnail : it->thumbnails_) {
+    if (thumbnail.size_ < size) continue;
+    if (!EnsureMapped(thumbnail.offset_ + thumbnail.length_)) break;
+
+    QImage image;
+    image.loadFromData(map_ + thumbnail.offset_, thumbnail.length_, "PNG");
+    return image;
+  }
+  return QImage();
+}
+
+void AlbumCoverThumbnailCache::Save(const QString& path, uint mtime,
+                                    const QImage& image) {
+  if (image.isNull()) return;
+
+  // Each size is scaled from the next one up, which is quicker than going
+  // back to the original every time.  Sizes bigger than the image itself
+  // aren't needed - the first one that's big enough gets the original.
+  QList<int> sizes;
+  for (int i = 0; i < kSizeCount; ++i) {
+    sizes << kSizes[i];
+    if (qMax(image.width(), image.height()) <= kSizes[i]) break;
+  }
+
+  // There's nothing bigger to load than the original, so it's stored as the
+  // largest size.  Otherwise a small cover would miss the cache, and be
+  // decoded and saved again, every time it's wanted at a bigger size.
+  sizes.last() = kLargestSize;
+
+  QList<QPair<int, QByteArray> > encoded;
+  QImage scaled = image;
+  for (int i = sizes.count() - 1; i >= 0; --i) {
+    const int size = sizes[i];
+    if (scaled.width() > size || scaled.height() > size) {
+      scaled = scaled.scaled(size, size, Qt::KeepAspectRatio,
+                             Qt::SmoothTransformation);
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!scaled.save(&buffer, "PNG")) return;
+    encoded.prepend(qMakePair(size, data));
+  }
+
+  QMutexLocker l(&mutex_);
+  Open();
+  if (!pack_.isOpen()) return;
+
+  Entry entry;
+  entry.mtime_ = mtime;
+  for (const QPair<int, QByteArray>& level : encoded) {
+    Thumbnail thumbnail;
+    thumbnail.size_ = level.first;
+    thumbnail.offset_ = pack_.size();
+    thumbnail.length_ = level.second.size();
+
+    if (!pack_.seek(thumbnail.offset_) ||
+        pack_.write(level.second) != thumbnail.length_) {
+      qLog(Warning) << "Couldn't write to" << pack_.fileName();
+      return;
+    }
+    entry.thumbnails_ << thumbnail;
+  }
+
+  entries_[path] = entry;
+  if (++unsaved_entries_ >= kSavesBetweenFlushes) WriteIndex();
+}
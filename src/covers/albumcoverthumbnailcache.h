@@ -0,0 +1,103 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ALBUMCOVERTHUMBNAILCACHE_H
+#define ALBUMCOVERTHUMBNAILCACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+// Small copies of album covers kept on disk, so the library and the cover
+// manager don't have to decode every full size cover again each time
+// Clementine starts.
+//
+// Each cover is saved at a few sizes, like the levels of a mipmap, and the
+// smallest one that's big enough is handed back to be scaled the rest of the
+// way.  The thumbnails are PNGs appended to a single pack file that's memory
+// mapped for reading, with a separate index saying where each one is.
+// Entries are keyed by the path of the image, or of the song for embedded
+// art, along with that file's modification time, so a cover that's changed
+// is saved again.  All the functions are thread-safe.
+class AlbumCoverThumbnailCache {
+ public:
+  AlbumCoverThumbnailCache(const QString& directory);
+  ~AlbumCoverThumbnailCache();
+
+  // In increasing order.
+  static const int kSizes[];
+  static const int kSizeCount;
+  static const int kLargestSize;
+
+  static const char* kPackFilename;
+  static const char* kIndexFilename;
+  static const quint32 kIndexMagic;
+  static const int kIndexVersion;
+  static const int kSavesBetweenFlushes;
+  // The pack file is compacted when it's opened if more than half of it, or
+  // more than this many bytes, aren't used by the index any more.
+  static const qint64 kMaxUnusedBytes;
+
+  // Returns the smallest thumbnail that's at least size pixels high and
+  // wide, or a null image if this version of the file hasn't been saved.
+  // A cover that's smaller than size comes back at its original size, as
+  // long as size is no bigger than kLargestSize.
+  QImage Load(const QString& path, uint mtime, int size);
+
+  // Saves the image at each of the sizes.  Does nothing if it's null.
+  void Save(const QString& path, uint mtime, const QImage& image);
+
+  // Writes the index.  Thumbnails saved since the last flush are lost if
+  // Clementine doesn't get to do this.
+  void Flush();
+
+ private:
+  struct Thumbnail {
+    int size_;
+    qint64 offset_;
+    int length_;
+  };
+
+  struct Entry {
+    uint mtime_;
+    QList<Thumbnail> thumbnails_;
+  };
+
+  void Open();
+  void Reset();
+  // Rewrites the pack file without the thumbnails that aren't in the index.
+  void Compact();
+  bool ReadIndex();
+  void WriteIndex();
+  bool EnsureMapped(qint64 end);
+
+  const QString directory_;
+
+  QMutex mutex_;
+  bool opened_;
+  QFile pack_;
+  uchar* map_;
+  qint64 map_size_;
+
+  QHash<QString, Entry> entries_;
+  int unsaved_entries_;
+};
+
+#endif  // ALBUMCOVERTHUMBNAILCACHE_H
@@ -52,6 +52,8 @@ FilesystemDevice::FilesystemDevice(const QUrl& url, DeviceLister* lister,
           SLOT(AddOrUpdateSongs(SongList)));
   connect(watcher_, SIGNAL(SongsMTimeUpdated(SongList)), backend_,
           SLOT(UpdateMTimesOnly(SongList)));
+  connect(watcher_, SIGNAL(SongsMoved(SongList)), backend_,
+          SLOT(MoveSongs(SongList)));
   connect(watcher_, SIGNAL(SongsDeleted(SongList)), backend_,
           SLOT(DeleteSongs(SongList)));
   connect(watcher_, SIGNAL(SubdirsDiscovered(SubdirectoryList)), backend_,
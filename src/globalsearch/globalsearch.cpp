@@ -41,6 +41,7 @@ GlobalSearch::GlobalSearch(Application* app, QObject* parent)
   cover_loader_options_.desired_height_ = SearchProvider::kArtHeight;
   cover_loader_options_.pad_output_image_ = true;
   cover_loader_options_.scale_output_image_ = true;
+  cover_loader_options_.use_thumbnail_cache_ = true;
 
   connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
           SLOT(AlbumArtLoaded(quint64, QImage)));
@@ -49,6 +49,7 @@ SearchProvider::ResultList LibrarySearchProvider::Search(int id,
 
   LibraryQuery q(options);
   q.SetColumnSpec("%songs_table.ROWID, " + Song::kColumnSpec);
+  q.SetOrderByRelevance();
 
   if (!backend_->ExecQuery(&q)) {
     return ResultList();
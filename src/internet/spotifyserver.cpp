@@ -18,33 +18,53 @@
 #include "spotifyserver.h"
 #include "core/closure.h"
 #include "core/logging.h"
+#include "core/sharedmemorydevice.h"
 
 #include "spotifymessages.pb.h"
 
-#include <QTcpServer>
-#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
 #include <QTimer>
 
 SpotifyServer::SpotifyServer(QObject* parent)
     : AbstractMessageHandler<pb::spotify::Message>(nullptr, parent),
-      server_(new QTcpServer(this)),
+      server_(new QLocalServer(this)),
       logged_in_(false) {
   connect(server_, SIGNAL(newConnection()), SLOT(NewConnection()));
 }
 
 void SpotifyServer::Init() {
-  if (!server_->listen(QHostAddress::LocalHost)) {
-    qLog(Error) << "Couldn't open server socket" << server_->errorString();
+  // Find an unused name and start listening
+  forever {
+    const QString name = QString("clementine_spotify_%1").arg(qrand());
+    if (server_->listen(name)) break;
+
+    if (server_->serverError() != QAbstractSocket::AddressInUseError) {
+      qLog(Error) << "Couldn't open server socket" << server_->errorString();
+      break;
+    }
   }
 }
 
-int SpotifyServer::server_port() const { return server_->serverPort(); }
+QString SpotifyServer::server_name() const {
+  return server_->fullServerName();
+}
 
 void SpotifyServer::NewConnection() {
-  QTcpSocket* socket = server_->nextPendingConnection();
-  SetDevice(socket);
+  QLocalSocket* socket = server_->nextPendingConnection();
+
+  // Search results and album art can be large, so send the messages through
+  // shared memory if we can.  The socket is then only used to notice the
+  // blob going away.
+  SharedMemoryDevice* shared_memory = SharedMemoryDevice::Create(socket, this);
+  if (shared_memory) {
+    SetDevice(shared_memory);
+  } else {
+    SetDevice(socket);
+  }
 
-  qLog(Info) << "Connection from port" << socket->peerPort();
+  qLog(Info) << "Connection from the Spotify blob"
+             << (shared_memory ? "using shared memory" : "using its socket");
 
   // Send any login messages that were queued before the client connected
   for (const pb::spotify::Message& message : queued_login_messages_) {
@@ -24,8 +24,7 @@
 #include <QImage>
 #include <QObject>
 
-class QTcpServer;
-class QTcpSocket;
+class QLocalServer;
 
 class SpotifyServer : public AbstractMessageHandler<pb::spotify::Message> {
   Q_OBJECT
@@ -51,7 +50,8 @@ class SpotifyServer : public AbstractMessageHandler<pb::spotify::Message> {
                            bool volume_normalisation);
   void LoadToplist();
 
-  int server_port() const;
+  // The name of the local socket the blob should connect to.
+  QString server_name() const;
 
  public slots:
   void StartPlayback(const QString& uri, quint16 port);
@@ -83,7 +83,7 @@ signals:
   void SyncPlaylist(pb::spotify::PlaylistType type, int index, bool offline);
   void SendOrQueueMessage(const pb::spotify::Message& message);
 
-  QTcpServer* server_;
+  QLocalServer* server_;
   bool logged_in_;
 
   QList<pb::spotify::Message> queued_login_messages_;
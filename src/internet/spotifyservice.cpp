@@ -324,8 +324,7 @@ void SpotifyService::StartBlobProcess() {
           SLOT(BlobProcessError(QProcess::ProcessError)));
 
   qLog(Info) << "Starting" << blob_path;
-  blob_process_->start(
-      blob_path, QStringList() << QString::number(server_->server_port()));
+  blob_process_->start(blob_path, QStringList() << server_->server_name());
 }
 
 bool SpotifyService::IsBlobInstalled() const {
@@ -33,6 +33,7 @@ const char* Library::kSongsTable = "songs";
 const char* Library::kDirsTable = "directories";
 const char* Library::kSubdirsTable = "subdirectories";
 const char* Library::kFtsTable = "songs_fts";
+const char* Library::kFullScanProgressTable = "full_scan_progress";
 
 Library::Library(Application* app, QObject* parent)
     : QObject(parent),
@@ -45,7 +46,7 @@ Library::Library(Application* app, QObject* parent)
   backend()->moveToThread(app->database()->thread());
 
   backend_->Init(app->database(), kSongsTable, kDirsTable, kSubdirsTable,
-                 kFtsTable);
+                 kFtsTable, kFullScanProgressTable);
 
   using smart_playlists::Generator;
   using smart_playlists::GeneratorPtr;
@@ -142,6 +143,8 @@ void Library::Init() {
           SLOT(AddOrUpdateSongs(SongList)));
   connect(watcher_, SIGNAL(SongsMTimeUpdated(SongList)), backend_,
           SLOT(UpdateMTimesOnly(SongList)));
+  connect(watcher_, SIGNAL(SongsMoved(SongList)), backend_,
+          SLOT(MoveSongs(SongList)));
   connect(watcher_, SIGNAL(SongsDeleted(SongList)), backend_,
           SLOT(MarkSongsUnavailable(SongList)));
   connect(watcher_, SIGNAL(SongsReadded(SongList, bool)), backend_,
@@ -152,6 +155,10 @@ void Library::Init() {
           SLOT(AddOrUpdateSubdirs(SubdirectoryList)));
   connect(watcher_, SIGNAL(CompilationsNeedUpdating()), backend_,
           SLOT(UpdateCompilations()));
+  connect(watcher_, SIGNAL(FullScanProgress(int, QStringList)), backend_,
+          SLOT(AddFullScanProgress(int, QStringList)));
+  connect(watcher_, SIGNAL(FullScanFinished(int)), backend_,
+          SLOT(ClearFullScanProgress(int)));
 
   // This will start the watcher checking for updates
   backend_->LoadDirectoriesAsync();
@@ -34,6 +34,10 @@
 #include <QtDebug>
 
 const char* LibraryBackend::kSettingsGroup = "LibraryBackend";
+const int LibraryBackend::kBulkInsertThreshold = 100;
+// SQLITE_MAX_VARIABLE_NUMBER in builds of SQLite older than 3.32.
+const int LibraryBackend::kMaxBoundValues = 999;
+const int LibraryBackend::kFtsRebuildBatchSize = 500;
 
 const char* LibraryBackend::kNewScoreSql =
     "case when playcount <= 0 then (%1 * 100 + score) / 2"
@@ -49,12 +53,21 @@ LibraryBackend::LibraryBackend(QObject* parent)
 void LibraryBackend::Init(Database* db, const QString& songs_table,
                           const QString& dirs_table,
                           const QString& subdirs_table,
-                          const QString& fts_table) {
+                          const QString& fts_table,
+                          const QString& full_scan_progress_table) {
   db_ = db;
   songs_table_ = songs_table;
   dirs_table_ = dirs_table;
   subdirs_table_ = subdirs_table;
   fts_table_ = fts_table;
+  full_scan_progress_table_ = full_scan_progress_table;
+
+  // Keep the index up to date before anything else hears about the changes.
+  connect(this, SIGNAL(SongsDiscovered(SongList)),
+          SLOT(IndexSongsDiscovered(SongList)), Qt::DirectConnection);
+  connect(this, SIGNAL(SongsDeleted(SongList)),
+          SLOT(IndexSongsDeleted(SongList)), Qt::DirectConnection);
+
   ReloadSettings();
 }
 
@@ -90,7 +103,7 @@ void LibraryBackend::UpdateSongRatingAsync(int id, float rating) {
 void LibraryBackend::LoadDirectories() {
   DirectoryList dirs = GetAllDirectories();
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   for (const Directory& dir : dirs) {
@@ -100,7 +113,7 @@ void LibraryBackend::LoadDirectories() {
 
 void LibraryBackend::ChangeDirPath(int id, const QString& old_path,
                                    const QString& new_path) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction t(&db);
 
@@ -145,7 +158,7 @@ void LibraryBackend::ChangeDirPath(int id, const QString& old_path,
 }
 
 DirectoryList LibraryBackend::GetAllDirectories() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   DirectoryList ret;
@@ -165,7 +178,7 @@ DirectoryList LibraryBackend::GetAllDirectories() {
 }
 
 SubdirectoryList LibraryBackend::SubdirsInDirectory(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db = db_->Connect();
   return SubdirsInDirectory(id, db);
 }
@@ -192,7 +205,7 @@ SubdirectoryList LibraryBackend::SubdirsInDirectory(int id, QSqlDatabase& db) {
 }
 
 void LibraryBackend::UpdateTotalSongCount() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString("SELECT COUNT(*) FROM %1 WHERE unavailable = 0")
@@ -216,7 +229,7 @@ void LibraryBackend::AddDirectory(const QString& path) {
     qLog(Debug) << "db_path" << db_path;
   }
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString(
@@ -235,7 +248,7 @@ void LibraryBackend::AddDirectory(const QString& path) {
 }
 
 void LibraryBackend::RemoveDirectory(const Directory& dir) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   // Remove songs first
@@ -257,13 +270,86 @@ void LibraryBackend::RemoveDirectory(const Directory& dir) {
   q.exec();
   if (db_->CheckErrors(q)) return;
 
+  ClearFullScanProgress(dir.id);
+
   emit DirectoryDeleted(dir);
 
   transaction.Commit();
 }
 
+bool LibraryBackend::GetFullScanProgress(int directory,
+                                         QStringList* finished_subdirs) {
+  if (full_scan_progress_table_.isEmpty()) return false;
+
+  Database::Locker l(db_->ReadMutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  QSqlQuery q(QString("SELECT path FROM %1 WHERE directory = :directory")
+                  .arg(full_scan_progress_table_),
+              db);
+  q.bindValue(":directory", directory);
+  q.exec();
+  if (db_->CheckErrors(q)) return false;
+
+  bool in_progress = false;
+  while (q.next()) {
+    in_progress = true;
+
+    // The row with a NULL path just marks the scan as started.
+    if (finished_subdirs && !q.value(0).isNull()) {
+      *finished_subdirs << q.value(0).toString();
+    }
+  }
+  return in_progress;
+}
+
+void LibraryBackend::AddFullScanProgress(int directory,
+                                         const QStringList& finished_subdirs) {
+  if (full_scan_progress_table_.isEmpty()) return;
+
+  Database::Locker l(db_->Mutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  QSqlQuery q(QString("INSERT INTO %1 (directory, path)"
+                      " VALUES (:directory, :path)")
+                  .arg(full_scan_progress_table_),
+              db);
+
+  ScopedTransaction transaction(&db);
+
+  if (finished_subdirs.isEmpty()) {
+    q.bindValue(":directory", directory);
+    q.bindValue(":path", QVariant(QVariant::String));
+    q.exec();
+    if (db_->CheckErrors(q)) return;
+  }
+
+  for (const QString& path : finished_subdirs) {
+    q.bindValue(":directory", directory);
+    q.bindValue(":path", path);
+    q.exec();
+    if (db_->CheckErrors(q)) return;
+  }
+
+  transaction.Commit();
+}
+
+void LibraryBackend::ClearFullScanProgress(int directory) {
+  if (full_scan_progress_table_.isEmpty()) return;
+
+  Database::Locker l(db_->Mutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  QSqlQuery q(QString("DELETE FROM %1 WHERE directory = :directory")
+                  .arg(full_scan_progress_table_),
+              db);
+  q.bindValue(":directory", directory);
+  q.exec();
+  db_->CheckErrors(q);
+}
+
 SongList LibraryBackend::FindSongsInDirectory(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(
@@ -284,27 +370,28 @@ SongList LibraryBackend::FindSongsInDirectory(int id) {
 }
 
 void LibraryBackend::AddOrUpdateSubdirs(const SubdirectoryList& subdirs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
-  QSqlQuery find_query(
+  Database::PreparedQuery find_query(db_->CachedQuery(
       QString(
           "SELECT ROWID FROM %1"
           " WHERE directory = :id AND path = :path").arg(subdirs_table_),
-      db);
-  QSqlQuery add_query(QString(
-                          "INSERT INTO %1 (directory, path, mtime)"
-                          " VALUES (:id, :path, :mtime)").arg(subdirs_table_),
-                      db);
-  QSqlQuery update_query(
+      db));
+  Database::PreparedQuery add_query(db_->CachedQuery(
+      QString(
+          "INSERT INTO %1 (directory, path, mtime)"
+          " VALUES (:id, :path, :mtime)").arg(subdirs_table_),
+      db));
+  Database::PreparedQuery update_query(db_->CachedQuery(
       QString(
           "UPDATE %1 SET mtime = :mtime"
           " WHERE directory = :id AND path = :path").arg(subdirs_table_),
-      db);
-  QSqlQuery delete_query(
+      db));
+  Database::PreparedQuery delete_query(db_->CachedQuery(
       QString(
           "DELETE FROM %1"
           " WHERE directory = :id AND path = :path").arg(subdirs_table_),
-      db);
+      db));
 
   ScopedTransaction transaction(&db);
   for (const Subdirectory& subdir : subdirs) {
@@ -336,49 +423,70 @@ void LibraryBackend::AddOrUpdateSubdirs(const SubdirectoryList& subdirs) {
       }
     }
   }
+  find_query.finish();
   transaction.Commit();
 }
 
+bool LibraryBackend::DirectoryExists(int id, QHash<int, bool>* cache,
+                                     QSqlDatabase& db) {
+  if (dirs_table_.isEmpty()) return true;
+
+  QHash<int, bool>::const_iterator it = cache->constFind(id);
+  if (it != cache->constEnd()) return it.value();
+
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("SELECT ROWID FROM %1 WHERE ROWID = :id").arg(dirs_table_), db));
+  q.bindValue(":id", id);
+  q.exec();
+  if (db_->CheckErrors(q)) return false;
+
+  const bool exists = q.next();
+  q.finish();
+  cache->insert(id, exists);
+  return exists;
+}
+
 void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
-  QMutexLocker l(db_->Mutex());
+  if (songs.count() >= kBulkInsertThreshold) {
+    AddOrUpdateSongsInBulk(songs);
+    return;
+  }
+
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery check_dir(
-      QString("SELECT ROWID FROM %1 WHERE ROWID = :id").arg(dirs_table_), db);
-  QSqlQuery add_song(QString("INSERT INTO %1 (" + Song::kColumnSpec +
-                             ")"
-                             " VALUES (" +
-                             Song::kBindSpec + ")").arg(songs_table_),
-                     db);
-  QSqlQuery update_song(QString("UPDATE %1 SET " + Song::kUpdateSpec +
-                                " WHERE ROWID = :id").arg(songs_table_),
-                        db);
-  QSqlQuery add_song_fts(
+  Database::PreparedQuery add_song(db_->CachedQuery(
+      QString("INSERT INTO %1 (" + Song::kColumnSpec +
+              ")"
+              " VALUES (" +
+              Song::kBindSpec + ")").arg(songs_table_),
+      db));
+  Database::PreparedQuery update_song(db_->CachedQuery(
+      QString("UPDATE %1 SET " + Song::kUpdateSpec +
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
+  Database::PreparedQuery add_song_fts(db_->CachedQuery(
       QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
               ")"
               " VALUES (:id, " +
               Song::kFtsBindSpec + ")").arg(fts_table_),
-      db);
-  QSqlQuery update_song_fts(QString("UPDATE %1 SET " + Song::kFtsUpdateSpec +
-                                    " WHERE ROWID = :id").arg(fts_table_),
-                            db);
+      db));
+  Database::PreparedQuery update_song_fts(db_->CachedQuery(
+      QString("UPDATE %1 SET " + Song::kFtsUpdateSpec +
+              " WHERE ROWID = :id").arg(fts_table_),
+      db));
 
   ScopedTransaction transaction(&db);
 
   SongList added_songs;
   SongList deleted_songs;
+  QHash<int, bool> directories;
 
   for (const Song& song : songs) {
     // Do a sanity check first - make sure the song's directory still exists
     // This is to fix a possible race condition when a directory is removed
     // while LibraryWatcher is scanning it.
-    if (!dirs_table_.isEmpty()) {
-      check_dir.bindValue(":id", song.directory_id());
-      check_dir.exec();
-      if (db_->CheckErrors(check_dir)) continue;
-
-      if (!check_dir.next()) continue;  // Directory didn't exist
-    }
+    if (!DirectoryExists(song.directory_id(), &directories, db)) continue;
 
     if (song.id() == -1) {
       // Create
@@ -430,13 +538,161 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
   UpdateTotalSongCountAsync();
 }
 
+void LibraryBackend::AddOrUpdateSongsInBulk(const SongList& songs) {
+  Database::Locker l(db_->Mutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  // Song::BindToQuery only knows how to bind one row, so bind each song to
+  // the single row INSERT and copy the values across to the multi-row one.
+  Database::PreparedQuery add_song(db_->CachedQuery(
+      QString("INSERT INTO %1 (" + Song::kColumnSpec +
+              ")"
+              " VALUES (" +
+              Song::kBindSpec + ")").arg(songs_table_),
+      db));
+  Database::PreparedQuery update_song(db_->CachedQuery(
+      QString("UPDATE %1 SET " + Song::kUpdateSpec +
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
+
+  ScopedTransaction transaction(&db);
+
+  // Sort the songs out first, and look up the old versions of all the
+  // updated ones at once.
+  SongList new_songs;
+  QStringList updated_ids;
+  QHash<int, bool> directories;
+  for (const Song& song : songs) {
+    if (!DirectoryExists(song.directory_id(), &directories, db)) continue;
+
+    if (song.id() == -1) {
+      new_songs << song;
+    } else {
+      updated_ids << QString::number(song.id());
+    }
+  }
+
+  QHash<int, Song> old_songs;
+  for (const Song& song : GetSongsById(updated_ids, db)) {
+    old_songs[song.id()] = song;
+  }
+
+  SongList added_songs;
+  SongList deleted_songs;
+  QStringList changed_ids;
+
+  // Give the new songs their IDs up front so they can be inserted many rows
+  // at a time, and so their FTS rows can be found again afterwards.
+  Database::PreparedQuery max_id(db_->CachedQuery(
+      QString("SELECT MAX(ROWID) FROM %1").arg(songs_table_), db));
+  max_id.exec();
+  if (db_->CheckErrors(max_id) || !max_id.next()) return;
+  int next_id = max_id.value(0).toInt() + 1;
+  max_id.finish();
+
+  const int columns = Song::kColumns.count() + 1;
+  const int rows_per_insert = kMaxBoundValues / columns;
+  const QString row = "(?" + QString(", ?").repeated(columns - 1) + ")";
+
+  for (int i = 0; i < new_songs.count(); i += rows_per_insert) {
+    const SongList chunk = new_songs.mid(i, rows_per_insert);
+
+    QStringList rows;
+    for (int j = 0; j < chunk.count(); ++j) rows << row;
+
+    Database::PreparedQuery insert(db_->CachedQuery(
+        QString("INSERT INTO %1 (ROWID, " + Song::kColumnSpec + ") VALUES " +
+                rows.join(", ")).arg(songs_table_),
+        db));
+
+    SongList inserted;
+    int position = 0;
+    for (const Song& song : chunk) {
+      song.BindToQuery(&add_song);
+
+      insert.bindValue(position++, next_id);
+      for (int column = 0; column < columns - 1; ++column) {
+        insert.bindValue(position++, add_song.boundValue(column));
+      }
+
+      Song copy(song);
+      copy.set_id(next_id++);
+      inserted << copy;
+    }
+
+    insert.exec();
+    if (db_->CheckErrors(insert)) continue;
+
+    for (const Song& song : inserted) {
+      changed_ids << QString::number(song.id());
+    }
+    added_songs << inserted;
+  }
+
+  for (const Song& song : songs) {
+    if (song.id() == -1) continue;
+
+    const Song old_song = old_songs.value(song.id());
+    if (!old_song.is_valid()) continue;
+
+    song.BindToQuery(&update_song);
+    update_song.bindValue(":id", song.id());
+    update_song.exec();
+    if (db_->CheckErrors(update_song)) continue;
+
+    changed_ids << QString::number(song.id());
+    deleted_songs << old_song;
+    added_songs << song;
+  }
+
+  // Now bring the FTS index up to date in one go, straight from the songs
+  // table.
+  RebuildFtsRows(changed_ids, db);
+
+  transaction.Commit();
+
+  if (!deleted_songs.isEmpty()) emit SongsDeleted(deleted_songs);
+
+  if (!added_songs.isEmpty()) emit SongsDiscovered(added_songs);
+
+  UpdateTotalSongCountAsync();
+}
+
+void LibraryBackend::RebuildFtsRows(const QStringList& ids, QSqlDatabase& db) {
+  // The FTS columns are the song columns with "fts" in front.
+  QStringList song_columns;
+  for (const QString& column : Song::kFtsColumns) {
+    song_columns << column.mid(3);
+  }
+
+  for (int i = 0; i < ids.count(); i += kFtsRebuildBatchSize) {
+    const QString in = ids.mid(i, kFtsRebuildBatchSize).join(",");
+
+    QSqlQuery remove(
+        QString("DELETE FROM %1 WHERE ROWID IN (%2)").arg(fts_table_, in), db);
+    remove.exec();
+    if (db_->CheckErrors(remove)) continue;
+
+    QSqlQuery add(QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
+                          ")"
+                          " SELECT ROWID, " +
+                          song_columns.join(", ") +
+                          " FROM %2 WHERE ROWID IN (%3)")
+                      .arg(fts_table_, songs_table_, in),
+                  db);
+    add.exec();
+    db_->CheckErrors(add);
+  }
+}
+
 void LibraryBackend::UpdateMTimesOnly(const SongList& songs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery q(QString("UPDATE %1 SET mtime = :mtime WHERE ROWID = :id")
-                  .arg(songs_table_),
-              db);
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("UPDATE %1 SET mtime = :mtime WHERE ROWID = :id")
+          .arg(songs_table_),
+      db));
 
   ScopedTransaction transaction(&db);
   for (const Song& song : songs) {
@@ -448,8 +704,63 @@ void LibraryBackend::UpdateMTimesOnly(const SongList& songs) {
   transaction.Commit();
 }
 
+void LibraryBackend::MoveSongs(const SongList& songs) {
+  Database::Locker l(db_->Mutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("UPDATE %1 SET directory = :directory,"
+              " filename = :filename, inode = :inode,"
+              " art_automatic = :art_automatic, unavailable = 0"
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
+
+  ScopedTransaction transaction(&db);
+
+  SongList added_songs;
+  SongList deleted_songs;
+  SongList new_songs;
+
+  for (const Song& song : songs) {
+    Song old_song(GetSongById(song.id()));
+    if (!old_song.is_valid()) {
+      // The old row was deleted before the move was found.  The watcher won't
+      // look at the file again, so add it back as a new song.
+      Song new_song(song);
+      new_song.set_id(-1);
+      new_songs << new_song;
+      continue;
+    }
+
+    q.bindValue(":directory", song.directory_id());
+    if (Application::kIsPortable &&
+        Utilities::UrlOnSameDriveAsClementine(song.url())) {
+      q.bindValue(":filename",
+                  Utilities::GetRelativePathToClementineBin(song.url()));
+    } else {
+      q.bindValue(":filename", song.url().toEncoded());
+    }
+    q.bindValue(":inode", song.inode() == -1 ? QVariant() : song.inode());
+    q.bindValue(":art_automatic", song.art_automatic());
+    q.bindValue(":id", song.id());
+    q.exec();
+    if (db_->CheckErrors(q)) continue;
+
+    deleted_songs << old_song;
+    added_songs << song;
+  }
+
+  transaction.Commit();
+
+  if (!deleted_songs.isEmpty()) emit SongsDeleted(deleted_songs);
+
+  if (!added_songs.isEmpty()) emit SongsDiscovered(added_songs);
+
+  if (!new_songs.isEmpty()) AddOrUpdateSongs(new_songs);
+}
+
 void LibraryBackend::DeleteSongs(const SongList& songs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery remove(
@@ -476,13 +787,14 @@ void LibraryBackend::DeleteSongs(const SongList& songs) {
 
 void LibraryBackend::MarkSongsUnavailable(const SongList& songs,
                                           bool unavailable) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery remove(QString("UPDATE %1 SET unavailable = %2 WHERE ROWID = :id")
-                       .arg(songs_table_)
-                       .arg(int(unavailable)),
-                   db);
+  Database::PreparedQuery remove(db_->CachedQuery(
+      QString("UPDATE %1 SET unavailable = %2 WHERE ROWID = :id")
+          .arg(songs_table_)
+          .arg(int(unavailable)),
+      db));
 
   ScopedTransaction transaction(&db);
   for (const Song& song : songs) {
@@ -494,6 +806,16 @@ void LibraryBackend::MarkSongsUnavailable(const SongList& songs,
 
   emit SongsDeleted(songs);
   UpdateTotalSongCountAsync();
+
+  // Songs that are back again went out of the index with SongsDeleted.
+  if (!unavailable) {
+    SongList available;
+    for (Song song : songs) {
+      song.set_unavailable(false);
+      available << song;
+    }
+    index_.AddOrUpdate(available);
+  }
 }
 
 QStringList LibraryBackend::GetAll(const QString& column,
@@ -502,7 +824,7 @@ QStringList LibraryBackend::GetAll(const QString& column,
   query.SetColumnSpec("DISTINCT " + column);
   query.AddCompilationRequirement(false);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   if (!ExecQuery(&query)) return QStringList();
 
   QStringList ret;
@@ -522,7 +844,7 @@ QStringList LibraryBackend::GetAllArtistsWithAlbums(const QueryOptions& opt) {
   query.AddCompilationRequirement(false);
   query.AddWhere("album", "", "!=");
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   if (!ExecQuery(&query)) return QStringList();
 
   QStringList ret;
@@ -561,26 +883,27 @@ SongList LibraryBackend::GetSongs(const QString& artist, const QString& album,
 
 SongList LibraryBackend::ExecLibraryQuery(LibraryQuery* query) {
   query->SetColumnSpec("%songs_table.ROWID, " + Song::kColumnSpec);
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   if (!ExecQuery(query)) return SongList();
 
   SongList ret;
-  while (query->Next()) {
+  SqlRowReader reader(*query);
+  while (reader.Next()) {
     Song song;
-    song.InitFromQuery(*query, true);
+    song.InitFromQuery(reader, true);
     ret << song;
   }
   return ret;
 }
 
 Song LibraryBackend::GetSongById(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
   return GetSongById(id, db);
 }
 
 SongList LibraryBackend::GetSongsById(const QList<int>& ids) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   QStringList str_ids;
@@ -592,7 +915,7 @@ SongList LibraryBackend::GetSongsById(const QList<int>& ids) {
 }
 
 SongList LibraryBackend::GetSongsById(const QStringList& ids) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   return GetSongsById(ids, db);
@@ -601,7 +924,7 @@ SongList LibraryBackend::GetSongsById(const QStringList& ids) {
 SongList LibraryBackend::GetSongsByForeignId(const QStringList& ids,
                                              const QString& table,
                                              const QString& column) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   QString in = ids.join(",");
@@ -629,9 +952,21 @@ SongList LibraryBackend::GetSongsByForeignId(const QStringList& ids,
 }
 
 Song LibraryBackend::GetSongById(int id, QSqlDatabase& db) {
-  SongList list = GetSongsById(QStringList() << QString::number(id), db);
-  if (list.isEmpty()) return Song();
-  return list.first();
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("SELECT ROWID, " + Song::kColumnSpec +
+              " FROM %1"
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
+  q.bindValue(":id", id);
+  q.exec();
+  if (db_->CheckErrors(q)) return Song();
+
+  Song song;
+  if (q.next()) {
+    song.InitFromQuery(q, true);
+  }
+  q.finish();
+  return song;
 }
 
 SongList LibraryBackend::GetSongsById(const QStringList& ids,
@@ -646,44 +981,85 @@ SongList LibraryBackend::GetSongsById(const QStringList& ids,
   if (db_->CheckErrors(q)) return SongList();
 
   SongList ret;
-  while (q.next()) {
+  SqlRowReader reader(q);
+  while (reader.Next()) {
     Song song;
-    song.InitFromQuery(q, true);
+    song.InitFromQuery(reader, true);
     ret << song;
   }
   return ret;
 }
 
 Song LibraryBackend::GetSongByUrl(const QUrl& url, qint64 beginning) {
-  LibraryQuery query;
-  query.SetColumnSpec("%songs_table.ROWID, " + Song::kColumnSpec);
-  query.AddWhere("filename", url.toEncoded());
-  query.AddWhere("beginning", beginning);
+  Database::Locker l(db_->ReadMutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("SELECT ROWID, " + Song::kColumnSpec +
+              " FROM %1"
+              " WHERE filename = :filename AND beginning = :beginning"
+              " AND unavailable = 0").arg(songs_table_),
+      db));
+  q.bindValue(":filename", url.toEncoded());
+  q.bindValue(":beginning", beginning);
+  q.exec();
+  if (db_->CheckErrors(q)) return Song();
 
   Song song;
-  if (ExecQuery(&query) && query.Next()) {
-    song.InitFromQuery(query, true);
+  if (q.next()) {
+    song.InitFromQuery(q, true);
   }
+  q.finish();
   return song;
 }
 
 SongList LibraryBackend::GetSongsByUrl(const QUrl& url) {
-  LibraryQuery query;
-  query.SetColumnSpec("%songs_table.ROWID, " + Song::kColumnSpec);
-  query.AddWhere("filename", url.toEncoded());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("SELECT ROWID, " + Song::kColumnSpec +
+              " FROM %1"
+              " WHERE filename = :filename AND unavailable = 0")
+          .arg(songs_table_),
+      db));
+  q.bindValue(":filename", url.toEncoded());
+  q.exec();
+  if (db_->CheckErrors(q)) return SongList();
 
   SongList songlist;
-  if (ExecQuery(&query)) {
-    while (query.Next()) {
-      Song song;
-      song.InitFromQuery(query, true);
+  while (q.next()) {
+    Song song;
+    song.InitFromQuery(q, true);
 
-      songlist << song;
-    }
+    songlist << song;
   }
   return songlist;
 }
 
+SongList LibraryBackend::GetSongsBySizeAndMTime(int filesize, uint mtime) {
+  Database::Locker l(db_->ReadMutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+
+  QSqlQuery q(QString("SELECT ROWID, " + Song::kColumnSpec +
+                      " FROM %1"
+                      " WHERE filesize = :filesize AND mtime = :mtime")
+                  .arg(songs_table_),
+              db);
+  q.bindValue(":filesize", filesize);
+  q.bindValue(":mtime", mtime);
+  q.exec();
+  if (db_->CheckErrors(q)) return SongList();
+
+  SongList ret;
+  while (q.next()) {
+    Song song;
+    song.InitFromQuery(q, true);
+    ret << song;
+  }
+  return ret;
+}
+
 LibraryBackend::AlbumList LibraryBackend::GetCompilationAlbums(
     const QueryOptions& opt) {
   return GetAlbums(QString(), true, opt);
@@ -696,7 +1072,7 @@ SongList LibraryBackend::GetCompilationSongs(const QString& album,
   query.AddCompilationRequirement(true);
   query.AddWhere("album", album);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   if (!ExecQuery(&query)) return SongList();
 
   SongList ret;
@@ -709,7 +1085,7 @@ SongList LibraryBackend::GetCompilationSongs(const QString& album,
 }
 
 void LibraryBackend::UpdateCompilations() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   // Look for albums that have songs by more than one 'effective album artist'
@@ -841,7 +1217,7 @@ LibraryBackend::AlbumList LibraryBackend::GetAlbums(const QString& artist,
     query.AddWhere("artist", artist);
   }
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   if (!ExecQuery(&query)) return ret;
 
   QString last_album;
@@ -878,7 +1254,7 @@ LibraryBackend::Album LibraryBackend::GetAlbumArt(const QString& artist,
   query.AddWhere("artist", artist);
   query.AddWhere("album", album);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   if (!ExecQuery(&query)) return ret;
 
   if (query.Next()) {
@@ -901,7 +1277,7 @@ void LibraryBackend::UpdateManualAlbumArtAsync(const QString& artist,
 void LibraryBackend::UpdateManualAlbumArt(const QString& artist,
                                           const QString& album,
                                           const QString& art) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   // Get the songs before they're updated
@@ -952,7 +1328,7 @@ void LibraryBackend::UpdateManualAlbumArt(const QString& artist,
 
 void LibraryBackend::ForceCompilation(const QString& album,
                                       const QList<QString>& artists, bool on) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
   SongList deleted_songs, added_songs;
 
@@ -1007,15 +1383,16 @@ void LibraryBackend::ForceCompilation(const QString& album,
 }
 
 bool LibraryBackend::ExecQuery(LibraryQuery* q) {
+  if (index_.Exec(q)) return true;
   return !db_->CheckErrors(q->Exec(db_->Connect(), songs_table_, fts_table_));
 }
 
 SongList LibraryBackend::FindSongs(const smart_playlists::Search& search) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
   // Build the query
-  QString sql = search.ToSql(songs_table());
+  QString sql = search.ToSql(songs_table(), fts_table_);
 
   // Run the query
   SongList ret;
@@ -1043,16 +1420,16 @@ SongList LibraryBackend::GetAllSongs() {
 void LibraryBackend::IncrementPlayCount(int id) {
   if (id == -1) return;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery q(QString(
-                  "UPDATE %1 SET playcount = playcount + 1,"
-                  "              lastplayed = :now,"
-                  "              score = " +
-                  QString(kNewScoreSql).arg("1.0") +
-                  " WHERE ROWID = :id").arg(songs_table_),
-              db);
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("UPDATE %1 SET playcount = playcount + 1,"
+              "              lastplayed = :now,"
+              "              score = " +
+              QString(kNewScoreSql).arg("1.0") +
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
   q.bindValue(":now", QDateTime::currentDateTime().toTime_t());
   q.bindValue(":id", id);
   q.exec();
@@ -1066,15 +1443,16 @@ void LibraryBackend::IncrementSkipCount(int id, float progress) {
   if (id == -1) return;
   progress = qBound(0.0f, progress, 1.0f);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery q(QString(
-                  "UPDATE %1 SET skipcount = skipcount + 1,"
-                  "              score = " +
-                  QString(kNewScoreSql).arg(progress) +
-                  " WHERE ROWID = :id").arg(songs_table_),
-              db);
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("UPDATE %1 SET skipcount = skipcount + 1,"
+              "              score = " +
+              QString(kNewScoreSql).arg(":progress") +
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
+  q.bindValue(":progress", progress);
   q.bindValue(":id", id);
   q.exec();
   if (db_->CheckErrors(q)) return;
@@ -1086,14 +1464,14 @@ void LibraryBackend::IncrementSkipCount(int id, float progress) {
 void LibraryBackend::ResetStatistics(int id) {
   if (id == -1) return;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery q(QString(
-                  "UPDATE %1 SET playcount = 0, skipcount = 0,"
-                  "              lastplayed = -1, score = 0"
-                  " WHERE ROWID = :id").arg(songs_table_),
-              db);
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("UPDATE %1 SET playcount = 0, skipcount = 0,"
+              "              lastplayed = -1, score = 0"
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
   q.bindValue(":id", id);
   q.exec();
   if (db_->CheckErrors(q)) return;
@@ -1105,13 +1483,13 @@ void LibraryBackend::ResetStatistics(int id) {
 void LibraryBackend::UpdateSongRating(int id, float rating) {
   if (id == -1) return;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), songs_table_);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery q(QString(
-                  "UPDATE %1 SET rating = :rating"
-                  " WHERE ROWID = :id").arg(songs_table_),
-              db);
+  Database::PreparedQuery q(db_->CachedQuery(
+      QString("UPDATE %1 SET rating = :rating"
+              " WHERE ROWID = :id").arg(songs_table_),
+      db));
   q.bindValue(":rating", rating);
   q.bindValue(":id", id);
   q.exec();
@@ -1123,7 +1501,7 @@ void LibraryBackend::UpdateSongRating(int id, float rating) {
 
 void LibraryBackend::DeleteAll() {
   {
-    QMutexLocker l(db_->Mutex());
+    Database::Locker l(db_->Mutex(), songs_table_);
     QSqlDatabase db(db_->Connect());
     ScopedTransaction t(&db);
 
@@ -1138,6 +1516,7 @@ void LibraryBackend::DeleteAll() {
     t.Commit();
   }
 
+  index_.Clear();
   emit DatabaseReset();
 }
 
@@ -1184,4 +1563,35 @@ void LibraryBackend::ReloadSettings() {
     // Save old value
     save_ratings_in_file_ = save_ratings_in_file;
   }
+
+  // In-memory index
+  {
+    bool in_memory_index = s.value("in_memory_index", false).toBool();
+    if (in_memory_index != index_.is_loaded()) {
+      // Loading it reads the whole songs table, so do that on the database
+      // thread.
+      QMetaObject::invokeMethod(this, "EnableIndex", Qt::QueuedConnection,
+                                Q_ARG(bool, in_memory_index));
+    }
+  }
+}
+
+void LibraryBackend::EnableIndex(bool enabled) {
+  if (!enabled) {
+    index_.Unload();
+    return;
+  }
+  if (index_.is_loaded()) return;
+
+  Database::Locker l(db_->ReadMutex(), songs_table_);
+  QSqlDatabase db(db_->Connect());
+  index_.Load(db, songs_table_);
+}
+
+void LibraryBackend::IndexSongsDiscovered(const SongList& songs) {
+  index_.AddOrUpdate(songs);
+}
+
+void LibraryBackend::IndexSongsDeleted(const SongList& songs) {
+  index_.Remove(songs);
 }
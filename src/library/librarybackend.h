@@ -18,11 +18,13 @@
 #ifndef LIBRARYBACKEND_H
 #define LIBRARYBACKEND_H
 
+#include <QHash>
 #include <QObject>
 #include <QSet>
 #include <QUrl>
 
 #include "directory.h"
+#include "libraryindex.h"
 #include "libraryquery.h"
 #include "core/song.h"
 
@@ -123,9 +125,11 @@ class LibraryBackend : public LibraryBackendInterface {
 
   Q_INVOKABLE LibraryBackend(QObject* parent = nullptr);
   void Init(Database* db, const QString& songs_table, const QString& dirs_table,
-            const QString& subdirs_table, const QString& fts_table);
+            const QString& subdirs_table, const QString& fts_table,
+            const QString& full_scan_progress_table = QString());
 
   Database* db() const { return db_; }
+  LibraryIndex* index() { return &index_; }
 
   QString songs_table() const { return songs_table_; }
   QString dirs_table() const { return dirs_table_; }
@@ -172,9 +176,25 @@ class LibraryBackend : public LibraryBackendInterface {
   SongList GetSongsByUrl(const QUrl& url);
   Song GetSongByUrl(const QUrl& url, qint64 beginning = 0);
 
+  // Returns every song, including unavailable ones, whose file has this size
+  // and modification time.  Used to find files that have been moved.
+  SongList GetSongsBySizeAndMTime(int filesize, uint mtime);
+
   void AddDirectory(const QString& path);
   void RemoveDirectory(const Directory& dir);
 
+  // Returns true if a full scan of this directory was started but never
+  // finished, and fills finished_subdirs with the subdirectories it had got
+  // through.
+  bool GetFullScanProgress(int directory,
+                           QStringList* finished_subdirs = nullptr);
+  // Only backends with a full scan progress table can resume full scans.
+  bool can_resume_full_scans() const {
+    return !full_scan_progress_table_.isEmpty();
+  }
+
+  // Answers the query from the in-memory index if it's loaded and can,
+  // otherwise runs it on the database.
   bool ExecQuery(LibraryQuery* q);
   SongList ExecLibraryQuery(LibraryQuery* query);
   SongList FindSongs(const smart_playlists::Search& search);
@@ -194,10 +214,18 @@ class LibraryBackend : public LibraryBackendInterface {
   void UpdateTotalSongCount();
   void AddOrUpdateSongs(const SongList& songs);
   void UpdateMTimesOnly(const SongList& songs);
+  // Updates the location of songs whose files were moved, without touching
+  // their tags or statistics.  Songs whose rows have already been deleted are
+  // added again.
+  void MoveSongs(const SongList& songs);
   void DeleteSongs(const SongList& songs);
   void MarkSongsUnavailable(const SongList& songs, bool unavailable = true);
   void AddOrUpdateSubdirs(const SubdirectoryList& subdirs);
   void UpdateCompilations();
+  // Records that a full scan of this directory is in progress, and that it's
+  // finished these subdirectories.
+  void AddFullScanProgress(int directory, const QStringList& finished_subdirs);
+  void ClearFullScanProgress(int directory);
   void UpdateManualAlbumArt(const QString& artist, const QString& album,
                             const QString& art);
   void ForceCompilation(const QString& album, const QList<QString>& artists,
@@ -207,6 +235,9 @@ class LibraryBackend : public LibraryBackendInterface {
   void ResetStatistics(int id);
   void UpdateSongRating(int id, float rating);
   void ReloadSettings();
+  // Keeps a copy of the columns the library is browsed by in memory, see
+  // LibraryIndex.  Loading it reads the whole songs table.
+  void EnableIndex(bool enabled);
 
 signals:
   void DirectoryDiscovered(const Directory& dir,
@@ -221,6 +252,10 @@ signals:
 
   void TotalSongCountUpdated(int total);
 
+ private slots:
+  void IndexSongsDiscovered(const SongList& songs);
+  void IndexSongsDeleted(const SongList& songs);
+
  private:
   struct CompilationInfo {
     CompilationInfo() : has_samplers(false), has_not_samplers(false) {}
@@ -234,6 +269,18 @@ signals:
 
   static const char* kNewScoreSql;
 
+  // AddOrUpdateSongs writes batches at least this big with multi-row INSERTs
+  // and updates the FTS index once at the end, instead of a row at a time.
+  static const int kBulkInsertThreshold;
+  static const int kMaxBoundValues;
+  static const int kFtsRebuildBatchSize;
+
+  void AddOrUpdateSongsInBulk(const SongList& songs);
+  // Replaces the FTS rows of these songs with their current values.
+  void RebuildFtsRows(const QStringList& ids, QSqlDatabase& db);
+  // Remembers the answer in cache, so it's only looked up once per batch.
+  bool DirectoryExists(int id, QHash<int, bool>* cache, QSqlDatabase& db);
+
   void UpdateCompilations(QSqlQuery& find_songs, QSqlQuery& update,
                           SongList& deleted_songs, SongList& added_songs,
                           const QString& album, int sampler);
@@ -250,8 +297,12 @@ signals:
   QString dirs_table_;
   QString subdirs_table_;
   QString fts_table_;
+  // Empty if this library doesn't keep track of full scans.
+  QString full_scan_progress_table_;
   bool save_statistics_in_file_;
   bool save_ratings_in_file_;
+
+  LibraryIndex index_;
 };
 
 #endif  // LIBRARYBACKEND_H
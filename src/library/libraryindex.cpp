@@ -0,0 +1,478 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libraryindex.h"
+
+#include <QMap>
+#include <QPair>
+#include <QReadLocker>
+#include <QRegExp>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+#include "core/database.h"
+#include "core/logging.h"
+
+const char* LibraryIndex::kColumnNames[] = {
+    "title",    "album",     "artist",   "albumartist",
+    "composer", "performer", "grouping", "genre",
+    "comment",  "effective_albumartist", "year",
+    "bitrate",  "filetype",  "ctime",    "effective_compilation"};
+const int LibraryIndex::kFtsColumnCount = LibraryIndex::Column_Comment + 1;
+const int LibraryIndex::kFirstIntColumn = LibraryIndex::Column_Year;
+
+LibraryIndex::LibraryIndex() : loaded_(false) {}
+
+bool LibraryIndex::is_loaded() const {
+  QReadLocker l(&lock_);
+  return loaded_;
+}
+
+int LibraryIndex::song_count() const {
+  QReadLocker l(&lock_);
+  return data_.ids_.count();
+}
+
+int LibraryIndex::ColumnForName(const QString& name) {
+  // Ignore the table name if there is one.
+  const QString column = name.section('.', -1, -1);
+  for (int i = 0; i < ColumnCount; ++i) {
+    if (column == kColumnNames[i]) return i;
+  }
+  return -1;
+}
+
+int LibraryIndex::FtsColumnForName(const QString& name) {
+  if (!name.startsWith("fts")) return -1;
+
+  const int column = ColumnForName(name.mid(3));
+  return column < kFtsColumnCount ? column : -1;
+}
+
+bool LibraryIndex::ParseColumnSpec(const QString& spec, QList<int>* columns) {
+  QRegExp re("DISTINCT\\s+(\\w+)(\\s*,\\s*(\\w+))?", Qt::CaseInsensitive);
+  if (!re.exactMatch(spec.trimmed())) return false;
+
+  columns->clear();
+  *columns << ColumnForName(re.cap(1));
+  if (!re.cap(3).isEmpty()) *columns << ColumnForName(re.cap(3));
+
+  return !columns->contains(-1);
+}
+
+bool LibraryIndex::ContainsWord(const QByteArray& folded,
+                                const QByteArray& word) {
+  // The folded text is the tokens separated by single spaces, so this is a
+  // prefix match on one of the tokens.  The word might be several tokens
+  // itself if it had punctuation in it, which FTS treats as a phrase.
+  int pos = folded.indexOf(word);
+  while (pos != -1) {
+    if (pos == 0 || folded[pos - 1] == ' ') return true;
+    pos = folded.indexOf(word, pos + 1);
+  }
+  return false;
+}
+
+QVariant LibraryIndex::SongValue(const Song& song, int column) {
+  switch (column) {
+    case Column_Title:
+      return song.title();
+    case Column_Album:
+      return song.album();
+    case Column_Artist:
+      return song.artist();
+    case Column_AlbumArtist:
+      return song.albumartist();
+    case Column_Composer:
+      return song.composer();
+    case Column_Performer:
+      return song.performer();
+    case Column_Grouping:
+      return song.grouping();
+    case Column_Genre:
+      return song.genre();
+    case Column_Comment:
+      return song.comment();
+    case Column_EffectiveAlbumArtist:
+      return song.effective_albumartist();
+    case Column_Year:
+      return song.year();
+    case Column_Bitrate:
+      return song.bitrate();
+    case Column_FileType:
+      return int(song.filetype());
+    case Column_CTime:
+      return song.ctime();
+    case Column_Compilation:
+      return song.is_compilation() ? 1 : 0;
+  }
+  return QVariant();
+}
+
+int LibraryIndex::IntValue(const QVariant& value, int column, bool* ok) {
+  // ctime is unsigned, so it's stored as the same bits in an int.
+  if (column == Column_CTime) return int(value.toUInt(ok));
+  return value.toInt(ok);
+}
+
+int LibraryIndex::CodeForValue(Data* data, const QString& value) {
+  QHash<QString, int>::const_iterator it = data->codes_.constFind(value);
+  if (it != data->codes_.constEnd()) return it.value();
+
+  const int code = data->values_.count();
+  data->values_ << value;
+  data->folded_ << Database::FoldText(value);
+  data->codes_.insert(value, code);
+  return code;
+}
+
+int LibraryIndex::AppendRow(Data* data, int id) {
+  data->ids_ << id;
+  for (int column = 0; column < ColumnCount; ++column) {
+    data->columns_[column] << 0;
+  }
+  return data->ids_.count() - 1;
+}
+
+void LibraryIndex::SetRow(Data* data, int row, const Song& song) {
+  for (int column = 0; column < ColumnCount; ++column) {
+    const QVariant value = SongValue(song, column);
+    data->columns_[column][row] = column < kFirstIntColumn
+                                      ? CodeForValue(data, value.toString())
+                                      : IntValue(value, column);
+  }
+}
+
+void LibraryIndex::SortRows(Data* data) {
+  const int count = data->ids_.count();
+  QVector<int> order(count);
+  for (int i = 0; i < count; ++i) order[i] = i;
+
+  const QVector<int>& ids = data->ids_;
+  std::sort(order.begin(), order.end(),
+            [&ids](int a, int b) { return ids[a] < ids[b]; });
+
+  QVector<int> sorted(count);
+  for (int i = 0; i < count; ++i) sorted[i] = data->ids_[order[i]];
+  data->ids_ = sorted;
+
+  for (int column = 0; column < ColumnCount; ++column) {
+    const QVector<int>& values = data->columns_[column];
+    for (int i = 0; i < count; ++i) sorted[i] = values[order[i]];
+    data->columns_[column] = sorted;
+  }
+}
+
+void LibraryIndex::RemoveRows(Data* data, const QSet<int>& ids) {
+  const int count = data->ids_.count();
+
+  int out = 0;
+  for (int row = 0; row < count; ++row) {
+    if (ids.contains(data->ids_[row])) continue;
+
+    if (out != row) {
+      data->ids_[out] = data->ids_[row];
+      for (int column = 0; column < ColumnCount; ++column) {
+        data->columns_[column][out] = data->columns_[column][row];
+      }
+    }
+    out++;
+  }
+
+  data->ids_.resize(out);
+  for (int column = 0; column < ColumnCount; ++column) {
+    data->columns_[column].resize(out);
+  }
+}
+
+void LibraryIndex::Load(QSqlDatabase& db, const QString& songs_table) {
+  QStringList columns;
+  for (int column = 0; column < ColumnCount; ++column) {
+    columns << kColumnNames[column];
+  }
+
+  QSqlQuery q(db);
+  q.setForwardOnly(true);
+  q.prepare(QString("SELECT ROWID, %1 FROM %2"
+                    " WHERE unavailable = 0 ORDER BY ROWID")
+                .arg(columns.join(", "), songs_table));
+  if (!q.exec()) {
+    qLog(Error) << "Couldn't load the library index:" << q.lastError();
+    return;
+  }
+
+  // Build it without the lock held, so queries can still be answered from
+  // the old one in the meantime.
+  Data data;
+  while (q.next()) {
+    const int row = AppendRow(&data, q.value(0).toInt());
+    for (int column = 0; column < ColumnCount; ++column) {
+      const QVariant value = q.value(column + 1);
+      data.columns_[column][row] = column < kFirstIntColumn
+                                       ? CodeForValue(&data, value.toString())
+                                       : IntValue(value, column);
+    }
+  }
+
+  qLog(Debug) << "Loaded" << data.ids_.count() << "songs and"
+              << data.values_.count() << "distinct values from" << songs_table;
+
+  QWriteLocker l(&lock_);
+  data_ = data;
+  loaded_ = true;
+}
+
+void LibraryIndex::Unload() {
+  QWriteLocker l(&lock_);
+  data_ = Data();
+  loaded_ = false;
+}
+
+void LibraryIndex::Clear() {
+  QWriteLocker l(&lock_);
+  data_ = Data();
+}
+
+void LibraryIndex::AddOrUpdate(const SongList& songs) {
+  QWriteLocker l(&lock_);
+  if (!loaded_) return;
+
+  QSet<int> removed;
+  QMap<int, Song> added;
+  for (const Song& song : songs) {
+    if (song.id() == -1) continue;
+
+    if (song.is_unavailable()) {
+      removed << song.id();
+      continue;
+    }
+
+    QVector<int>::const_iterator it =
+        std::lower_bound(data_.ids_.constBegin(), data_.ids_.constEnd(),
+                         song.id());
+    if (it != data_.ids_.constEnd() && *it == song.id()) {
+      SetRow(&data_, it - data_.ids_.constBegin(), song);
+    } else {
+      added[song.id()] = song;
+    }
+  }
+
+  // New songs usually have the largest ROWIDs, so they can go on the end
+  // without sorting everything again.
+  const bool needs_sort = !added.isEmpty() && !data_.ids_.isEmpty() &&
+                          added.firstKey() < data_.ids_.last();
+  for (const Song& song : added) {
+    SetRow(&data_, AppendRow(&data_, song.id()), song);
+  }
+  if (needs_sort) SortRows(&data_);
+
+  if (!removed.isEmpty()) RemoveRows(&data_, removed);
+}
+
+void LibraryIndex::Remove(const SongList& songs) {
+  QSet<int> ids;
+  for (const Song& song : songs) ids << song.id();
+
+  QWriteLocker l(&lock_);
+  RemoveRows(&data_, ids);
+}
+
+bool LibraryIndex::Exec(LibraryQuery* query) const {
+  QReadLocker l(&lock_);
+  if (!loaded_) return false;
+
+  QList<int> columns;
+  if (query->include_unavailable_ || !query->order_by_.isEmpty() ||
+      !ParseColumnSpec(query->column_spec_, &columns)) {
+    return false;
+  }
+
+  const int count = data_.ids_.count();
+  QVector<char> selected(count, 1);
+
+  for (const LibraryQuery::Condition& condition : query->conditions_) {
+    if (!ApplyCondition(data_, condition, &selected)) return false;
+  }
+  for (const LibraryQuery::FilterTerm& term : query->filter_terms_) {
+    if (!ApplyFilterTerm(data_, term, &selected)) return false;
+  }
+  if (query->duplicates_only_) ApplyDuplicates(data_, &selected);
+  if (query->untagged_only_) ApplyUntagged(data_, &selected);
+
+  // Pick out the distinct values in the order they first appear.
+  const QVector<int>& first = data_.columns_[columns[0]];
+  const QVector<int>* second =
+      columns.count() > 1 ? &data_.columns_[columns[1]] : nullptr;
+  const int limit = query->limit_;
+
+  QSet<QPair<int, int> > seen;
+  QList<QVariantList> rows;
+  for (int row = 0; row < count; ++row) {
+    if (!selected[row]) continue;
+    if (limit != -1 && rows.count() >= limit) break;
+
+    const QPair<int, int> key(first[row], second ? (*second)[row] : 0);
+    if (seen.contains(key)) continue;
+    seen.insert(key);
+
+    QVariantList values;
+    for (int column : columns) values << Value(data_, column, row);
+    rows << values;
+  }
+
+  query->from_index_ = true;
+  query->index_rows_ = rows;
+  query->index_row_ = -1;
+  return true;
+}
+
+bool LibraryIndex::ApplyCondition(const Data& data,
+                                  const LibraryQuery::Condition& condition,
+                                  QVector<char>* selected) {
+  const int column = ColumnForName(condition.column_);
+  if (column == -1) return false;
+
+  int target = -1;
+  if (column < kFirstIntColumn) {
+    // A value that isn't in the dictionary isn't in any of the songs.
+    target = data.codes_.value(condition.value_.toString(), -1);
+  } else {
+    bool ok = false;
+    target = IntValue(condition.value_, column, &ok);
+    if (!ok) return false;
+  }
+
+  const int count = data.ids_.count();
+  const int* values = data.columns_[column].constData();
+  char* out = selected->data();
+
+  if (condition.op_ == "=") {
+    for (int i = 0; i < count; ++i) out[i] &= values[i] == target;
+  } else if (condition.op_ == "!=") {
+    for (int i = 0; i < count; ++i) out[i] &= values[i] != target;
+  } else if (condition.op_ == ">" && column == Column_CTime) {
+    for (int i = 0; i < count; ++i) out[i] &= uint(values[i]) > uint(target);
+  } else if (condition.op_ == ">" && column >= kFirstIntColumn) {
+    for (int i = 0; i < count; ++i) out[i] &= values[i] > target;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool LibraryIndex::ApplyFilterTerm(const Data& data,
+                                   const LibraryQuery::FilterTerm& term,
+                                   QVector<char>* selected) {
+  int first_column = 0;
+  int last_column = kFtsColumnCount - 1;
+  if (!term.column_.isEmpty()) {
+    first_column = last_column = FtsColumnForName(term.column_);
+    if (first_column == -1) return false;
+  }
+
+  const QByteArray word = Database::FoldText(term.word_);
+  if (word.isEmpty()) return true;
+
+  // Find the distinct values that contain the word first, then the songs
+  // that have any of those values.
+  const int value_count = data.values_.count();
+  QVector<char> matching_values(value_count);
+  for (int i = 0; i < value_count; ++i) {
+    matching_values[i] = ContainsWord(data.folded_[i], word);
+  }
+
+  const int count = data.ids_.count();
+  const char* matching = matching_values.constData();
+  QVector<char> matching_rows(count, 0);
+  char* hit = matching_rows.data();
+  for (int column = first_column; column <= last_column; ++column) {
+    const int* values = data.columns_[column].constData();
+    for (int i = 0; i < count; ++i) hit[i] |= matching[values[i]];
+  }
+
+  char* out = selected->data();
+  for (int i = 0; i < count; ++i) out[i] &= hit[i];
+  return true;
+}
+
+void LibraryIndex::ApplyDuplicates(const Data& data, QVector<char>* selected) {
+  // The same as the duplicated_songs view - songs with the same artist, album
+  // and title as another one, as long as none of them are empty.
+  typedef QPair<int, QPair<int, int> > Key;
+
+  const int empty = data.codes_.value(QString(), -1);
+  const int count = data.ids_.count();
+  const int* artists = data.columns_[Column_Artist].constData();
+  const int* albums = data.columns_[Column_Album].constData();
+  const int* titles = data.columns_[Column_Title].constData();
+
+  QHash<Key, int> counts;
+  for (int i = 0; i < count; ++i) {
+    if (artists[i] == empty || albums[i] == empty || titles[i] == empty) {
+      continue;
+    }
+    counts[Key(artists[i], qMakePair(albums[i], titles[i]))]++;
+  }
+
+  char* out = selected->data();
+  for (int i = 0; i < count; ++i) {
+    if (!out[i]) continue;
+    out[i] = counts.value(Key(artists[i], qMakePair(albums[i], titles[i]))) > 1;
+  }
+}
+
+void LibraryIndex::ApplyUntagged(const Data& data, QVector<char>* selected) {
+  const int empty = data.codes_.value(QString(), -1);
+  const int count = data.ids_.count();
+  const int* artists = data.columns_[Column_Artist].constData();
+  const int* albums = data.columns_[Column_Album].constData();
+  const int* titles = data.columns_[Column_Title].constData();
+
+  char* out = selected->data();
+  for (int i = 0; i < count; ++i) {
+    out[i] &= artists[i] == empty || albums[i] == empty || titles[i] == empty;
+  }
+}
+
+QVariant LibraryIndex::Value(const Data& data, int column, int row) {
+  const int value = data.columns_[column][row];
+  if (column < kFirstIntColumn) return data.values_[value];
+  if (column == Column_CTime) return uint(value);
+  return value;
+}
+
+bool LibraryIndex::Matches(const Song& song,
+                           const LibraryQuery::FilterTerm& term) {
+  int first_column = 0;
+  int last_column = kFtsColumnCount - 1;
+  if (!term.column_.isEmpty()) {
+    first_column = last_column = FtsColumnForName(term.column_);
+    if (first_column == -1) return false;
+  }
+
+  const QByteArray word = Database::FoldText(term.word_);
+  if (word.isEmpty()) return true;
+
+  for (int column = first_column; column <= last_column; ++column) {
+    const QString value = SongValue(song, column).toString();
+    if (ContainsWord(Database::FoldText(value), word)) return true;
+  }
+  return false;
+}
@@ -0,0 +1,148 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBRARYINDEX_H
+#define LIBRARYINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include "libraryquery.h"
+#include "core/song.h"
+
+class QSqlDatabase;
+
+// A copy of the columns of the songs table that the library is grouped and
+// filtered by, kept in memory so browsing doesn't have to run a query every
+// time an item is expanded or the filter changes.
+//
+// Each column is a vector with an entry for every available song, in order of
+// ROWID.  Text columns hold indexes into a dictionary of the distinct values,
+// so grouping only compares integers and the filter text is matched against
+// each distinct value once instead of once per song.
+//
+// LibraryBackend keeps it up to date and uses it to answer the DISTINCT
+// queries that LibraryModel runs to fill in the tree.  Everything else still
+// goes to SQLite.  All the functions are thread-safe.
+class LibraryIndex {
+ public:
+  LibraryIndex();
+
+  enum Column {
+    // Text columns.  The first ones are in the same order as
+    // Song::kFtsColumns.
+    Column_Title = 0,
+    Column_Album,
+    Column_Artist,
+    Column_AlbumArtist,
+    Column_Composer,
+    Column_Performer,
+    Column_Grouping,
+    Column_Genre,
+    Column_Comment,
+    Column_EffectiveAlbumArtist,
+
+    // Integer columns.
+    Column_Year,
+    Column_Bitrate,
+    Column_FileType,
+    Column_CTime,
+    Column_Compilation,
+
+    ColumnCount
+  };
+
+  static const char* kColumnNames[];
+  static const int kFtsColumnCount;
+  static const int kFirstIntColumn;
+
+  // False until Load() is called.  Queries aren't answered until then.
+  bool is_loaded() const;
+  int song_count() const;
+
+  // Reads every available song in the table, replacing whatever was there.
+  void Load(QSqlDatabase& db, const QString& songs_table);
+  // Forgets all the songs and stops answering queries.
+  void Unload();
+  // Forgets all the songs but carries on answering queries.
+  void Clear();
+
+  // Unavailable songs are removed instead.
+  void AddOrUpdate(const SongList& songs);
+  void Remove(const SongList& songs);
+
+  // Runs the query against the index if it can, in which case its results
+  // are read with LibraryQuery::Next() and Value() as usual.  Returns false if
+  // the index isn't loaded or the query needs something it doesn't have,
+  // like columns it doesn't keep, an ORDER BY or unavailable songs.
+  bool Exec(LibraryQuery* query) const;
+
+  // Whether the song contains the filter word, in the same way that SQLite's
+  // FTS would find it.
+  static bool Matches(const Song& song, const LibraryQuery::FilterTerm& term);
+
+ private:
+  struct Data {
+    // Sorted.
+    QVector<int> ids_;
+    QVector<int> columns_[ColumnCount];
+
+    // The distinct text values, and what they look like to the FTS
+    // tokenizer.  Values are never removed until the index is loaded again.
+    QStringList values_;
+    QList<QByteArray> folded_;
+    QHash<QString, int> codes_;
+  };
+
+  static int ColumnForName(const QString& name);
+  static int FtsColumnForName(const QString& name);
+  static bool ParseColumnSpec(const QString& spec, QList<int>* columns);
+  static bool ContainsWord(const QByteArray& folded, const QByteArray& word);
+
+  static QVariant SongValue(const Song& song, int column);
+  static int IntValue(const QVariant& value, int column, bool* ok = nullptr);
+
+  static int CodeForValue(Data* data, const QString& value);
+  static int AppendRow(Data* data, int id);
+  static void SetRow(Data* data, int row, const Song& song);
+  static void SortRows(Data* data);
+  static void RemoveRows(Data* data, const QSet<int>& ids);
+
+  // Each of these clears the entries in selected for the songs that don't
+  // match.
+  static bool ApplyCondition(const Data& data,
+                             const LibraryQuery::Condition& condition,
+                             QVector<char>* selected);
+  static bool ApplyFilterTerm(const Data& data,
+                              const LibraryQuery::FilterTerm& term,
+                              QVector<char>* selected);
+  static void ApplyDuplicates(const Data& data, QVector<char>* selected);
+  static void ApplyUntagged(const Data& data, QVector<char>* selected);
+
+  static QVariant Value(const Data& data, int column, int row);
+
+  mutable QReadWriteLock lock_;
+  bool loaded_;
+  Data data_;
+};
+
+#endif  // LIBRARYINDEX_H
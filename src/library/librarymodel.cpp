@@ -58,9 +58,12 @@ const char* LibraryModel::kSmartPlaylistsSettingsGroup =
     "SerialisedSmartPlaylists";
 const int LibraryModel::kSmartPlaylistsVersion = 4;
 const int LibraryModel::kPrettyCoverSize = 32;
+const int LibraryModel::kLazyPopulateWaitMsec = 50;
+const int LibraryModel::kMaxFilterSongs = 5000;
 
-typedef QFuture<LibraryModel::QueryResult> RootQueryFuture;
 typedef QFutureWatcher<LibraryModel::QueryResult> RootQueryWatcher;
+typedef QFuture<LibraryModel::QueryResult> ChildQueryFuture;
+typedef QFutureWatcher<LibraryModel::QueryResult> ChildQueryWatcher;
 
 static bool IsArtistGroupBy(const LibraryModel::GroupBy by) {
   return by == LibraryModel::GroupBy_Artist ||
@@ -85,6 +88,9 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
       playlists_dir_icon_(IconLoader::Load("folder-sound")),
       playlist_icon_(":/icons/22x22/x-clementine-albums.png"),
       init_task_id_(-1),
+      reset_pending_(false),
+      filter_songs_valid_(false),
+      lazy_populate_wait_msec_(-1),
       use_pretty_covers_(false),
       show_dividers_(true) {
   root_->lazy_loaded = true;
@@ -96,9 +102,12 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
   cover_loader_options_.desired_height_ = kPrettyCoverSize;
   cover_loader_options_.pad_output_image_ = true;
   cover_loader_options_.scale_output_image_ = true;
+  cover_loader_options_.use_thumbnail_cache_ = true;
 
-  connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
-          SLOT(AlbumArtLoaded(quint64, QImage)));
+  if (app_) {
+    connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
+            SLOT(AlbumArtLoaded(quint64, QImage)));
+  }
 
   no_cover_icon_ = QPixmap(":nocover.png")
                        .scaled(kPrettyCoverSize, kPrettyCoverSize,
@@ -119,7 +128,18 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
   backend_->UpdateTotalSongCountAsync();
 }
 
-LibraryModel::~LibraryModel() { delete root_; }
+LibraryModel::~LibraryModel() {
+  // The queries use this object, so let them finish.
+  QList<PendingPopulate> pending = pending_populates_.values();
+  CancelLazyPopulates();
+  for (const PendingPopulate& p : pending) {
+    p.future_.waitForFinished();
+  }
+  CancelResetAsync();
+  pending_reset_.future_.waitForFinished();
+
+  delete root_;
+}
 
 void LibraryModel::set_pretty_covers(bool use_pretty_covers) {
   if (use_pretty_covers != use_pretty_covers_) {
@@ -136,6 +156,8 @@ void LibraryModel::set_show_dividers(bool show_dividers) {
 }
 
 void LibraryModel::Init(bool async) {
+  lazy_populate_wait_msec_ = async ? kLazyPopulateWaitMsec : -1;
+
   if (async) {
     // Show a loading indicator in the model.
     LibraryItem* loading =
@@ -154,11 +176,42 @@ void LibraryModel::Init(bool async) {
 }
 
 void LibraryModel::SongsDiscovered(const SongList& songs) {
+  // Sanity check to make sure we don't add songs that are outside the user's
+  // filter
+  SongList matching;
   for (const Song& song : songs) {
-    // Sanity check to make sure we don't add songs that are outside the user's
-    // filter
-    if (!query_options_.Matches(song)) continue;
+    const bool matches = query_options_.Matches(song);
+    if (matches) matching << song;
+
+    // Keep the songs that match the filter up to date, so they're still right
+    // when the filter is refined later.
+    if (filter_songs_valid_) {
+      if (matches) {
+        filter_songs_[song.id()] = song;
+      } else {
+        filter_songs_.remove(song.id());
+      }
+    }
+  }
 
+  AddSongs(matching, true);
+}
+
+void LibraryModel::AddSongs(const SongList& songs, bool signal) {
+  // Work out where every song goes before touching the model, so that each
+  // parent gets all its new children in a single beginInsertRows.  Views only
+  // relayout once for each parent, and nothing is reset, so items the user
+  // expanded stay expanded.
+  QList<LibraryItem*> parents;
+  QHash<LibraryItem*, QList<LibraryItem*> > new_children;
+
+  auto add_child = [&](LibraryItem* parent, LibraryItem* child) {
+    QList<LibraryItem*>& children = new_children[parent];
+    if (children.isEmpty()) parents << parent;
+    children << child;
+  };
+
+  for (const Song& song : songs) {
     // Hey, we've already got that one!
     if (song_nodes_.contains(song.id())) continue;
 
@@ -177,59 +230,27 @@ void LibraryModel::SongsDiscovered(const SongList& songs) {
       // Special case: if the song is a compilation and the current GroupBy
       // level is Artists, then we want the Various Artists node :(
       if (IsArtistGroupBy(type) && song.is_compilation()) {
-        if (container->compilation_artist_node_ == nullptr)
-          CreateCompilationArtistNode(true, container);
+        if (container->compilation_artist_node_ == nullptr) {
+          container->compilation_artist_node_ =
+              NewCompilationArtistNode(container);
+          add_child(container, container->compilation_artist_node_);
+        }
         container = container->compilation_artist_node_;
       } else {
         // Otherwise find the proper container at this level based on the
-        // item's key
-        QString key;
-        switch (type) {
-          case GroupBy_Album:
-            key = song.album();
-            break;
-          case GroupBy_Artist:
-            key = song.artist();
-            break;
-          case GroupBy_Composer:
-            key = song.composer();
-            break;
-          case GroupBy_Performer:
-            key = song.performer();
-            break;
-          case GroupBy_Grouping:
-            key = song.grouping();
-            break;
-          case GroupBy_Genre:
-            key = song.genre();
-            break;
-          case GroupBy_AlbumArtist:
-            key = song.effective_albumartist();
-            break;
-          case GroupBy_Year:
-            key = QString::number(qMax(0, song.year()));
-            break;
-          case GroupBy_YearAlbum:
-            key = PrettyYearAlbum(qMax(0, song.year()), song.album());
-            break;
-          case GroupBy_FileType:
-            key = song.filetype();
-            break;
-          case GroupBy_Bitrate:
-            key = song.bitrate();
-            break;
-          case GroupBy_None:
-            qLog(Error) << "GroupBy_None";
-            break;
-        }
-
-        // Does it exist already?
-        if (!container_nodes_[i].contains(key)) {
-          // Create the container
-          container_nodes_[i][key] =
-              ItemFromSong(type, true, i == 0, container, song, i);
+        // item's key, creating it if it doesn't exist yet.
+        const ContainerNodeKey key(container, ContainerKey(type, song));
+        LibraryItem* child = container_nodes_[i].value(key);
+        if (!child) {
+          child = ItemFromSong(type, song, i);
+          if (i == 0) {
+            LibraryItem* divider = DividerForItem(type, child);
+            if (divider) add_child(root_, divider);
+          }
+          container_nodes_[i][key] = child;
+          add_child(container, child);
         }
-        container = container_nodes_[i][key];
+        container = child;
       }
 
       // If we just created the damn thing then we don't need to continue into
@@ -241,11 +262,59 @@ void LibraryModel::SongsDiscovered(const SongList& songs) {
 
     // We've gone all the way down to the deepest level and everything was
     // already lazy loaded, so now we have to create the song in the container.
-    song_nodes_[song.id()] =
-        ItemFromSong(GroupBy_None, true, false, container, song, -1);
+    LibraryItem* item = ItemFromSong(GroupBy_None, song, -1);
+    song_nodes_[song.id()] = item;
+    add_child(container, item);
+  }
+
+  // A parent is always added to the list before any of its new children, so
+  // new containers are in the tree by the time their own children go in.
+  for (LibraryItem* parent : parents) {
+    const QList<LibraryItem*>& children = new_children[parent];
+    const int first = parent->children.count();
+
+    if (signal) {
+      beginInsertRows(ItemToIndex(parent), first,
+                      first + children.count() - 1);
+    }
+    for (LibraryItem* child : children) {
+      child->Insert(parent);
+    }
+    if (signal) endInsertRows();
   }
 }
 
+QString LibraryModel::ContainerKey(GroupBy type, const Song& song) {
+  switch (type) {
+    case GroupBy_Album:
+      return song.album();
+    case GroupBy_Artist:
+      return song.artist();
+    case GroupBy_Composer:
+      return song.composer();
+    case GroupBy_Performer:
+      return song.performer();
+    case GroupBy_Grouping:
+      return song.grouping();
+    case GroupBy_Genre:
+      return song.genre();
+    case GroupBy_AlbumArtist:
+      return song.effective_albumartist();
+    case GroupBy_Year:
+      return QString::number(qMax(0, song.year()));
+    case GroupBy_YearAlbum:
+      return PrettyYearAlbum(qMax(0, song.year()), song.album());
+    case GroupBy_FileType:
+      return song.TextForFiletype();
+    case GroupBy_Bitrate:
+      return QString::number(qMax(0, song.bitrate()));
+    case GroupBy_None:
+      break;
+  }
+  qLog(Error) << "GroupBy_None";
+  return QString();
+}
+
 void LibraryModel::SongsSlightlyChanged(const SongList& songs) {
   // This is called if there was a minor change to the songs that will not
   // normally require the library to be restructured.  We can just update our
@@ -257,23 +326,13 @@ void LibraryModel::SongsSlightlyChanged(const SongList& songs) {
   }
 }
 
-LibraryItem* LibraryModel::CreateCompilationArtistNode(bool signal,
-                                                       LibraryItem* parent) {
-  if (signal)
-    beginInsertRows(ItemToIndex(parent), parent->children.count(),
-                    parent->children.count());
-
-  parent->compilation_artist_node_ =
-      new LibraryItem(LibraryItem::Type_Container, parent);
-  parent->compilation_artist_node_->compilation_artist_node_ = nullptr;
-  parent->compilation_artist_node_->key = tr("Various artists");
-  parent->compilation_artist_node_->sort_text = " various";
-  parent->compilation_artist_node_->container_level =
-      parent->container_level + 1;
-
-  if (signal) endInsertRows();
-
-  return parent->compilation_artist_node_;
+LibraryItem* LibraryModel::NewCompilationArtistNode(LibraryItem* parent) {
+  LibraryItem* node = new LibraryItem(LibraryItem::Type_Container);
+  node->compilation_artist_node_ = nullptr;
+  node->key = tr("Various artists");
+  node->sort_text = " various";
+  node->container_level = parent->container_level + 1;
+  return node;
 }
 
 QString LibraryModel::DividerKey(GroupBy type, LibraryItem* item) const {
@@ -353,6 +412,12 @@ QString LibraryModel::DividerDisplayText(GroupBy type,
 }
 
 void LibraryModel::SongsDeleted(const SongList& songs) {
+  if (filter_songs_valid_) {
+    for (const Song& song : songs) {
+      filter_songs_.remove(song.id());
+    }
+  }
+
   // Delete the actual song nodes first, keeping track of each parent so we
   // might check to see if they're empty later.
   QSet<LibraryItem*> parents;
@@ -399,7 +464,8 @@ void LibraryModel::SongsDeleted(const SongList& songs) {
       if (IsCompilationArtistNode(node))
         node->parent->compilation_artist_node_ = nullptr;
       else
-        container_nodes_[node->container_level].remove(node->key);
+        container_nodes_[node->container_level].remove(
+            ContainerNodeKey(node->parent, node->key));
 
       // It was empty - delete it
       beginRemoveRows(ItemToIndex(node->parent), node->row, node->row);
@@ -601,23 +667,22 @@ bool LibraryModel::HasCompilations(const LibraryQuery& query) {
   q.AddCompilationRequirement(true);
   q.SetLimit(1);
 
-  QMutexLocker l(backend_->db()->Mutex());
+  QMutexLocker l(backend_->db()->ReadMutex());
   if (!backend_->ExecQuery(&q)) return false;
 
   return q.Next();
 }
 
-LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
-  QueryResult result;
-
-  // Information about what we want the children to be
+LibraryModel::GroupBy LibraryModel::ChildGroupBy(LibraryItem* parent) const {
   int child_level = parent == root_ ? 0 : parent->container_level + 1;
-  GroupBy child_type = child_level >= 3 ? GroupBy_None : group_by_[child_level];
+  return child_level >= 3 ? GroupBy_None : group_by_[child_level];
+}
 
-  // Initialise the query.  child_type says what type of thing we want (artists,
-  // songs, etc.)
+LibraryQuery LibraryModel::ChildrenQuery(LibraryItem* parent) {
+  // Initialise the query.  The child type says what type of thing we want
+  // (artists, songs, etc.)
   LibraryQuery q(query_options_);
-  InitQuery(child_type, &q);
+  InitQuery(ChildGroupBy(parent), &q);
 
   // Walk up through the item's parents adding filters as necessary
   LibraryItem* p = parent;
@@ -625,6 +690,13 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
     FilterQuery(group_by_[p->container_level], p, &q);
     p = p->parent;
   }
+  return q;
+}
+
+LibraryModel::QueryResult LibraryModel::RunQuery(const LibraryQuery& query,
+                                                 GroupBy child_type) {
+  QueryResult result;
+  LibraryQuery q(query);
 
   // Artists GroupBy is special - we don't want compilation albums appearing
   if (IsArtistGroupBy(child_type)) {
@@ -638,7 +710,7 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
   }
 
   // Execute the query
-  QMutexLocker l(backend_->db()->Mutex());
+  QMutexLocker l(backend_->db()->ReadMutex());
   if (!backend_->ExecQuery(&q)) return result;
 
   while (q.Next()) {
@@ -647,57 +719,275 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
   return result;
 }
 
+LibraryModel::QueryResult LibraryModel::RunPopulateRequest(
+    std::shared_ptr<PopulateRequest> request) {
+  QueryResult result;
+
+  // Don't bother if the item was collapsed or the model was reset while this
+  // was waiting for a thread.
+  if (!request->cancelled_ && request->fetch_songs_) {
+    result = RunSongsQuery(request->songs_query_);
+  }
+  if (!request->cancelled_ && !result.has_songs) {
+    result = RunQuery(request->query_, request->child_type_);
+  }
+  request->finished_.release();
+  return result;
+}
+
+LibraryModel::QueryResult LibraryModel::RunSongsQuery(
+    const LibraryQuery& query) {
+  QueryResult result;
+
+  // Broad filters match too many songs to keep in memory, so count them by
+  // their IDs before decoding any.
+  LibraryQuery q(query);
+  q.SetColumnSpec("%songs_table.ROWID");
+  q.SetLimit(kMaxFilterSongs + 1);
+
+  QList<int> ids;
+  {
+    QMutexLocker l(backend_->db()->ReadMutex());
+    if (!backend_->ExecQuery(&q)) return result;
+
+    while (q.Next()) {
+      ids << q.Value(0).toInt();
+    }
+  }
+  if (ids.count() > kMaxFilterSongs) return result;
+
+  result.has_songs = true;
+  if (!ids.isEmpty()) result.songs = backend_->GetSongsById(ids);
+  return result;
+}
+
 void LibraryModel::PostQuery(LibraryItem* parent,
                              const LibraryModel::QueryResult& result,
                              bool signal) {
   // Information about what we want the children to be
   int child_level = parent == root_ ? 0 : parent->container_level + 1;
-  GroupBy child_type = child_level >= 3 ? GroupBy_None : group_by_[child_level];
+  GroupBy child_type = ChildGroupBy(parent);
 
-  if (result.create_va) {
-    CreateCompilationArtistNode(signal, parent);
+  // Songs discovered while the query was running might be there already.
+  QList<LibraryItem*> children;
+  if (result.create_va && parent->compilation_artist_node_ == nullptr) {
+    parent->compilation_artist_node_ = NewCompilationArtistNode(parent);
+    children << parent->compilation_artist_node_;
   }
 
   // Step through the results
   for (const SqlRow& row : result.rows) {
-    // Create the item - it will get inserted into the model here
-    LibraryItem* item = ItemFromQuery(child_type, signal, child_level == 0,
-                                      parent, row, child_level);
+    LibraryItem* item = ItemFromQuery(child_type, row, child_level);
 
     // Save a pointer to it for later
-    if (child_type == GroupBy_None)
+    if (child_type == GroupBy_None) {
+      if (song_nodes_.contains(item->metadata.id())) {
+        delete item;
+        continue;
+      }
       song_nodes_[item->metadata.id()] = item;
-    else
-      container_nodes_[child_level][item->key] = item;
+    } else {
+      const ContainerNodeKey key(parent, item->key);
+      if (container_nodes_[child_level].contains(key)) {
+        delete item;
+        continue;
+      }
+      container_nodes_[child_level][key] = item;
+    }
+
+    // Top-level items go under dividers, which are also in the root.
+    if (child_level == 0) {
+      LibraryItem* divider = DividerForItem(child_type, item);
+      if (divider) children << divider;
+    }
+    children << item;
+  }
+
+  if (children.isEmpty()) return;
+
+  // Add them all at once so views only have to relayout once.
+  const int first = parent->children.count();
+  if (signal) {
+    beginInsertRows(ItemToIndex(parent), first, first + children.count() - 1);
+  }
+  for (LibraryItem* child : children) {
+    child->Insert(parent);
   }
+  if (signal) endInsertRows();
+}
+
+void LibraryModel::LazyPopulate(LibraryItem* parent) {
+  if (parent->lazy_loaded) return;
+
+  if (lazy_populate_wait_msec_ < 0) {
+    LazyPopulate(parent, true);
+    return;
+  }
+
+  parent->lazy_loaded = true;
+
+  std::shared_ptr<PopulateRequest> request(new PopulateRequest);
+  request->query_ = ChildrenQuery(parent);
+  request->child_type_ = ChildGroupBy(parent);
+
+  ChildQueryFuture future =
+      QtConcurrent::run(this, &LibraryModel::RunPopulateRequest, request);
+
+  // Most queries are quick, and it's nicer for the view if the children are
+  // there as soon as the item is expanded.  Only slow ones get a placeholder.
+  if (request->finished_.tryAcquire(1, lazy_populate_wait_msec_)) {
+    PostQuery(parent, future.result(), true);
+    return;
+  }
+
+  beginInsertRows(ItemToIndex(parent), parent->children.count(),
+                  parent->children.count());
+  LibraryItem* loading =
+      new LibraryItem(LibraryItem::Type_LoadingIndicator, parent);
+  loading->display_text = tr("Loading...");
+  loading->lazy_loaded = true;
+  endInsertRows();
+
+  PendingPopulate pending;
+  pending.request_ = request;
+  pending.future_ = future;
+  pending.watcher_ = new ChildQueryWatcher(this);
+  connect(pending.watcher_, SIGNAL(finished()), SLOT(LazyPopulateFinished()));
+  pending.watcher_->setFuture(future);
+
+  pending_populates_[parent] = pending;
 }
 
 void LibraryModel::LazyPopulate(LibraryItem* parent, bool signal) {
+  // Something needs the children right now, so if they're being loaded
+  // already wait for them.
+  if (pending_populates_.contains(parent)) {
+    FinishLazyPopulate(parent, pending_populates_.take(parent));
+    return;
+  }
+
   if (parent->lazy_loaded) return;
   parent->lazy_loaded = true;
 
-  QueryResult result = RunQuery(parent);
+  QueryResult result = RunQuery(ChildrenQuery(parent), ChildGroupBy(parent));
   PostQuery(parent, result, signal);
 }
 
+void LibraryModel::LazyPopulateFinished() {
+  ChildQueryWatcher* watcher = static_cast<ChildQueryWatcher*>(sender());
+
+  for (auto it = pending_populates_.begin(); it != pending_populates_.end();
+       ++it) {
+    if (it.value().watcher_ == watcher) {
+      LibraryItem* parent = it.key();
+      PendingPopulate pending = it.value();
+      pending_populates_.erase(it);
+
+      FinishLazyPopulate(parent, pending);
+      return;
+    }
+  }
+
+  // It was cancelled.
+}
+
+void LibraryModel::FinishLazyPopulate(LibraryItem* parent,
+                                      const PendingPopulate& pending) {
+  pending.watcher_->deleteLater();
+
+  RemoveLoadingIndicator(parent);
+  PostQuery(parent, pending.future_.result(), true);
+}
+
+void LibraryModel::CancelLazyPopulate(const QModelIndex& index) {
+  LibraryItem* parent = IndexToItem(index);
+  if (!pending_populates_.contains(parent)) return;
+
+  PendingPopulate pending = pending_populates_.take(parent);
+  pending.request_->cancelled_ = 1;
+  pending.watcher_->deleteLater();
+
+  RemoveLoadingIndicator(parent);
+  parent->lazy_loaded = false;
+}
+
+void LibraryModel::CancelLazyPopulates() {
+  for (const PendingPopulate& pending : pending_populates_) {
+    pending.request_->cancelled_ = 1;
+    pending.watcher_->deleteLater();
+  }
+  pending_populates_.clear();
+}
+
+void LibraryModel::RemoveLoadingIndicator(LibraryItem* parent) {
+  for (LibraryItem* child : parent->children) {
+    if (child->type == LibraryItem::Type_LoadingIndicator) {
+      beginRemoveRows(ItemToIndex(parent), child->row, child->row);
+      parent->Delete(child->row);
+      endRemoveRows();
+      return;
+    }
+  }
+}
+
 void LibraryModel::ResetAsync() {
-  RootQueryFuture future =
-      QtConcurrent::run(this, &LibraryModel::RunQuery, root_);
-  RootQueryWatcher* watcher = new RootQueryWatcher(this);
-  watcher->setFuture(future);
+  // Children of the old tree aren't wanted any more, and neither is a tree
+  // for an older filter that's still being loaded.
+  CancelLazyPopulates();
+  CancelResetAsync();
+  ClearFilterSongs();
+
+  std::shared_ptr<PopulateRequest> request(new PopulateRequest);
+  request->query_ = ChildrenQuery(root_);
+  request->child_type_ = ChildGroupBy(root_);
+
+  // Get the songs that match the filter rather than just the top level of the
+  // tree, so that when more of the filter is typed they can be filtered again
+  // without another query.
+  if (!LibraryQuery::ParseFilter(query_options_.filter()).isEmpty()) {
+    request->fetch_songs_ = true;
+    request->songs_query_ = LibraryQuery(query_options_);
+    InitQuery(GroupBy_None, &request->songs_query_);
+  }
+
+  pending_reset_.request_ = request;
+  pending_reset_.future_ =
+      QtConcurrent::run(this, &LibraryModel::RunPopulateRequest, request);
+  pending_reset_.watcher_ = new RootQueryWatcher(this);
+  connect(pending_reset_.watcher_, SIGNAL(finished()),
+          SLOT(ResetAsyncQueryFinished()));
+  pending_reset_.watcher_->setFuture(pending_reset_.future_);
+  reset_pending_ = true;
+}
+
+void LibraryModel::CancelResetAsync() {
+  if (!reset_pending_) return;
+  reset_pending_ = false;
 
-  connect(watcher, SIGNAL(finished()), SLOT(ResetAsyncQueryFinished()));
+  // A query that's already running can't be stopped, but its result is
+  // thrown away.
+  pending_reset_.request_->cancelled_ = 1;
+  pending_reset_.watcher_->disconnect(this);
+  pending_reset_.watcher_->deleteLater();
 }
 
 void LibraryModel::ResetAsyncQueryFinished() {
-  RootQueryWatcher* watcher = static_cast<RootQueryWatcher*>(sender());
-  const struct QueryResult result = watcher->result();
-  watcher->deleteLater();
+  reset_pending_ = false;
+  pending_reset_.watcher_->deleteLater();
+  const struct QueryResult result = pending_reset_.future_.result();
 
   BeginReset();
   root_->lazy_loaded = true;
 
-  PostQuery(root_, result, false);
+  if (result.has_songs) {
+    for (const Song& song : result.songs) {
+      filter_songs_[song.id()] = song;
+    }
+    filter_songs_valid_ = true;
+    AddSongs(result.songs, false);
+  } else {
+    PostQuery(root_, result, false);
+  }
 
   if (init_task_id_ != -1) {
     app_->task_manager()->SetTaskFinished(init_task_id_);
@@ -708,6 +998,8 @@ void LibraryModel::ResetAsyncQueryFinished() {
 }
 
 void LibraryModel::BeginReset() {
+  CancelLazyPopulates();
+
   beginResetModel();
   delete root_;
   song_nodes_.clear();
@@ -728,11 +1020,19 @@ void LibraryModel::BeginReset() {
 }
 
 void LibraryModel::Reset() {
+  CancelResetAsync();
+  ClearFilterSongs();
   BeginReset();
 
   // Populate top level
   LazyPopulate(root_, false);
 
+  // This might have replaced the query started by Init.
+  if (init_task_id_ != -1) {
+    app_->task_manager()->SetTaskFinished(init_task_id_);
+    init_task_id_ = -1;
+  }
+
   endResetModel();
 }
 
@@ -836,28 +1136,21 @@ void LibraryModel::FilterQuery(GroupBy type, LibraryItem* item,
   }
 }
 
-LibraryItem* LibraryModel::InitItem(GroupBy type, bool signal,
-                                    LibraryItem* parent, int container_level) {
+LibraryItem* LibraryModel::InitItem(GroupBy type, int container_level) {
   LibraryItem::Type item_type = type == GroupBy_None
                                     ? LibraryItem::Type_Song
                                     : LibraryItem::Type_Container;
 
-  if (signal)
-    beginInsertRows(ItemToIndex(parent), parent->children.count(),
-                    parent->children.count());
-
   // Initialise the item depending on what type it's meant to be
-  LibraryItem* item = new LibraryItem(item_type, parent);
+  LibraryItem* item = new LibraryItem(item_type);
   item->compilation_artist_node_ = nullptr;
   item->container_level = container_level;
   return item;
 }
 
-LibraryItem* LibraryModel::ItemFromQuery(GroupBy type, bool signal,
-                                         bool create_divider,
-                                         LibraryItem* parent, const SqlRow& row,
+LibraryItem* LibraryModel::ItemFromQuery(GroupBy type, const SqlRow& row,
                                          int container_level) {
-  LibraryItem* item = InitItem(type, signal, parent, container_level);
+  LibraryItem* item = InitItem(type, container_level);
   int year = 0;
   int bitrate = 0;
 
@@ -912,15 +1205,13 @@ LibraryItem* LibraryModel::ItemFromQuery(GroupBy type, bool signal,
       break;
   }
 
-  FinishItem(type, signal, create_divider, parent, item);
+  FinishItem(type, item);
   return item;
 }
 
-LibraryItem* LibraryModel::ItemFromSong(GroupBy type, bool signal,
-                                        bool create_divider,
-                                        LibraryItem* parent, const Song& s,
+LibraryItem* LibraryModel::ItemFromSong(GroupBy type, const Song& s,
                                         int container_level) {
-  LibraryItem* item = InitItem(type, signal, parent, container_level);
+  LibraryItem* item = InitItem(type, container_level);
   int year = 0;
   int bitrate = 0;
 
@@ -946,17 +1237,12 @@ LibraryItem* LibraryModel::ItemFromSong(GroupBy type, bool signal,
       break;
 
     case GroupBy_Composer:
-      item->key = s.composer();
     case GroupBy_Performer:
-      item->key = s.performer();
     case GroupBy_Grouping:
-      item->key = s.grouping();
     case GroupBy_Genre:
-      if (item->key.isNull()) item->key = s.genre();
     case GroupBy_Album:
-      if (item->key.isNull()) item->key = s.album();
     case GroupBy_AlbumArtist:
-      if (item->key.isNull()) item->key = s.effective_albumartist();
+      item->key = ContainerKey(type, s);
       item->display_text = TextOrUnknown(item->key);
       item->sort_text = SortTextForArtist(item->key);
       break;
@@ -980,37 +1266,32 @@ LibraryItem* LibraryModel::ItemFromSong(GroupBy type, bool signal,
       break;
   }
 
-  FinishItem(type, signal, create_divider, parent, item);
+  FinishItem(type, item);
   if (s.url().scheme() == "cdda") item->lazy_loaded = true;
   return item;
 }
 
-void LibraryModel::FinishItem(GroupBy type, bool signal, bool create_divider,
-                              LibraryItem* parent, LibraryItem* item) {
+void LibraryModel::FinishItem(GroupBy type, LibraryItem* item) {
   if (type == GroupBy_None) item->lazy_loaded = true;
+}
 
-  if (signal) endInsertRows();
-
-  // Create the divider entry if we're supposed to
-  if (create_divider && show_dividers_) {
-    QString divider_key = DividerKey(type, item);
-    item->sort_text.prepend(divider_key);
+LibraryItem* LibraryModel::DividerForItem(GroupBy type, LibraryItem* item) {
+  if (!show_dividers_) return nullptr;
 
-    if (!divider_key.isEmpty() && !divider_nodes_.contains(divider_key)) {
-      if (signal)
-        beginInsertRows(ItemToIndex(parent), parent->children.count(),
-                        parent->children.count());
+  QString divider_key = DividerKey(type, item);
+  item->sort_text.prepend(divider_key);
 
-      LibraryItem* divider = new LibraryItem(LibraryItem::Type_Divider, root_);
-      divider->key = divider_key;
-      divider->display_text = DividerDisplayText(type, divider_key);
-      divider->lazy_loaded = true;
+  if (divider_key.isEmpty() || divider_nodes_.contains(divider_key)) {
+    return nullptr;
+  }
 
-      divider_nodes_[divider_key] = divider;
+  LibraryItem* divider = new LibraryItem(LibraryItem::Type_Divider);
+  divider->key = divider_key;
+  divider->display_text = DividerDisplayText(type, divider_key);
+  divider->lazy_loaded = true;
 
-      if (signal) endInsertRows();
-    }
-  }
+  divider_nodes_[divider_key] = divider;
+  return divider;
 }
 
 QString LibraryModel::TextOrUnknown(const QString& text) {
@@ -1126,7 +1407,7 @@ void LibraryModel::GetChildSongs(LibraryItem* item, QList<QUrl>* urls,
                                  SongList* songs, QSet<int>* song_ids) const {
   switch (item->type) {
     case LibraryItem::Type_Container: {
-      const_cast<LibraryModel*>(this)->LazyPopulate(item);
+      const_cast<LibraryModel*>(this)->LazyPopulate(item, true);
 
       QList<LibraryItem*> children = item->children;
       qSort(children.begin(), children.end(),
@@ -1171,8 +1452,67 @@ void LibraryModel::SetFilterAge(int age) {
 }
 
 void LibraryModel::SetFilterText(const QString& text) {
+  // Typing more of the filter only ever takes songs away, so if all the songs
+  // that matched the old filter are here already the database isn't needed.
+  const bool refine = filter_songs_valid_ &&
+                      IsFilterRefinement(query_options_.filter(), text);
+
   query_options_.set_filter(text);
-  ResetAsync();
+  if (refine) {
+    RefineFilter();
+  } else {
+    ResetAsync();
+  }
+}
+
+bool LibraryModel::IsFilterRefinement(const QString& old_filter,
+                                      const QString& new_filter) {
+  const QList<LibraryQuery::FilterTerm> old_terms =
+      LibraryQuery::ParseFilter(old_filter);
+  const QList<LibraryQuery::FilterTerm> new_terms =
+      LibraryQuery::ParseFilter(new_filter);
+
+  // Each word matches the start of a word in the song, so every old word needs
+  // a new word for the same column that starts with it.
+  for (const LibraryQuery::FilterTerm& old_term : old_terms) {
+    const QByteArray old_word = Database::FoldText(old_term.word_);
+
+    bool refined = false;
+    for (const LibraryQuery::FilterTerm& new_term : new_terms) {
+      if (new_term.column_ == old_term.column_ &&
+          Database::FoldText(new_term.word_).startsWith(old_word)) {
+        refined = true;
+        break;
+      }
+    }
+    if (!refined) return false;
+  }
+  return true;
+}
+
+void LibraryModel::RefineFilter() {
+  CancelResetAsync();
+
+  SongList songs;
+  for (QMap<int, Song>::iterator it = filter_songs_.begin();
+       it != filter_songs_.end();) {
+    if (query_options_.Matches(*it)) {
+      songs << *it;
+      ++it;
+    } else {
+      it = filter_songs_.erase(it);
+    }
+  }
+
+  BeginReset();
+  root_->lazy_loaded = true;
+  AddSongs(songs, false);
+  endResetModel();
+}
+
+void LibraryModel::ClearFilterSongs() {
+  filter_songs_valid_ = false;
+  filter_songs_.clear();
 }
 
 void LibraryModel::SetFilterQueryMode(QueryOptions::QueryMode query_mode) {
@@ -19,7 +19,13 @@
 #define LIBRARYMODEL_H
 
 #include <QAbstractItemModel>
+#include <QAtomicInt>
+#include <QFuture>
+#include <QFutureWatcher>
 #include <QIcon>
+#include <QSemaphore>
+
+#include <memory>
 
 #include "libraryitem.h"
 #include "libraryquery.h"
@@ -56,6 +62,13 @@ class LibraryModel : public SimpleTreeModel<LibraryItem> {
   static const int kSmartPlaylistsVersion;
   static const int kPrettyCoverSize;
 
+  // Expanding an item waits this long for its children to be loaded before
+  // showing a placeholder and adding them when they arrive.
+  static const int kLazyPopulateWaitMsec;
+  // Filtering keeps the songs that match in memory if there are no more than
+  // this many, so typing more of the filter text doesn't need a query.
+  static const int kMaxFilterSongs;
+
   enum Role {
     Role_Type = Qt::UserRole + 1,
     Role_ContainerType,
@@ -102,10 +115,15 @@ class LibraryModel : public SimpleTreeModel<LibraryItem> {
   };
 
   struct QueryResult {
-    QueryResult() : create_va(false) {}
+    QueryResult() : create_va(false), has_songs(false) {}
 
     SqlRowList rows;
     bool create_va;
+
+    // Set instead of rows when every song that matched the filter was
+    // fetched.
+    bool has_songs;
+    SongList songs;
   };
 
   LibraryBackend* backend() const { return backend_; }
@@ -155,6 +173,12 @@ class LibraryModel : public SimpleTreeModel<LibraryItem> {
   // Whether or not to show letters heading in the library view
   void set_show_dividers(bool show_dividers);
 
+  // Used by tests.  -1 loads children synchronously, which is what Init(false)
+  // does.
+  void set_lazy_populate_wait_msec(int msec) {
+    lazy_populate_wait_msec_ = msec;
+  }
+
   // Utility functions for manipulating text
   static QString TextOrUnknown(const QString& text);
   static QString PrettyYearAlbum(int year, const QString& album);
@@ -178,8 +202,16 @@ signals:
   void Reset();
   void ResetAsync();
 
+  // Stops loading the item's children if they haven't arrived yet, so
+  // expanding it again starts afresh.  Called when the item is collapsed.
+  void CancelLazyPopulate(const QModelIndex& index);
+
  protected:
-  void LazyPopulate(LibraryItem* item) { LazyPopulate(item, true); }
+  // Called when the view expands an item.  The children are loaded on another
+  // thread if they take a while.
+  void LazyPopulate(LibraryItem* item);
+  // Loads the children straight away, waiting for them if they were already
+  // being loaded on another thread.
   void LazyPopulate(LibraryItem* item, bool signal);
 
  private slots:
@@ -191,16 +223,64 @@ signals:
 
   // Called after ResetAsync
   void ResetAsyncQueryFinished();
+  // Called when a slow query started by LazyPopulate finishes
+  void LazyPopulateFinished();
 
   void AlbumArtLoaded(quint64 id, const QImage& image);
 
  private:
-  // Provides some optimisations for loading the list of items in the root.
-  // This gets called a lot when filtering the playlist, so it's nice to be
-  // able to do it in a background thread.
-  QueryResult RunQuery(LibraryItem* parent);
+  // A query for an item's children that LazyPopulate is running on another
+  // thread.  Cancelling it before it starts saves running the query at all.
+  struct PopulateRequest {
+    PopulateRequest() : fetch_songs_(false) {}
+
+    LibraryQuery query_;
+    GroupBy child_type_;
+    // Tries songs_query_ first, and only runs query_ if it returned too many
+    // songs.
+    bool fetch_songs_;
+    LibraryQuery songs_query_;
+    QAtomicInt cancelled_;
+    QSemaphore finished_;
+  };
+
+  struct PendingPopulate {
+    std::shared_ptr<PopulateRequest> request_;
+    QFuture<QueryResult> future_;
+    QFutureWatcher<QueryResult>* watcher_;
+  };
+
+  // The query for an item's children has to be built on the GUI thread since
+  // it looks at the item's parents, but it can be run on any thread.  This
+  // gets called a lot when filtering the playlist, so it's nice to be able to
+  // do it in a background thread.
+  GroupBy ChildGroupBy(LibraryItem* parent) const;
+  LibraryQuery ChildrenQuery(LibraryItem* parent);
+  QueryResult RunQuery(const LibraryQuery& query, GroupBy child_type);
+  QueryResult RunPopulateRequest(std::shared_ptr<PopulateRequest> request);
+  // Fetches the songs, unless there are more than kMaxFilterSongs.
+  QueryResult RunSongsQuery(const LibraryQuery& query);
+  // Adds the items in the result to the parent, skipping any that are there
+  // already.
   void PostQuery(LibraryItem* parent, const QueryResult& result, bool signal);
 
+  void FinishLazyPopulate(LibraryItem* parent, const PendingPopulate& pending);
+  void CancelLazyPopulates();
+  void RemoveLoadingIndicator(LibraryItem* parent);
+  void CancelResetAsync();
+
+  // Adds each song to the tree if it matches the filter, along with any
+  // containers it needs.
+  void AddSongs(const SongList& songs, bool signal);
+
+  // Whether every song that matches the new filter text also matches the old
+  // one - the new text has more words, or longer words.
+  static bool IsFilterRefinement(const QString& old_filter,
+                                 const QString& new_filter);
+  // Rebuilds the tree from filter_songs_ without running a query.
+  void RefineFilter();
+  void ClearFilterSongs();
+
   bool HasCompilations(const LibraryQuery& query);
 
   void BeginReset();
@@ -215,15 +295,17 @@ signals:
 
   // Items can be created either from a query that's been run to populate a
   // node, or by a spontaneous SongsDiscovered emission from the backend.
-  LibraryItem* ItemFromQuery(GroupBy type, bool signal, bool create_divider,
-                             LibraryItem* parent, const SqlRow& row,
+  // They aren't in the tree yet - the caller adds a batch of them at a time.
+  LibraryItem* ItemFromQuery(GroupBy type, const SqlRow& row,
                              int container_level);
-  LibraryItem* ItemFromSong(GroupBy type, bool signal, bool create_divider,
-                            LibraryItem* parent, const Song& s,
-                            int container_level);
+  LibraryItem* ItemFromSong(GroupBy type, const Song& s, int container_level);
 
-  // The "Various Artists" node is an annoying special case.
-  LibraryItem* CreateCompilationArtistNode(bool signal, LibraryItem* parent);
+  // The key of the container the song belongs in at a level grouped by type.
+  static QString ContainerKey(GroupBy type, const Song& song);
+
+  // The "Various Artists" node is an annoying special case.  This makes one for
+  // the parent without adding it to the tree.
+  LibraryItem* NewCompilationArtistNode(LibraryItem* parent);
 
   // Smart playlists are shown in another top-level node
   void CreateSmartPlaylists();
@@ -232,11 +314,13 @@ signals:
   void ItemFromSmartPlaylist(const QSettings& s, bool notify) const;
 
   // Helpers for ItemFromQuery and ItemFromSong
-  LibraryItem* InitItem(GroupBy type, bool signal, LibraryItem* parent,
-                        int container_level);
-  void FinishItem(GroupBy type, bool signal, bool create_divider,
-                  LibraryItem* parent, LibraryItem* item);
+  LibraryItem* InitItem(GroupBy type, int container_level);
+  void FinishItem(GroupBy type, LibraryItem* item);
 
+  // Prefixes a top-level item's sort text with its divider's key.  Returns a
+  // new divider if there isn't one for that key yet - it isn't in the tree, so
+  // the caller has to insert it.
+  LibraryItem* DividerForItem(GroupBy type, LibraryItem* item);
   QString DividerKey(GroupBy type, LibraryItem* item) const;
   QString DividerDisplayText(GroupBy type, const QString& key) const;
 
@@ -262,8 +346,10 @@ signals:
   // Keyed on database ID
   QMap<int, LibraryItem*> song_nodes_;
 
-  // Keyed on whatever the key is for that level - artist, album, year, etc.
-  QMap<QString, LibraryItem*> container_nodes_[3];
+  // Keyed on the parent and whatever the key is for that level - artist,
+  // album, year, etc.  Different artists can have albums with the same name.
+  typedef QPair<LibraryItem*, QString> ContainerNodeKey;
+  QHash<ContainerNodeKey, LibraryItem*> container_nodes_[3];
 
   // Keyed on a letter, a year, a century, etc.
   QMap<QString, LibraryItem*> divider_nodes_;
@@ -281,6 +367,19 @@ signals:
 
   int init_task_id_;
 
+  // The query for the top level started by ResetAsync, if it hasn't finished.
+  bool reset_pending_;
+  PendingPopulate pending_reset_;
+
+  // Every song that matches the filter text, keyed on database ID.  Only
+  // valid if filter_songs_valid_ is set, which is after a query for a filter
+  // that didn't match too many songs.  Kept up to date as songs change.
+  bool filter_songs_valid_;
+  QMap<int, Song> filter_songs_;
+
+  int lazy_populate_wait_msec_;
+  QHash<LibraryItem*, PendingPopulate> pending_populates_;
+
   bool use_pretty_covers_;
   bool show_dividers_;
 
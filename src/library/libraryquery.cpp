@@ -16,57 +16,50 @@
 */
 
 #include "libraryquery.h"
+#include "libraryindex.h"
+#include "core/logging.h"
 #include "core/song.h"
 
 #include <QtDebug>
 #include <QDateTime>
+#include <QRegExp>
 #include <QSqlError>
+#include <QSqlRecord>
+
+bool LibraryQuery::sAuditQueryPlans = false;
+
+// Passed to bm25() to make matches in some columns count for more than others.
+// They're in the same order as Song::kFtsColumns.
+const char* LibraryQuery::kFtsRankWeights =
+    "10.0, 6.0, 8.0, 6.0, 2.0, 2.0, 1.0, 1.0, 0.5";
 
 QueryOptions::QueryOptions() : max_age_(-1), query_mode_(QueryMode_All) {}
 
 LibraryQuery::LibraryQuery(const QueryOptions& options)
-    : include_unavailable_(false), join_with_fts_(false), limit_(-1) {
+    : include_unavailable_(false),
+      join_with_fts_(false),
+      limit_(-1),
+      from_index_(false),
+      index_row_(-1) {
   if (!options.filter().isEmpty()) {
-    // We need to munge the filter text a little bit to get it to work as
-    // expected with sqlite's FTS3:
-    //  1) Append * to all tokens.
-    //  2) Prefix "fts" to column names.
-    //  3) Remove colons which don't correspond to column names.
-
-    // Split on whitespace
-    QStringList tokens(
-        options.filter().split(QRegExp("\\s+"), QString::SkipEmptyParts));
-    QString query;
-    for (QString token : tokens) {
-      token.remove('(');
-      token.remove(')');
-      token.remove('"');
-      token.replace('-', ' ');
-
-      if (token.contains(':')) {
-        // Only prefix fts if the token is a valid column name.
-        if (Song::kFtsColumns.contains("fts" + token.section(':', 0, 0),
-                                       Qt::CaseInsensitive)) {
-          // Account for multiple colons.
-          QString columntoken =
-              token.section(':', 0, 0, QString::SectionIncludeTrailingSep);
-          QString subtoken = token.section(':', 1, -1);
-          subtoken.replace(":", " ");
-          subtoken = subtoken.trimmed();
-          query += "fts" + columntoken + subtoken + "* ";
-        } else {
-          token.replace(":", " ");
-          token = token.trimmed();
-          query += token + "* ";
-        }
-      } else {
-        query += token + "* ";
+    // Quote every word, so punctuation can't break the query syntax, and make
+    // it a prefix search.
+    filter_terms_ = ParseFilter(options.filter());
+
+    QStringList terms;
+    for (const FilterTerm& filter_term : filter_terms_) {
+      QString term = "\"" + filter_term.word_ + "\"*";
+      if (!filter_term.column_.isEmpty()) {
+        term = filter_term.column_ + " : " + term;
       }
+      terms << term;
     }
 
-    where_clauses_ << "fts.%fts_table_noprefix MATCH ?";
-    bound_values_ << query;
-    join_with_fts_ = true;
+    if (!terms.isEmpty()) {
+      where_clauses_ << "fts.%fts_table_noprefix MATCH ?";
+      bound_values_ << terms.join(" ");
+      join_with_fts_ = true;
+    }
   }
 
   if (options.max_age() != -1) {
@@ -74,6 +67,7 @@ LibraryQuery::LibraryQuery(const QueryOptions& options)
 
     where_clauses_ << "ctime > ?";
     bound_values_ << cutoff;
+    conditions_ << Condition("ctime", cutoff, ">");
   }
 
   // TODO: currently you cannot use any QueryMode other than All and fts at the
@@ -89,11 +83,69 @@ LibraryQuery::LibraryQuery(const QueryOptions& options)
   // filtering in both Duplicates and Untagged modes.
   duplicates_only_ = options.query_mode() == QueryOptions::QueryMode_Duplicates;
 
-  if (options.query_mode() == QueryOptions::QueryMode_Untagged) {
+  untagged_only_ = options.query_mode() == QueryOptions::QueryMode_Untagged;
+
+  if (untagged_only_) {
     where_clauses_ << "(artist = '' OR album = '' OR title ='')";
   }
 }
 
+QList<LibraryQuery::FilterTerm> LibraryQuery::ParseFilter(
+    const QString& filter) {
+  // We need to munge the filter text a little bit to get it to work as
+  // expected with sqlite's FTS5:
+  //  1) Prefix "fts" to column names.
+  //  2) Remove colons which don't correspond to column names.
+
+  // Split on whitespace
+  QStringList tokens(filter.split(QRegExp("\\s+"), QString::SkipEmptyParts));
+  QList<FilterTerm> ret;
+  for (QString token : tokens) {
+    token.remove('(');
+    token.remove(')');
+    token.remove('"');
+    token.replace('-', ' ');
+
+    QString column;
+    if (token.contains(':')) {
+      // Only prefix fts if the token is a valid column name.
+      const QString fts_column = "fts" + token.section(':', 0, 0).toLower();
+      if (Song::kFtsColumns.contains(fts_column)) {
+        // Account for multiple colons.
+        column = fts_column;
+        token = token.section(':', 1, -1);
+      }
+      token.replace(':', ' ');
+    }
+
+    for (const QString& word : token.split(' ', QString::SkipEmptyParts)) {
+      // The tokenizer throws away anything that isn't a letter or number,
+      // and FTS5 doesn't like empty strings.
+      if (!ContainsLetterOrNumber(word)) continue;
+
+      FilterTerm term;
+      term.column_ = column;
+      term.word_ = word;
+      ret << term;
+    }
+  }
+  return ret;
+}
+
+bool LibraryQuery::ContainsLetterOrNumber(const QString& text) {
+  for (const QChar& c : text) {
+    if (c.isLetterOrNumber()) return true;
+  }
+  return false;
+}
+
+void LibraryQuery::SetOrderByRelevance() {
+  if (join_with_fts_) {
+    order_by_ =
+        QString("bm25(fts.%fts_table_noprefix, %1)").arg(kFtsRankWeights);
+  }
+}
+
 QString LibraryQuery::GetInnerQuery() {
   return duplicates_only_
              ? QString(
@@ -106,6 +158,8 @@ QString LibraryQuery::GetInnerQuery() {
 
 void LibraryQuery::AddWhere(const QString& column, const QVariant& value,
                             const QString& op) {
+  conditions_ << Condition(column, value, op);
+
   // ignore 'literal' for IN
   if (!op.compare("IN", Qt::CaseInsensitive)) {
     QStringList final;
@@ -130,6 +184,7 @@ void LibraryQuery::AddWhere(const QString& column, const QVariant& value,
 void LibraryQuery::AddCompilationRequirement(bool compilation) {
   where_clauses_ << QString("effective_compilation = %1")
                         .arg(compilation ? 1 : 0);
+  conditions_ << Condition("effective_compilation", compilation ? 1 : 0, "=");
 }
 
 QSqlQuery LibraryQuery::Exec(QSqlDatabase db, const QString& songs_table,
@@ -160,7 +215,14 @@ QSqlQuery LibraryQuery::Exec(QSqlDatabase db, const QString& songs_table,
   sql.replace("%fts_table_noprefix", fts_table.section('.', -1, -1));
   sql.replace("%fts_table", fts_table);
 
-  query_ = QSqlQuery(sql, db);
+  if (sAuditQueryPlans) {
+    AuditQueryPlan(db, sql, songs_table);
+  }
+
+  // Constructing the query with the SQL would execute it straight away, before
+  // anything was bound.
+  query_ = QSqlQuery(db);
+  query_.prepare(sql);
 
   // Bind values
   for (const QVariant& value : bound_values_) {
@@ -171,9 +233,53 @@ QSqlQuery LibraryQuery::Exec(QSqlDatabase db, const QString& songs_table,
   return query_;
 }
 
-bool LibraryQuery::Next() { return query_.next(); }
+void LibraryQuery::AuditQueryPlan(QSqlDatabase db, const QString& sql,
+                                  const QString& songs_table) const {
+  QSqlQuery explain(db);
+  explain.prepare("EXPLAIN QUERY PLAN " + sql);
+  for (const QVariant& value : bound_values_) {
+    explain.addBindValue(value);
+  }
+  if (!explain.exec()) return;
+
+  // Older versions of SQLite say "SCAN TABLE songs", newer ones "SCAN songs".
+  // Scans that use an index say so with USING.
+  const QString table = songs_table.section('.', -1, -1);
+  QRegExp full_scan("SCAN (TABLE )?" + QRegExp::escape(table) +
+                    "( AS \\w+)?");
+
+  QStringList plan;
+  bool scans_table = false;
+  while (explain.next()) {
+    // The last column is always the description of the step.
+    const QString detail =
+        explain.value(explain.record().count() - 1).toString();
+    plan << detail;
+    if (full_scan.exactMatch(detail)) scans_table = true;
+  }
+
+  if (scans_table) {
+    qLog(Info) << "Full scan of" << songs_table << "in" << sql;
+    for (const QString& detail : plan) {
+      qLog(Info) << "  " << detail;
+    }
+  }
+}
+
+bool LibraryQuery::Next() {
+  if (from_index_) return ++index_row_ < index_rows_.count();
+  return query_.next();
+}
 
-QVariant LibraryQuery::Value(int column) const { return query_.value(column); }
+QVariant LibraryQuery::Value(int column) const {
+  if (from_index_) return index_rows_[index_row_][column];
+  return query_.value(column);
+}
+
+int LibraryQuery::ColumnCount() const {
+  if (from_index_) return index_rows_.isEmpty() ? 0 : index_rows_[0].count();
+  return query_.record().count();
+}
 
 bool QueryOptions::Matches(const Song& song) const {
   if (max_age_ != -1) {
@@ -181,10 +287,17 @@ bool QueryOptions::Matches(const Song& song) const {
     if (song.ctime() <= cutoff) return false;
   }
 
-  if (!filter_.isNull()) {
-    return song.artist().contains(filter_, Qt::CaseInsensitive) ||
-           song.album().contains(filter_, Qt::CaseInsensitive) ||
-           song.title().contains(filter_, Qt::CaseInsensitive);
+  if (query_mode_ == QueryMode_Untagged && !song.artist().isEmpty() &&
+      !song.album().isEmpty() && !song.title().isEmpty()) {
+    return false;
+  }
+
+  // Match the words the same way the FTS query would.
+  if (!filter_.isEmpty()) {
+    for (const LibraryQuery::FilterTerm& term :
+         LibraryQuery::ParseFilter(filter_)) {
+      if (!LibraryIndex::Matches(song, term)) return false;
+    }
   }
 
   return true;
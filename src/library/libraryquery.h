@@ -18,6 +18,7 @@
 #ifndef LIBRARYQUERY_H
 #define LIBRARYQUERY_H
 
+#include <QList>
 #include <QString>
 #include <QVariant>
 #include <QSqlQuery>
@@ -26,6 +27,7 @@
 
 class Song;
 class LibraryBackend;
+class LibraryIndex;
 
 // This structure let's you customize behaviour of any LibraryQuery.
 struct QueryOptions {
@@ -69,10 +71,26 @@ class LibraryQuery {
  public:
   LibraryQuery(const QueryOptions& options = QueryOptions());
 
+  static const char* kFtsRankWeights;
+
+  // One word of the filter text.  column_ is the FTS column it has to be in,
+  // or empty if it can be in any of them.
+  struct FilterTerm {
+    QString column_;
+    QString word_;
+  };
+
+  // Splits the filter text into the words that have to match, the same way
+  // the FTS query is built.
+  static QList<FilterTerm> ParseFilter(const QString& filter);
+
   // Sets contents of SELECT clause on the query (list of columns to get).
   void SetColumnSpec(const QString& spec) { column_spec_ = spec; }
   // Sets an ORDER BY clause on the query.
   void SetOrderBy(const QString& order_by) { order_by_ = order_by; }
+  // Puts the best matches for the filter text first.  Does nothing if there
+  // isn't any filter text.
+  void SetOrderByRelevance();
 
   // Adds a fragment of WHERE clause. When executed, this Query will connect all
   // the fragments with AND operator.
@@ -90,11 +108,33 @@ class LibraryQuery {
                  const QString& fts_table);
   bool Next();
   QVariant Value(int column) const;
+  int ColumnCount() const;
 
   operator const QSqlQuery&() const { return query_; }
 
+  // Logs the query plan of every query that ends up scanning the whole songs
+  // table.  This runs an extra EXPLAIN for each query so it's off by default.
+  static void set_audit_query_plans(bool audit) { sAuditQueryPlans = audit; }
+
  private:
   QString GetInnerQuery();
+  static bool ContainsLetterOrNumber(const QString& text);
+  void AuditQueryPlan(QSqlDatabase db, const QString& sql,
+                      const QString& songs_table) const;
+
+  static bool sAuditQueryPlans;
+
+  // LibraryIndex answers queries from these instead of the SQL.
+  friend class LibraryIndex;
+
+  struct Condition {
+    Condition(const QString& column, const QVariant& value, const QString& op)
+        : column_(column), value_(value), op_(op) {}
+
+    QString column_;
+    QVariant value_;
+    QString op_;
+  };
 
   bool include_unavailable_;
   bool join_with_fts_;
@@ -104,8 +144,16 @@ class LibraryQuery {
   QVariantList bound_values_;
   int limit_;
   bool duplicates_only_;
+  bool untagged_only_;
+  QList<Condition> conditions_;
+  QList<FilterTerm> filter_terms_;
 
   QSqlQuery query_;
+
+  // Set if LibraryIndex ran the query instead of SQLite.
+  bool from_index_;
+  QList<QVariantList> index_rows_;
+  int index_row_;
 };
 
 #endif  // LIBRARYQUERY_H
@@ -104,6 +104,7 @@ void LibrarySettingsPage::Save() {
   s.setValue("save_ratings_in_file", ui_->save_ratings_in_file->isChecked());
   s.setValue("save_statistics_in_file",
              ui_->save_statistics_in_file->isChecked());
+  s.setValue("in_memory_index", ui_->in_memory_index->isChecked());
   s.endGroup();
 }
 
@@ -146,6 +147,8 @@ void LibrarySettingsPage::Load() {
       s.value("save_ratings_in_file", false).toBool());
   ui_->save_statistics_in_file->setChecked(
       s.value("save_statistics_in_file", false).toBool());
+  ui_->in_memory_index->setChecked(
+      s.value("in_memory_index", false).toBool());
   s.endGroup();
 }
 
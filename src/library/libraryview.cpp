@@ -178,6 +178,9 @@ LibraryView::LibraryView(QWidget* parent)
   setSelectionMode(QAbstractItemView::ExtendedSelection);
 
   setStyleSheet("QTreeView::item{padding-top:1px;}");
+
+  connect(this, SIGNAL(collapsed(QModelIndex)),
+          SLOT(ItemCollapsed(QModelIndex)));
 }
 
 LibraryView::~LibraryView() {}
@@ -683,6 +686,15 @@ void LibraryView::DeleteFinished(const SongList& songs_with_errors) {
   // It deletes itself when the user closes it
 }
 
+void LibraryView::ItemCollapsed(const QModelIndex& index) {
+  if (!app_) return;
+
+  // Don't bother finishing loading the children of an item nobody can see.
+  QSortFilterProxyModel* proxy = qobject_cast<QSortFilterProxyModel*>(model());
+  app_->library_model()->CancelLazyPopulate(
+      proxy ? proxy->mapToSource(index) : index);
+}
+
 void LibraryView::FilterReturnPressed() {
   if (!currentIndex().isValid()) {
     // Pick the first thing that isn't a divider
@@ -109,6 +109,7 @@ signals:
   void EditSmartPlaylistFinished();
 
   void DeleteFinished(const SongList& songs_with_errors);
+  void ItemCollapsed(const QModelIndex& index);
 
  private:
   void RecheckIsEmpty();
@@ -23,21 +23,29 @@
 #include "core/tagreaderclient.h"
 #include "core/taskmanager.h"
 #include "core/utilities.h"
+#include "core/workstealingqueue.h"
 #include "playlistparsers/cueparser.h"
 
 #include <QDateTime>
+#include <QDir>
 #include <QDirIterator>
+#include <QFuture>
 #include <QtDebug>
 #include <QThread>
-#include <QDateTime>
 #include <QHash>
 #include <QSet>
 #include <QSettings>
 #include <QTimer>
 
+#include <functional>
+
+#include <sys/stat.h>
+
 #include <fileref.h>
 #include <tag.h>
 
+#include "core/concurrentrun.h"
+
 // This is defined by one of the windows headers that is included by taglib.
 #ifdef RemoveDirectory
 #undef RemoveDirectory
@@ -46,6 +54,8 @@
 QStringList LibraryWatcher::sValidImages;
 
 const char* LibraryWatcher::kSettingsGroup = "LibraryWatcher";
+const int LibraryWatcher::kUnwatchedPollIntervalMsec = 5 * 60 * 1000;  // 5 min
+const int LibraryWatcher::kCheckpointIntervalMsec = 30 * 1000;  // 30 seconds
 
 LibraryWatcher::LibraryWatcher(QObject* parent)
     : QObject(parent),
@@ -57,6 +67,7 @@ LibraryWatcher::LibraryWatcher(QObject* parent)
       monitor_(true),
       rescan_timer_(new QTimer(this)),
       rescan_paused_(false),
+      unwatched_poll_timer_(new QTimer(this)),
       total_watches_(0),
       cue_parser_(new CueParser(backend_, this)) {
   Utilities::SetThreadIOPriority(Utilities::IOPRIO_CLASS_IDLE);
@@ -64,6 +75,13 @@ LibraryWatcher::LibraryWatcher(QObject* parent)
   rescan_timer_->setInterval(1000);
   rescan_timer_->setSingleShot(true);
 
+  unwatched_poll_timer_->setInterval(kUnwatchedPollIntervalMsec);
+
+  // Each scan thread gets its own database connection, so keep the threads
+  // around rather than letting the pool create new ones for every scan.
+  scan_thread_pool_.setMaxThreadCount(QThread::idealThreadCount());
+  scan_thread_pool_.setExpiryTimeout(-1);
+
   if (sValidImages.isEmpty()) {
     sValidImages << "jpg"
                  << "png"
@@ -74,12 +92,16 @@ LibraryWatcher::LibraryWatcher(QObject* parent)
   ReloadSettings();
 
   connect(rescan_timer_, SIGNAL(timeout()), SLOT(RescanPathsNow()));
+  connect(unwatched_poll_timer_, SIGNAL(timeout()),
+          SLOT(PollUnwatchedSubdirs()));
 }
 
 LibraryWatcher::ScanTransaction::ScanTransaction(LibraryWatcher* watcher,
                                                  int dir, bool incremental,
                                                  bool ignores_mtime)
-    : progress_(0),
+    : scan_queue_(nullptr),
+      checkpoints_(false),
+      progress_(0),
       progress_max_(0),
       dir_(dir),
       incremental_(incremental),
@@ -101,63 +123,172 @@ LibraryWatcher::ScanTransaction::~ScanTransaction() {
   // If we're stopping then don't commit the transaction
   if (watcher_->stop_requested_) return;
 
-  if (!new_songs.isEmpty()) emit watcher_->NewOrUpdatedSongs(new_songs);
-
-  if (!touched_songs.isEmpty()) emit watcher_->SongsMTimeUpdated(touched_songs);
+  Commit();
 
-  if (!deleted_songs.isEmpty()) emit watcher_->SongsDeleted(deleted_songs);
-
-  if (!readded_songs.isEmpty()) emit watcher_->SongsReadded(readded_songs);
-
-  if (!new_subdirs.isEmpty()) emit watcher_->SubdirsDiscovered(new_subdirs);
-
-  if (!touched_subdirs.isEmpty())
-    emit watcher_->SubdirsMTimeUpdated(touched_subdirs);
+  // The scan finished, so there's nothing to resume next time.
+  if (checkpoints_) emit watcher_->FullScanFinished(dir_);
 
   watcher_->task_manager_->SetTaskFinished(task_id_);
 
   if (watcher_->monitor_) {
     // Watch the new subdirectories
-    for (const Subdirectory& subdir : new_subdirs) {
+    for (const Subdirectory& subdir : committed_new_subdirs_) {
       watcher_->AddWatch(watcher_->watched_dirs_[dir_], subdir.path);
     }
   }
 }
 
+void LibraryWatcher::ScanTransaction::EnableCheckpoints(
+    const QStringList& finished_subdirs) {
+  QMutexLocker l(&mutex_);
+  checkpoints_ = true;
+  checkpoint_time_.start();
+
+  // A new scan records that it's started, so it gets resumed even if it's
+  // interrupted before the first checkpoint.
+  if (finished_subdirs.isEmpty())
+    emit watcher_->FullScanProgress(dir_, QStringList());
+}
+
+void LibraryWatcher::ScanTransaction::SubdirFinished(const QString& path) {
+  QMutexLocker l(&mutex_);
+  if (!checkpoints_) return;
+
+  finished_subdirs_ << path;
+  if (checkpoint_time_.elapsed() < kCheckpointIntervalMsec) return;
+
+  qLog(Debug) << "Checkpointing full scan after" << progress_ << "of"
+              << progress_max_ << "subdirectories";
+
+  // The songs go to the backend before the list of finished subdirectories,
+  // so a subdirectory is only skipped when the scan is resumed if its songs
+  // were saved.
+  Commit();
+  emit watcher_->FullScanProgress(dir_, finished_subdirs_);
+  finished_subdirs_.clear();
+  checkpoint_time_.restart();
+}
+
+void LibraryWatcher::ScanTransaction::Commit() {
+  if (!new_songs_.isEmpty()) emit watcher_->NewOrUpdatedSongs(new_songs_);
+
+  if (!touched_songs_.isEmpty())
+    emit watcher_->SongsMTimeUpdated(touched_songs_);
+
+  if (!moved_songs_.isEmpty()) emit watcher_->SongsMoved(moved_songs_);
+
+  // The scan of the old subdirectory thinks moved songs were deleted.  The
+  // move might have been found before an earlier checkpoint, so check all of
+  // them.  A song whose deletion was committed before its move was found is
+  // made available again by SongsMoved.
+  if (!moved_song_ids_.isEmpty()) {
+    SongList deleted_songs;
+    for (const Song& song : deleted_songs_) {
+      if (!moved_song_ids_.contains(song.id())) deleted_songs << song;
+    }
+    deleted_songs_ = deleted_songs;
+  }
+
+  if (!deleted_songs_.isEmpty()) emit watcher_->SongsDeleted(deleted_songs_);
+
+  if (!readded_songs_.isEmpty()) emit watcher_->SongsReadded(readded_songs_);
+
+  if (!new_subdirs_.isEmpty()) emit watcher_->SubdirsDiscovered(new_subdirs_);
+
+  if (!touched_subdirs_.isEmpty())
+    emit watcher_->SubdirsMTimeUpdated(touched_subdirs_);
+
+  committed_new_subdirs_ << new_subdirs_;
+
+  new_songs_.clear();
+  touched_songs_.clear();
+  moved_songs_.clear();
+  deleted_songs_.clear();
+  readded_songs_.clear();
+  new_subdirs_.clear();
+  touched_subdirs_.clear();
+}
+
 void LibraryWatcher::ScanTransaction::AddToProgress(int n) {
+  QMutexLocker l(&mutex_);
   progress_ += n;
   watcher_->task_manager_->SetTaskProgress(task_id_, progress_, progress_max_);
 }
 
 void LibraryWatcher::ScanTransaction::AddToProgressMax(int n) {
+  QMutexLocker l(&mutex_);
   progress_max_ += n;
   watcher_->task_manager_->SetTaskProgress(task_id_, progress_, progress_max_);
 }
 
+void LibraryWatcher::ScanTransaction::AddDeletedSong(const Song& song) {
+  QMutexLocker l(&mutex_);
+  deleted_songs_ << song;
+}
+
+void LibraryWatcher::ScanTransaction::AddReaddedSong(const Song& song) {
+  QMutexLocker l(&mutex_);
+  readded_songs_ << song;
+}
+
+void LibraryWatcher::ScanTransaction::AddNewSong(const Song& song) {
+  QMutexLocker l(&mutex_);
+  new_songs_ << song;
+}
+
+void LibraryWatcher::ScanTransaction::AddTouchedSong(const Song& song) {
+  QMutexLocker l(&mutex_);
+  touched_songs_ << song;
+}
+
+bool LibraryWatcher::ScanTransaction::AddMovedSong(const Song& song) {
+  QMutexLocker l(&mutex_);
+  if (moved_song_ids_.contains(song.id())) return false;
+
+  moved_song_ids_.insert(song.id());
+  moved_songs_ << song;
+  return true;
+}
+
+void LibraryWatcher::ScanTransaction::AddNewSubdir(
+    const Subdirectory& subdir) {
+  QMutexLocker l(&mutex_);
+  new_subdirs_ << subdir;
+}
+
+void LibraryWatcher::ScanTransaction::AddTouchedSubdir(
+    const Subdirectory& subdir) {
+  QMutexLocker l(&mutex_);
+  touched_subdirs_ << subdir;
+}
+
 SongList LibraryWatcher::ScanTransaction::FindSongsInSubdirectory(
     const QString& path) {
+  QMutexLocker l(&mutex_);
   if (cached_songs_dirty_) {
-    cached_songs_ = watcher_->backend_->FindSongsInDirectory(dir_);
+    cached_songs_.clear();
+    for (const Song& song : watcher_->backend_->FindSongsInDirectory(dir_)) {
+      cached_songs_[DirectoryPart(song.url().toLocalFile())] << song;
+    }
     cached_songs_dirty_ = false;
   }
 
-  // TODO: Make this faster
-  SongList ret;
-  for (const Song& song : cached_songs_) {
-    if (song.url().toLocalFile().section('/', 0, -2) == path) ret << song;
-  }
-  return ret;
+  return cached_songs_.value(path);
 }
 
 void LibraryWatcher::ScanTransaction::SetKnownSubdirs(
     const SubdirectoryList& subdirs) {
+  QMutexLocker l(&mutex_);
   known_subdirs_ = subdirs;
   known_subdirs_dirty_ = false;
 }
 
 bool LibraryWatcher::ScanTransaction::HasSeenSubdir(const QString& path) {
-  if (known_subdirs_dirty_)
-    SetKnownSubdirs(watcher_->backend_->SubdirsInDirectory(dir_));
+  QMutexLocker l(&mutex_);
+  if (known_subdirs_dirty_) {
+    known_subdirs_ = watcher_->backend_->SubdirsInDirectory(dir_);
+    known_subdirs_dirty_ = false;
+  }
 
   for (const Subdirectory& subdir : known_subdirs_) {
     if (subdir.path == path && subdir.mtime != 0) return true;
@@ -167,8 +298,11 @@ bool LibraryWatcher::ScanTransaction::HasSeenSubdir(const QString& path) {
 
 SubdirectoryList LibraryWatcher::ScanTransaction::GetImmediateSubdirs(
     const QString& path) {
-  if (known_subdirs_dirty_)
-    SetKnownSubdirs(watcher_->backend_->SubdirsInDirectory(dir_));
+  QMutexLocker l(&mutex_);
+  if (known_subdirs_dirty_) {
+    known_subdirs_ = watcher_->backend_->SubdirsInDirectory(dir_);
+    known_subdirs_dirty_ = false;
+  }
 
   SubdirectoryList ret;
   for (const Subdirectory& subdir : known_subdirs_) {
@@ -182,8 +316,11 @@ SubdirectoryList LibraryWatcher::ScanTransaction::GetImmediateSubdirs(
 }
 
 SubdirectoryList LibraryWatcher::ScanTransaction::GetAllSubdirs() {
-  if (known_subdirs_dirty_)
-    SetKnownSubdirs(watcher_->backend_->SubdirsInDirectory(dir_));
+  QMutexLocker l(&mutex_);
+  if (known_subdirs_dirty_) {
+    known_subdirs_ = watcher_->backend_->SubdirsInDirectory(dir_);
+    known_subdirs_dirty_ = false;
+  }
   return known_subdirs_;
 }
 
@@ -197,19 +334,34 @@ void LibraryWatcher::AddDirectory(const Directory& dir,
     ScanTransaction transaction(this, dir.id, false);
     transaction.SetKnownSubdirs(subdirs);
     transaction.AddToProgressMax(1);
-    ScanSubdirectory(dir.path, Subdirectory(), &transaction);
+    ScanSubdirectories(QList<ScanTask>() << ScanTask(dir.path, Subdirectory()),
+                       &transaction);
   } else {
-    // We can do an incremental scan - looking at the mtimes of each
-    // subdirectory and only rescan if the directory has changed.
-    ScanTransaction transaction(this, dir.id, true);
-    transaction.SetKnownSubdirs(subdirs);
-    transaction.AddToProgressMax(subdirs.count());
-    for (const Subdirectory& subdir : subdirs) {
-      if (stop_requested_) return;
-
-      if (scan_on_startup_) ScanSubdirectory(subdir.path, subdir, &transaction);
+    if (scan_on_startup_ && backend_->GetFullScanProgress(dir.id)) {
+      // A full scan of this directory was interrupted last time, so carry on
+      // with it instead.
+      ScanDirectory(dir, false, true);
+    } else {
+      // We can do an incremental scan - looking at the mtimes of each
+      // subdirectory and only rescan if the directory has changed.
+      ScanTransaction transaction(this, dir.id, true);
+      transaction.SetKnownSubdirs(subdirs);
+
+      if (scan_on_startup_) {
+        QList<ScanTask> tasks;
+        for (const Subdirectory& subdir : subdirs) {
+          tasks << ScanTask(subdir.path, subdir);
+        }
+        transaction.AddToProgressMax(tasks.count());
+        ScanSubdirectories(tasks, &transaction);
+      }
+    }
 
-      if (monitor_) AddWatch(dir, subdir.path);
+    if (monitor_) {
+      for (const Subdirectory& subdir : subdirs) {
+        if (stop_requested_) return;
+        AddWatch(dir, subdir.path);
+      }
     }
   }
 
@@ -225,7 +377,8 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
   // Do not scan symlinked dirs that are already in collection
   if (path_info.isSymLink()) {
     QString real_path = path_info.symLinkTarget();
-    for (const Directory& dir : watched_dirs_) {
+    const QMap<int, Directory>& watched_dirs = watched_dirs_;
+    for (const Directory& dir : watched_dirs) {
       if (real_path.startsWith(dir.path)) {
         t->AddToProgress(1);
         return;
@@ -251,7 +404,7 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
   for (const Subdirectory& subdir : previous_subdirs) {
     if (!QFile::exists(subdir.path) && subdir.path != path) {
       t->AddToProgressMax(1);
-      ScanSubdirectory(subdir.path, subdir, t, true);
+      QueueSubdirectory(ScanTask(subdir.path, subdir, true), t);
     }
   }
 
@@ -291,9 +444,47 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
   if (stop_requested_) return;
 
   // Ask the database for a list of files in this directory
-  SongList songs_in_db = t->FindSongsInSubdirectory(path);
+  const SongPathIndex songs_in_db =
+      IndexSongsByPath(t->FindSongsInSubdirectory(path));
+
+  UpdateFiles(path, files_on_disk, songs_in_db, album_art, t);
+
+  if (stop_requested_) return;
+
+  // Add this subdir to the new or touched list
+  Subdirectory updated_subdir;
+  updated_subdir.directory_id = t->dir();
+  updated_subdir.mtime =
+      path_info.exists() ? path_info.lastModified().toTime_t() : 0;
+  updated_subdir.path = path;
+
+  if (subdir.directory_id == -1)
+    t->AddNewSubdir(updated_subdir);
+  else
+    t->AddTouchedSubdir(updated_subdir);
+
+  t->AddToProgress(1);
+  t->SubdirFinished(path);
+
+  // Recurse into the new subdirs that we found
+  t->AddToProgressMax(my_new_subdirs.count());
+  for (const Subdirectory& my_new_subdir : my_new_subdirs) {
+    if (stop_requested_) return;
+    QueueSubdirectory(ScanTask(my_new_subdir.path, my_new_subdir, true), t);
+  }
+}
+
+void LibraryWatcher::UpdateFiles(const QString& path,
+                                 const QStringList& files_on_disk,
+                                 const SongPathIndex& songs_in_db,
+                                 QMap<QString, QStringList>& album_art,
+                                 ScanTransaction* t) {
+  // Files that have disappeared since we listed the directory are removed from
+  // here, so their songs are treated as deleted.
+  QSet<QString> files_still_on_disk = files_on_disk.toSet();
 
   QSet<QString> cues_processed;
+  PendingTagReadList pending_reads;
 
   // Now compare the list from the database with the list of files on disk
   for (const QString& file : files_on_disk) {
@@ -302,8 +493,11 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
     // associated cue
     QString matching_cue = NoExtensionPart(file) + ".cue";
 
-    Song matching_song;
-    if (FindSongByPath(songs_in_db, file, &matching_song)) {
+    SongPathIndex::const_iterator it = songs_in_db.constFind(file);
+    if (it != songs_in_db.constEnd()) {
+      // If there's more than one song for this file they are sections of a
+      // cue sheet - any one of them will do.
+      const Song matching_song = it.value().first();
       uint matching_cue_mtime = GetMtimeForCue(matching_cue);
 
       // The song is in the database and still on disk.
@@ -313,7 +507,7 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
       if (!file_info.exists()) {
         // Partially fixes race condition - if file was removed between being
         // added to the list and now.
-        files_on_disk.removeAll(file);
+        files_still_on_disk.remove(file);
         continue;
       }
 
@@ -350,63 +544,137 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
           // if no cue or it's about to lose it...
         } else {
           UpdateNonCueAssociatedSong(file, matching_song, image, cue_deleted,
-                                     t);
+                                     t, &pending_reads);
         }
       }
 
       // nothing has changed - mark the song available without re-scanning
-      if (matching_song.is_unavailable()) t->readded_songs << matching_song;
+      if (matching_song.is_unavailable()) t->AddReaddedSong(matching_song);
 
     } else {
-      // The song is on disk but not in the DB
-      SongList song_list =
-          ScanNewFile(file, path, matching_cue, &cues_processed);
-
-      if (song_list.isEmpty()) {
-        continue;
+      // The song is on disk but not in the DB - either it's new or it was
+      // moved here from somewhere else.
+      if (!FindMovedSong(file, matching_cue, album_art, t)) {
+        QueueNewFile(file, path, matching_cue, &cues_processed,
+                     &pending_reads);
       }
+    }
+  }
 
-      qLog(Debug) << file << "created";
-      // choose an image for the song(s)
-      QString image = ImageForSong(file, album_art);
+  if (stop_requested_) return;
 
-      for (Song song : song_list) {
-        song.set_directory_id(t->dir());
-        if (song.art_automatic().isEmpty()) song.set_art_automatic(image);
+  ReadPendingFiles(pending_reads, album_art, t);
 
-        t->new_songs << song;
+  // Look for deleted songs
+  for (SongPathIndex::const_iterator it = songs_in_db.constBegin();
+       it != songs_in_db.constEnd(); ++it) {
+    if (files_still_on_disk.contains(it.key())) continue;
+
+    for (const Song& song : it.value()) {
+      if (!song.is_unavailable()) {
+        qLog(Debug) << "Song deleted from disk:" << it.key();
+        t->AddDeletedSong(song);
       }
     }
   }
+}
 
-  // Look for deleted songs
-  for (const Song& song : songs_in_db) {
-    if (!song.is_unavailable() &&
-        !files_on_disk.contains(song.url().toLocalFile())) {
-      qLog(Debug) << "Song deleted from disk:" << song.url().toLocalFile();
-      t->deleted_songs << song;
-    }
+void LibraryWatcher::ScanChangedFiles(const QString& path,
+                                      const Subdirectory& subdir,
+                                      const QStringList& files,
+                                      ScanTransaction* t) {
+  QStringList files_on_disk;
+  for (const QString& file : files) {
+    QFileInfo file_info(file);
+    if (file_info.isFile() && !file_info.isHidden()) files_on_disk << file;
   }
 
-  // Add this subdir to the new or touched list
+  // Only compare the songs for the changed files - the rest of the
+  // subdirectory is left alone.
+  SongPathIndex songs_in_db =
+      IndexSongsByPath(t->FindSongsInSubdirectory(path));
+  const QSet<QString> changed_files = files.toSet();
+  for (SongPathIndex::iterator it = songs_in_db.begin();
+       it != songs_in_db.end();) {
+    if (changed_files.contains(it.key()))
+      ++it;
+    else
+      it = songs_in_db.erase(it);
+  }
+
+  // New songs still need the subdirectory's album art.
+  QStringList image_filters;
+  for (const QString& ext : sValidImages) {
+    image_filters << "*." + ext;
+  }
+  QMap<QString, QStringList> album_art;
+  for (const QString& image :
+       QDir(path).entryList(image_filters, QDir::Files)) {
+    album_art[path] << path + "/" + image;
+  }
+
+  UpdateFiles(path, files_on_disk, songs_in_db, album_art, t);
+
+  if (stop_requested_) return;
+
+  // Update the subdir's mtime so the next incremental scan doesn't look at it
+  // again.
+  QFileInfo path_info(path);
   Subdirectory updated_subdir;
   updated_subdir.directory_id = t->dir();
   updated_subdir.mtime =
       path_info.exists() ? path_info.lastModified().toTime_t() : 0;
   updated_subdir.path = path;
-
-  if (subdir.directory_id == -1)
-    t->new_subdirs << updated_subdir;
-  else
-    t->touched_subdirs << updated_subdir;
+  t->AddTouchedSubdir(updated_subdir);
 
   t->AddToProgress(1);
+}
 
-  // Recurse into the new subdirs that we found
-  t->AddToProgressMax(my_new_subdirs.count());
-  for (const Subdirectory& my_new_subdir : my_new_subdirs) {
-    if (stop_requested_) return;
-    ScanSubdirectory(my_new_subdir.path, my_new_subdir, t, true);
+void LibraryWatcher::ScanSubdirectories(const QList<ScanTask>& tasks,
+                                        ScanTransaction* t) {
+  ScanQueue queue(scan_thread_pool_.maxThreadCount());
+  for (const ScanTask& task : tasks) {
+    queue.Push(task);
+  }
+
+  t->set_scan_queue(&queue);
+
+  QList<QFuture<void>> futures;
+  for (int i = 0; i < queue.thread_count(); ++i) {
+    futures << ConcurrentRun::Run<void>(
+                   &scan_thread_pool_,
+                   std::bind(&LibraryWatcher::ScanThreadMain, this, &queue, t));
+  }
+
+  for (QFuture<void> future : futures) {
+    future.waitForFinished();
+  }
+
+  t->set_scan_queue(nullptr);
+}
+
+void LibraryWatcher::QueueSubdirectory(const ScanTask& task,
+                                       ScanTransaction* t) {
+  if (t->scan_queue()) {
+    t->scan_queue()->Push(task);
+  } else {
+    ScanSubdirectory(task.path, task.subdir, t, task.force_noincremental);
+  }
+}
+
+void LibraryWatcher::ScanThreadMain(ScanQueue* queue, ScanTransaction* t) {
+  Utilities::SetThreadIOPriority(Utilities::IOPRIO_CLASS_IDLE);
+
+  ScanTask task;
+  while (queue->Pop(&task)) {
+    if (stop_requested_) {
+      queue->Abort();
+    } else if (!task.files.isEmpty()) {
+      ScanChangedFiles(task.path, task.subdir, task.files, t);
+    } else {
+      ScanSubdirectory(task.path, task.subdir, t, task.force_noincremental);
+    }
+    queue->TaskDone();
   }
 }
 
@@ -434,7 +702,7 @@ void LibraryWatcher::UpdateCueAssociatedSongs(const QString& file,
     Song matching = sections_map[cue_song.beginning_nanosec()];
     // a new section
     if (!matching.is_valid()) {
-      t->new_songs << cue_song;
+      t->AddNewSong(cue_song);
       // changed section
     } else {
       PreserveUserSetData(file, image, matching, &cue_song, t);
@@ -445,16 +713,14 @@ void LibraryWatcher::UpdateCueAssociatedSongs(const QString& file,
   // sections that are now missing
   for (const Song& matching : old_sections) {
     if (!used_ids.contains(matching.id())) {
-      t->deleted_songs << matching;
+      t->AddDeletedSong(matching);
     }
   }
 }
 
-void LibraryWatcher::UpdateNonCueAssociatedSong(const QString& file,
-                                                const Song& matching_song,
-                                                const QString& image,
-                                                bool cue_deleted,
-                                                ScanTransaction* t) {
+void LibraryWatcher::UpdateNonCueAssociatedSong(
+    const QString& file, const Song& matching_song, const QString& image,
+    bool cue_deleted, ScanTransaction* t, PendingTagReadList* pending_reads) {
   // if a cue got deleted, we turn it's first section into the new
   // 'raw' (cueless) song and we just remove the rest of the sections
   // from the library
@@ -462,60 +728,151 @@ void LibraryWatcher::UpdateNonCueAssociatedSong(const QString& file,
     for (const Song& song :
          backend_->GetSongsByUrl(QUrl::fromLocalFile(file))) {
       if (!song.IsMetadataEqual(matching_song)) {
-        t->deleted_songs << song;
+        t->AddDeletedSong(song);
+      }
+    }
+  }
+
+  *pending_reads << PendingTagRead(file, image, matching_song);
+}
+
+void LibraryWatcher::ReadPendingFiles(const PendingTagReadList& pending_reads,
+                                      QMap<QString, QStringList>& album_art,
+                                      ScanTransaction* t) {
+  if (pending_reads.isEmpty()) return;
+
+  QStringList filenames;
+  for (const PendingTagRead& pending : pending_reads) {
+    filenames << pending.file;
+  }
+
+  SongList songs_on_disk;
+  TagReaderClient::Instance()->ReadFilesBlocking(filenames, &songs_on_disk);
+
+  for (int i = 0; i < pending_reads.count() && i < songs_on_disk.count();
+       ++i) {
+    const PendingTagRead& pending = pending_reads[i];
+    Song song = songs_on_disk[i];
+    if (!song.is_valid()) continue;
+
+    song.set_directory_id(t->dir());
+
+    if (pending.matching_song.is_valid()) {
+      PreserveUserSetData(pending.file, pending.image, pending.matching_song,
+                          &song, t);
+    } else {
+      qLog(Debug) << pending.file << "created";
+      // choose an image for the song(s)
+      const QString image = ImageForSong(pending.file, album_art);
+
+      // A cue sheet's sections replace the file's own tags.
+      const SongList new_songs =
+          pending.cue_songs.isEmpty() ? SongList() << song : pending.cue_songs;
+      for (Song new_song : new_songs) {
+        new_song.set_directory_id(t->dir());
+        if (new_song.art_automatic().isEmpty())
+          new_song.set_art_automatic(image);
+
+        t->AddNewSong(new_song);
       }
     }
   }
+}
+
+bool LibraryWatcher::FindMovedSong(const QString& file,
+                                   const QString& matching_cue,
+                                   QMap<QString, QStringList>& album_art,
+                                   ScanTransaction* t) {
+  // Files with cue sheets have several songs in the library - they're just
+  // read again.
+  if (GetMtimeForCue(matching_cue)) return false;
+
+  const QFileInfo file_info(file);
+  qint64 inode = -1;
+#ifndef Q_OS_WIN32
+  struct stat stat_buf;
+  if (stat(QFile::encodeName(file).constData(), &stat_buf) == 0) {
+    inode = stat_buf.st_ino;
+  }
+#endif
+
+  for (Song song : backend_->GetSongsBySizeAndMTime(
+           file_info.size(), file_info.lastModified().toTime_t())) {
+    if (song.has_cue()) continue;
+
+    // If the old file is still there this is a copy, not a move.
+    const QString old_file = song.url().toLocalFile();
+    if (old_file == file || QFile::exists(old_file)) continue;
+
+    // Songs added before we stored inodes, or files moved to another
+    // filesystem, can still be matched if the file kept its name.
+    // A file with the same name is only a move if the old one really went
+    // away, and didn't just disappear with an unmounted filesystem.
+    const bool same_inode = inode != -1 && song.inode() == inode;
+    const bool same_name = song.basefilename() == file_info.fileName();
+    if (!same_inode && !(same_name && IsLocationAvailable(old_file))) continue;
+
+    song.set_url(QUrl::fromLocalFile(file));
+    song.set_basefilename(file_info.fileName());
+    song.set_directory_id(t->dir());
+    song.set_inode(inode);
+    song.set_unavailable(false);
+    if (!song.has_embedded_cover()) {
+      song.set_art_automatic(ImageForSong(file, album_art));
+    }
+
+    if (!t->AddMovedSong(song)) continue;
+
+    qLog(Debug) << old_file << "moved to" << file;
+    return true;
+  }
 
-  Song song_on_disk;
-  song_on_disk.set_directory_id(t->dir());
-  TagReaderClient::Instance()->ReadFileBlocking(file, &song_on_disk);
+  return false;
+}
 
-  if (song_on_disk.is_valid()) {
-    PreserveUserSetData(file, image, matching_song, &song_on_disk, t);
+bool LibraryWatcher::IsLocationAvailable(const QString& file) {
+  QString path = QFileInfo(file).absolutePath();
+  while (!QFileInfo(path).isDir()) {
+    const QString parent = QFileInfo(path).absolutePath();
+    if (parent == path) return false;
+    path = parent;
   }
+  return !QDir(path).entryList(QDir::AllEntries | QDir::NoDotAndDotDot |
+                               QDir::Hidden | QDir::System).isEmpty();
 }
 
-SongList LibraryWatcher::ScanNewFile(const QString& file, const QString& path,
-                                     const QString& matching_cue,
-                                     QSet<QString>* cues_processed) {
-  SongList song_list;
+void LibraryWatcher::QueueNewFile(const QString& file, const QString& path,
+                                  const QString& matching_cue,
+                                  QSet<QString>* cues_processed,
+                                  PendingTagReadList* pending_reads) {
+  PendingTagRead pending(file, QString(), Song());
 
   uint matching_cue_mtime = GetMtimeForCue(matching_cue);
   // if it's a cue - create virtual tracks
   if (matching_cue_mtime) {
     // don't process the same cue many times
-    if (cues_processed->contains(matching_cue)) return song_list;
+    if (cues_processed->contains(matching_cue)) return;
 
     QFile cue(matching_cue);
     cue.open(QIODevice::ReadOnly);
 
-    // Ignore FILEs pointing to other media files. Also, watch out for incorrect
-    // media files. Playlist parser for CUEs considers every entry in sheet
-    // valid and we don't want invalid media getting into library!
+    // Ignore FILEs pointing to other media files.
     for (const Song& cue_song : cue_parser_->Load(&cue, matching_cue, path)) {
       if (cue_song.url().toLocalFile() == file) {
-        if (TagReaderClient::Instance()->IsMediaFileBlocking(file)) {
-          song_list << cue_song;
-        }
+        pending.cue_songs << cue_song;
       }
     }
 
-    if (!song_list.isEmpty()) {
-      *cues_processed << matching_cue;
-    }
+    if (pending.cue_songs.isEmpty()) return;
 
-    // it's a normal media file
-  } else {
-    Song song;
-    TagReaderClient::Instance()->ReadFileBlocking(file, &song);
-
-    if (song.is_valid()) {
-      song_list << song;
-    }
+    *cues_processed << matching_cue;
   }
 
-  return song_list;
+  // Read it later along with the rest of the directory.  Even if it has a cue
+  // sheet we still need to read the file: the playlist parser for CUEs
+  // considers every entry in the sheet valid and we don't want invalid media
+  // getting into the library!
+  *pending_reads << pending;
 }
 
 void LibraryWatcher::PreserveUserSetData(const QString& file,
@@ -536,15 +893,15 @@ void LibraryWatcher::PreserveUserSetData(const QString& file,
   if (matching_song.is_unavailable()) {
     qLog(Debug) << file << " unavailable song restored";
 
-    t->new_songs << *out;
+    t->AddNewSong(*out);
   } else if (!matching_song.IsMetadataEqual(*out)) {
     qLog(Debug) << file << "metadata changed";
 
     // Update the song in the DB
-    t->new_songs << *out;
+    t->AddNewSong(*out);
   } else {
     // Only the mtime's changed
-    t->touched_songs << *out;
+    t->AddTouchedSong(*out);
   }
 }
 
@@ -569,12 +926,21 @@ void LibraryWatcher::AddWatch(const Directory& dir, const QString& path) {
 
   connect(fs_watcher_, SIGNAL(PathChanged(const QString&)), this,
           SLOT(DirectoryChanged(const QString&)), Qt::UniqueConnection);
+  connect(fs_watcher_, SIGNAL(FilesChanged(const QString&, const QStringList&)),
+          this, SLOT(FilesChanged(const QString&, const QStringList&)),
+          Qt::UniqueConnection);
+  connect(fs_watcher_, SIGNAL(PathNotWatched(const QString&)), this,
+          SLOT(PathNotWatched(const QString&)), Qt::UniqueConnection);
+  connect(fs_watcher_, SIGNAL(EventsLost()), this, SLOT(IncrementalScanNow()),
+          Qt::UniqueConnection);
   fs_watcher_->AddPath(path);
   subdir_mapping_[path] = dir;
 }
 
 void LibraryWatcher::RemoveDirectory(const Directory& dir) {
   rescan_queue_.remove(dir.id);
+  rescan_file_queue_.remove(dir.id);
+  unwatched_subdirs_.remove(dir.id);
   watched_dirs_.remove(dir.id);
 
   // Stop watching the directory's subdirectories
@@ -584,16 +950,14 @@ void LibraryWatcher::RemoveDirectory(const Directory& dir) {
   }
 }
 
-bool LibraryWatcher::FindSongByPath(const SongList& list, const QString& path,
-                                    Song* out) {
-  // TODO: Make this faster
+LibraryWatcher::SongPathIndex LibraryWatcher::IndexSongsByPath(
+    const SongList& list) {
+  SongPathIndex ret;
+  ret.reserve(list.count());
   for (const Song& song : list) {
-    if (song.url().toLocalFile() == path) {
-      *out = song;
-      return true;
-    }
+    ret[song.url().toLocalFile()] << song;
   }
-  return false;
+  return ret;
 }
 
 void LibraryWatcher::DirectoryChanged(const QString& subdir) {
@@ -614,23 +978,114 @@ void LibraryWatcher::DirectoryChanged(const QString& subdir) {
   if (!rescan_paused_) rescan_timer_->start();
 }
 
+void LibraryWatcher::FilesChanged(const QString& subdir,
+                                  const QStringList& files) {
+  QHash<QString, Directory>::const_iterator it =
+      subdir_mapping_.constFind(subdir);
+  if (it == subdir_mapping_.constEnd()) {
+    return;
+  }
+  const Directory& dir = *it;
+
+  // Album art and cue sheets affect the other songs in the directory, so those
+  // still need the whole subdirectory rescanned.
+  for (const QString& file : files) {
+    const QString ext_part(ExtensionPart(file));
+    if (ext_part == "cue" || sValidImages.contains(ext_part)) {
+      DirectoryChanged(subdir);
+      return;
+    }
+  }
+
+  qLog(Debug) << files.count() << "files changed in subdir" << subdir
+              << "under directory" << dir.path << "id" << dir.id;
+
+  rescan_file_queue_[dir.id][subdir].unite(files.toSet());
+
+  if (!rescan_paused_) rescan_timer_->start();
+}
+
+void LibraryWatcher::PathNotWatched(const QString& subdir) {
+  QHash<QString, Directory>::const_iterator it =
+      subdir_mapping_.constFind(subdir);
+  if (it == subdir_mapping_.constEnd()) {
+    return;
+  }
+
+  unwatched_subdirs_[it->id].insert(subdir);
+  if (!unwatched_poll_timer_->isActive()) unwatched_poll_timer_->start();
+}
+
+void LibraryWatcher::PollUnwatchedSubdirs() {
+  if (rescan_paused_) return;
+
+  for (int dir : unwatched_subdirs_.keys()) {
+    if (stop_requested_) return;
+
+    // Only start a transaction if something actually changed, so we don't
+    // show a task in the UI every few minutes.
+    const QSet<QString>& unwatched = unwatched_subdirs_[dir];
+    const SubdirectoryList subdirs = backend_->SubdirsInDirectory(dir);
+    QList<ScanTask> tasks;
+    for (const Subdirectory& subdir : subdirs) {
+      if (unwatched.contains(subdir.path) &&
+          QFileInfo(subdir.path).lastModified().toTime_t() != subdir.mtime) {
+        tasks << ScanTask(subdir.path, subdir);
+      }
+    }
+    if (tasks.isEmpty()) continue;
+
+    ScanTransaction transaction(this, dir, true);
+    transaction.SetKnownSubdirs(subdirs);
+    transaction.AddToProgressMax(tasks.count());
+    ScanSubdirectories(tasks, &transaction);
+  }
+
+  emit CompilationsNeedUpdating();
+}
+
 void LibraryWatcher::RescanPathsNow() {
-  for (int dir : rescan_queue_.keys()) {
+  QSet<int> dirs = rescan_queue_.keys().toSet();
+  dirs.unite(rescan_file_queue_.keys().toSet());
+
+  for (int dir : dirs) {
     if (stop_requested_) return;
     ScanTransaction transaction(this, dir, false);
-    transaction.AddToProgressMax(rescan_queue_[dir].count());
 
-    for (const QString& path : rescan_queue_[dir]) {
-      if (stop_requested_) return;
+    const QStringList paths = rescan_queue_.value(dir);
+    const QMap<QString, QSet<QString> > files = rescan_file_queue_.value(dir);
+
+    QList<ScanTask> tasks;
+    for (const QString& path : paths) {
       Subdirectory subdir;
       subdir.directory_id = dir;
       subdir.mtime = 0;
       subdir.path = path;
-      ScanSubdirectory(path, subdir, &transaction);
+      tasks << ScanTask(path, subdir);
     }
+
+    // Subdirectories that are being rescanned anyway don't need their files
+    // looked at separately.
+    for (QMap<QString, QSet<QString> >::const_iterator it = files.constBegin();
+         it != files.constEnd(); ++it) {
+      if (paths.contains(it.key())) continue;
+
+      Subdirectory subdir;
+      subdir.directory_id = dir;
+      subdir.mtime = 0;
+      subdir.path = it.key();
+
+      ScanTask task(it.key(), subdir);
+      task.files = it.value().toList();
+      tasks << task;
+    }
+
+    transaction.AddToProgressMax(tasks.count());
+    ScanSubdirectories(tasks, &transaction);
   }
 
   rescan_queue_.clear();
+  rescan_file_queue_.clear();
 
   emit CompilationsNeedUpdating();
 }
@@ -719,6 +1174,8 @@ void LibraryWatcher::ReloadSettings() {
 
   if (!monitor_ && was_monitoring_before) {
     fs_watcher_->Clear();
+    unwatched_subdirs_.clear();
+    unwatched_poll_timer_->stop();
   } else if (monitor_ && !was_monitoring_before) {
     // Add all directories to all QFileSystemWatchers again
     for (const Directory& dir : watched_dirs_.values()) {
@@ -737,7 +1194,9 @@ void LibraryWatcher::SetRescanPausedAsync(bool pause) {
 
 void LibraryWatcher::SetRescanPaused(bool pause) {
   rescan_paused_ = pause;
-  if (!rescan_paused_ && !rescan_queue_.isEmpty()) RescanPathsNow();
+  if (!rescan_paused_ &&
+      (!rescan_queue_.isEmpty() || !rescan_file_queue_.isEmpty()))
+    RescanPathsNow();
 }
 
 void LibraryWatcher::IncrementalScanAsync() {
@@ -754,16 +1213,43 @@ void LibraryWatcher::FullScanNow() { PerformScan(false, true); }
 
 void LibraryWatcher::PerformScan(bool incremental, bool ignore_mtimes) {
   for (const Directory& dir : watched_dirs_.values()) {
-    ScanTransaction transaction(this, dir.id, incremental, ignore_mtimes);
-    SubdirectoryList subdirs(transaction.GetAllSubdirs());
-    transaction.AddToProgressMax(subdirs.count());
+    if (stop_requested_) return;
+    ScanDirectory(dir, incremental, ignore_mtimes);
+  }
 
-    for (const Subdirectory& subdir : subdirs) {
-      if (stop_requested_) return;
+  emit CompilationsNeedUpdating();
+}
 
-      ScanSubdirectory(subdir.path, subdir, &transaction);
+void LibraryWatcher::ScanDirectory(const Directory& dir, bool incremental,
+                                   bool ignore_mtimes) {
+  ScanTransaction transaction(this, dir.id, incremental, ignore_mtimes);
+  SubdirectoryList subdirs(transaction.GetAllSubdirs());
+  transaction.AddToProgressMax(subdirs.count());
+
+  // Full scans can take hours, so they're checkpointed.  If one was
+  // interrupted skip the subdirectories it had already finished.  Devices
+  // can't resume scans, and their backends delete songs for real, so a
+  // checkpoint could delete a song before the scan finds where it moved to.
+  QSet<QString> finished_subdirs;
+  if (ignore_mtimes && backend_->can_resume_full_scans()) {
+    QStringList finished;
+    backend_->GetFullScanProgress(dir.id, &finished);
+    transaction.EnableCheckpoints(finished);
+    finished_subdirs = finished.toSet();
+
+    if (!finished_subdirs.isEmpty()) {
+      qLog(Info) << "Resuming full scan of" << dir.path << "-"
+                 << finished_subdirs.count() << "subdirectories already done";
     }
   }
 
-  emit CompilationsNeedUpdating();
+  QList<ScanTask> tasks;
+  for (const Subdirectory& subdir : subdirs) {
+    if (finished_subdirs.contains(subdir.path)) {
+      transaction.AddToProgress(1);
+    } else {
+      tasks << ScanTask(subdir.path, subdir);
+    }
+  }
+  ScanSubdirectories(tasks, &transaction);
 }
@@ -22,9 +22,13 @@
 #include "core/song.h"
 
 #include <QHash>
+#include <QMutex>
+#include <QSet>
 #include <QObject>
 #include <QStringList>
 #include <QMap>
+#include <QThreadPool>
+#include <QTime>
 
 class QFileSystemWatcher;
 class QTimer;
@@ -34,6 +38,9 @@ class FileSystemWatcherInterface;
 class LibraryBackend;
 class TaskManager;
 
+template <typename T>
+class WorkStealingQueue;
+
 class LibraryWatcher : public QObject {
   Q_OBJECT
 
@@ -60,12 +67,16 @@ class LibraryWatcher : public QObject {
 signals:
   void NewOrUpdatedSongs(const SongList& songs);
   void SongsMTimeUpdated(const SongList& songs);
+  void SongsMoved(const SongList& songs);
   void SongsDeleted(const SongList& songs);
   void SongsReadded(const SongList& songs, bool unavailable = false);
   void SubdirsDiscovered(const SubdirectoryList& subdirs);
   void SubdirsMTimeUpdated(const SubdirectoryList& subdirs);
   void CompilationsNeedUpdating();
 
+  void FullScanProgress(int directory, const QStringList& finished_subdirs);
+  void FullScanFinished(int directory);
+
   void ScanStarted(int task_id);
 
  public slots:
@@ -75,15 +86,34 @@ signals:
   void SetRescanPaused(bool pause);
 
  private:
+  // A subdirectory waiting to be scanned by one of the scan threads.  If files
+  // isn't empty only those files in the subdirectory are scanned.
+  struct ScanTask {
+    ScanTask() : force_noincremental(false) {}
+    ScanTask(const QString& _path, const Subdirectory& _subdir,
+             bool _force_noincremental = false)
+        : path(_path),
+          subdir(_subdir),
+          force_noincremental(_force_noincremental) {}
+
+    QString path;
+    Subdirectory subdir;
+    bool force_noincremental;
+    QStringList files;
+  };
+  typedef WorkStealingQueue<ScanTask> ScanQueue;
+
   // This class encapsulates a full or partial scan of a directory.
   // Each directory has one or more subdirectories, and any number of
   // subdirectories can be scanned during one transaction.  ScanSubdirectory()
   // adds its results to the members of this transaction class, and they are
   // "committed" through calls to the LibraryBackend in the transaction's dtor.
   // The transaction also caches the list of songs in this directory according
-  // to the library.  Multiple calls to FindSongsInSubdirectory during one
-  // transaction will only result in one call to
-  // LibraryBackend::FindSongsInDirectory.
+  // to the library, indexed by subdirectory.  Multiple calls to
+  // FindSongsInSubdirectory during one transaction will only result in one
+  // call to LibraryBackend::FindSongsInDirectory.
+  // Subdirectories are scanned on several threads at once, so all the public
+  // methods are thread-safe.
   class ScanTransaction {
    public:
     ScanTransaction(LibraryWatcher* watcher, int dir, bool incremental,
@@ -99,21 +129,61 @@ signals:
     void AddToProgress(int n = 1);
     void AddToProgressMax(int n);
 
+    void AddDeletedSong(const Song& song);
+    void AddReaddedSong(const Song& song);
+    void AddNewSong(const Song& song);
+    void AddTouchedSong(const Song& song);
+    // Returns false if the song has already been moved somewhere else in this
+    // transaction.
+    bool AddMovedSong(const Song& song);
+    void AddNewSubdir(const Subdirectory& subdir);
+    void AddTouchedSubdir(const Subdirectory& subdir);
+
+    // Makes the transaction commit what it's got so far every
+    // kCheckpointIntervalMsec, along with the subdirectories it's finished.
+    // If the scan is interrupted it can be resumed from there next time.
+    // finished_subdirs are the ones an earlier, interrupted, scan got through.
+    void EnableCheckpoints(const QStringList& finished_subdirs);
+    void SubdirFinished(const QString& path);
+
     int dir() const { return dir_; }
     bool is_incremental() const { return incremental_; }
     bool ignores_mtime() const { return ignores_mtime_; }
 
-    SongList deleted_songs;
-    SongList readded_songs;
-    SongList new_songs;
-    SongList touched_songs;
-    SubdirectoryList new_subdirs;
-    SubdirectoryList touched_subdirs;
+    // Set while the transaction's subdirectories are being scanned in
+    // parallel.  Subdirectories found during the scan are pushed onto this
+    // queue instead of being scanned recursively.
+    ScanQueue* scan_queue() const { return scan_queue_; }
+    void set_scan_queue(ScanQueue* queue) { scan_queue_ = queue; }
 
    private:
     ScanTransaction(const ScanTransaction&) {}
     ScanTransaction& operator=(const ScanTransaction&) { return *this; }
 
+    // Sends everything found so far to the backend.  Must be called with
+    // mutex_ held, or from the destructor.
+    void Commit();
+
+    QMutex mutex_;
+
+    SongList deleted_songs_;
+    SongList readded_songs_;
+    SongList new_songs_;
+    SongList touched_songs_;
+    SongList moved_songs_;
+    QSet<int> moved_song_ids_;
+    SubdirectoryList new_subdirs_;
+    SubdirectoryList touched_subdirs_;
+    // New subdirectories that have already been committed, to be watched once
+    // the scan is finished.
+    SubdirectoryList committed_new_subdirs_;
+
+    ScanQueue* scan_queue_;
+
+    bool checkpoints_;
+    QTime checkpoint_time_;
+    QStringList finished_subdirs_;
+
     int task_id_;
     int progress_;
     int progress_max_;
@@ -130,7 +200,8 @@ signals:
 
     LibraryWatcher* watcher_;
 
-    SongList cached_songs_;
+    // Subdirectory path -> songs directly inside it.
+    QHash<QString, SongList> cached_songs_;
     bool cached_songs_dirty_;
 
     SubdirectoryList known_subdirs_;
@@ -139,24 +210,69 @@ signals:
 
  private slots:
   void DirectoryChanged(const QString& path);
+  void FilesChanged(const QString& path, const QStringList& files);
+  void PathNotWatched(const QString& path);
+  void PollUnwatchedSubdirs();
   void IncrementalScanNow();
   void FullScanNow();
   void RescanPathsNow();
   void ScanSubdirectory(const QString& path, const Subdirectory& subdir,
                         ScanTransaction* t, bool force_noincremental = false);
+  // Rescans only some of the files in a subdirectory, after the filesystem
+  // watcher told us they changed.
+  void ScanChangedFiles(const QString& path, const Subdirectory& subdir,
+                        const QStringList& files, ScanTransaction* t);
 
  private:
-  static bool FindSongByPath(const SongList& list, const QString& path,
-                             Song* out);
+  // A file whose tags need to be read from disk.  These are collected for a
+  // whole subdirectory and then read with a single call to
+  // TagReaderClient::ReadFilesBlocking.
+  struct PendingTagRead {
+    PendingTagRead() {}
+    PendingTagRead(const QString& _file, const QString& _image,
+                   const Song& _matching_song)
+        : file(_file), image(_image), matching_song(_matching_song) {}
+
+    QString file;
+    QString image;
+    // The song that's already in the library, or an invalid song if this is a
+    // new file.
+    Song matching_song;
+    // For a new file with a cue sheet, the sections from the cue sheet.  These
+    // are added to the library instead of the file's own tags if the file
+    // turns out to be a valid media file.
+    SongList cue_songs;
+  };
+  typedef QList<PendingTagRead> PendingTagReadList;
+
+  // Local filename -> songs with that filename.  There's more than one song
+  // for a file that has a cue sheet.
+  typedef QHash<QString, SongList> SongPathIndex;
+  static SongPathIndex IndexSongsByPath(const SongList& list);
   inline static QString NoExtensionPart(const QString& fileName);
   inline static QString ExtensionPart(const QString& fileName);
   inline static QString DirectoryPart(const QString& fileName);
+  // Whether the filesystem a file was on looks like it's still mounted - the
+  // closest of its directories that still exists isn't empty.  An unmounted
+  // share usually leaves an empty mount point behind, or nothing at all.
+  static bool IsLocationAvailable(const QString& file);
   QString PickBestImage(const QStringList& images);
   QString ImageForSong(const QString& path,
                        QMap<QString, QStringList>& album_art);
   void AddWatch(const Directory& dir, const QString& path);
+
+  // Scans all the tasks, and any subdirectories they discover, using every
+  // thread in scan_thread_pool_.  Blocks until the scan is finished.
+  void ScanSubdirectories(const QList<ScanTask>& tasks, ScanTransaction* t);
+  // Scans a subdirectory found while scanning its parent - either by pushing it
+  // onto the transaction's scan queue, or straight away if there isn't one.
+  void QueueSubdirectory(const ScanTask& task, ScanTransaction* t);
+  // Runs on each of the scan threads.
+  void ScanThreadMain(ScanQueue* queue, ScanTransaction* t);
   uint GetMtimeForCue(const QString& cue_path);
   void PerformScan(bool incremental, bool ignore_mtimes);
+  void ScanDirectory(const Directory& dir, bool incremental,
+                     bool ignore_mtimes);
 
   // Updates the sections of a cue associated and altered (according to mtime)
   // media file during a scan.
@@ -165,22 +281,42 @@ signals:
                                 const QString& image, ScanTransaction* t);
   // Updates a single non-cue associated and altered (according to mtime) song
   // during a scan.
+  // The file's tags are not read immediately, it's added to pending_reads.
   void UpdateNonCueAssociatedSong(const QString& file,
                                   const Song& matching_song,
                                   const QString& image, bool cue_deleted,
-                                  ScanTransaction* t);
+                                  ScanTransaction* t,
+                                  PendingTagReadList* pending_reads);
   // Updates a new song with some metadata taken from it's equivalent old
   // song (for example rating and score).
   void PreserveUserSetData(const QString& file, const QString& image,
                            const Song& matching_song, Song* out,
                            ScanTransaction* t);
-  // Scans a single media file that's present on the disk but not yet in the
-  // library.
+  // Compares the files on disk with the songs in the library for those files,
+  // and adds any differences to the transaction.  Songs whose files aren't in
+  // files_on_disk are treated as deleted.
+  void UpdateFiles(const QString& path, const QStringList& files_on_disk,
+                   const SongPathIndex& songs_in_db,
+                   QMap<QString, QStringList>& album_art, ScanTransaction* t);
+  // Looks for a song in the library that has the same inode, size and mtime
+  // as a new file but whose own file has gone.  If there is one the file was
+  // moved or renamed, and the song is moved to the new location without
+  // reading the file's tags again.
+  bool FindMovedSong(const QString& file, const QString& matching_cue,
+                     QMap<QString, QStringList>& album_art,
+                     ScanTransaction* t);
+  // Queues a single media file that's present on the disk but not yet in the
+  // library to be read along with the rest of the directory.
   // It may result in a multiple files added to the library when the media file
   // has many sections (like a CUE related media file).
-  SongList ScanNewFile(const QString& file, const QString& path,
-                       const QString& matching_cue,
-                       QSet<QString>* cues_processed);
+  void QueueNewFile(const QString& file, const QString& path,
+                    const QString& matching_cue, QSet<QString>* cues_processed,
+                    PendingTagReadList* pending_reads);
+  // Reads the tags of all the pending files in one batch and adds the results
+  // to the transaction.
+  void ReadPendingFiles(const PendingTagReadList& pending_reads,
+                        QMap<QString, QStringList>& album_art,
+                        ScanTransaction* t);
 
  private:
   LibraryBackend* backend_;
@@ -205,12 +341,23 @@ signals:
   QTimer* rescan_timer_;
   QMap<int, QStringList>
       rescan_queue_;  // dir id -> list of subdirs to be scanned
+  // dir id -> subdir -> files in the subdir to be scanned
+  QMap<int, QMap<QString, QSet<QString> > > rescan_file_queue_;
   bool rescan_paused_;
 
+  // Subdirectories the filesystem watcher couldn't watch, by dir id.  These
+  // are checked for changes every kUnwatchedPollIntervalMsec instead.
+  QMap<int, QSet<QString> > unwatched_subdirs_;
+  QTimer* unwatched_poll_timer_;
+  static const int kUnwatchedPollIntervalMsec;
+  static const int kCheckpointIntervalMsec;
+
   int total_watches_;
 
   CueParser* cue_parser_;
 
+  QThreadPool scan_thread_pool_;
+
   static QStringList sValidImages;
 };
 
@@ -20,10 +20,96 @@
 
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QSqlResult>
 
-SqlRow::SqlRow(const QSqlQuery& query) { Init(query); }
+#include <sqlite3.h>
 
-SqlRow::SqlRow(const LibraryQuery& query) { Init(query); }
+#include "core/logging.h"
+
+SqlRowReader::SqlRowReader(const QSqlQuery& query)
+    : query_(query), stmt_(nullptr), started_(false), finished_(false) {
+  const QSqlResult* result = query_.result();
+  if (!result) return;
+
+  QVariant handle = result->handle();
+  if (handle.isValid() && qstrcmp(handle.typeName(), "sqlite3_stmt*") == 0) {
+    stmt_ = *static_cast<sqlite3_stmt**>(handle.data());
+  }
+}
+
+bool SqlRowReader::Next() {
+  // The driver has already stepped onto the first row while executing the
+  // query, and the statement stays there until it's stepped again.
+  if (finished_) return false;
+  if (!stmt_ || !started_) {
+    started_ = true;
+    finished_ = !query_.next();
+    return !finished_;
+  }
+
+  const int ret = sqlite3_step(stmt_);
+  if (ret == SQLITE_ROW) return true;
+
+  if (ret != SQLITE_DONE) {
+    qLog(Error) << "db error:" << sqlite3_errmsg(sqlite3_db_handle(stmt_));
+  }
+  sqlite3_reset(stmt_);
+  finished_ = true;
+  return false;
+}
+
+QVariant SqlRowReader::value(int i) const {
+  if (!stmt_) return query_.value(i);
+
+  switch (sqlite3_column_type(stmt_, i)) {
+    case SQLITE_INTEGER:
+      return sqlite3_column_int64(stmt_, i);
+    case SQLITE_FLOAT:
+      return sqlite3_column_double(stmt_, i);
+    case SQLITE_BLOB:
+      return QByteArray(static_cast<const char*>(sqlite3_column_blob(stmt_, i)),
+                        sqlite3_column_bytes(stmt_, i));
+    case SQLITE_NULL:
+      return QVariant(QVariant::String);
+    default:
+      return QString::fromUtf8(
+          reinterpret_cast<const char*>(sqlite3_column_text(stmt_, i)),
+          sqlite3_column_bytes(stmt_, i));
+  }
+}
+
+int SqlRowReader::column_count() const {
+  if (!stmt_) return query_.record().count();
+  return sqlite3_column_count(stmt_);
+}
+
+SqlRow::SqlRow(const QSqlQuery& query) : song_column_(-1) { Init(query); }
+
+SqlRow::SqlRow(const LibraryQuery& query) : song_column_(-1) {
+  // The query might have been answered by LibraryIndex instead of SQLite.
+  const int columns = query.ColumnCount();
+  for (int i = 0; i < columns; ++i) {
+    columns_ << query.Value(i);
+  }
+}
+
+SqlRow::SqlRow(const SqlRowReader& reader, int song_column,
+               bool reliable_metadata)
+    : song_column_(-1) {
+  const int song_width = Song::kColumns.count() + 1;
+  const int columns = reader.column_count();
+
+  for (int i = 0; i < columns; ++i) {
+    if (i == song_column && reader.statement()) {
+      song_column_ = i;
+      song_.InitFromQuery(reader, reliable_metadata, i);
+      for (int j = 0; j < song_width; ++j) columns_ << QVariant();
+      i += song_width - 1;
+    } else {
+      columns_ << reader.value(i);
+    }
+  }
+}
 
 void SqlRow::Init(const QSqlQuery& query) {
   int rows = query.record().count();
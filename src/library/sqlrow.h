@@ -19,26 +19,67 @@
 #define SQLROW_H
 
 #include <QList>
+#include <QSqlQuery>
 #include <QVariant>
 
-class QSqlQuery;
+#include "core/song.h"
+
+struct sqlite3_stmt;
 
 class LibraryQuery;
 
+// Steps through the results of a SELECT by reading the query's sqlite3_stmt
+// directly, so the driver doesn't convert every column of every row into a
+// QVariant first.  Create it straight after the query is executed and use
+// Next() instead of the query's next().  Afterwards the query can only be
+// executed again or finished.
+class SqlRowReader {
+ public:
+  explicit SqlRowReader(const QSqlQuery& query);
+
+  bool Next();
+
+  // The statement, positioned on the current row.  This is NULL if the query
+  // isn't backed by SQLite, in which case values come from the query itself.
+  sqlite3_stmt* statement() const { return stmt_; }
+  const QSqlQuery& query() const { return query_; }
+
+  QVariant value(int i) const;
+  int column_count() const;
+
+ private:
+  QSqlQuery query_;
+  sqlite3_stmt* stmt_;
+  bool started_;
+  bool finished_;
+};
+
 class SqlRow {
  public:
   // WARNING: Implicit construction from QSqlQuery and LibraryQuery.
   SqlRow(const QSqlQuery& query);
   SqlRow(const LibraryQuery& query);
 
+  // Decodes the block of columns starting at song_column (a ROWID followed by
+  // Song::kColumns) into a Song straight away, and copies the other columns.
+  SqlRow(const SqlRowReader& reader, int song_column, bool reliable_metadata);
+
   const QVariant& value(int i) const { return columns_[i]; }
 
+  // The song decoded from the block starting at column i, or NULL.
+  const Song* song(int i) const {
+    return i == song_column_ ? &song_ : nullptr;
+  }
+
  private:
   SqlRow();
 
   void Init(const QSqlQuery& query);
 
   QList<QVariant> columns_;
+
+  int song_column_;
+  Song song_;
 };
 
 typedef QList<SqlRow> SqlRowList;
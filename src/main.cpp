@@ -47,6 +47,7 @@
 #include "core/commandlineoptions.h"
 #include "core/crashreporting.h"
 #include "core/database.h"
+#include "core/databasestats.h"
 #include "core/logging.h"
 #include "core/mac_startup.h"
 #include "core/metatypes.h"
@@ -61,6 +62,7 @@
 #include "covers/discogscoverprovider.h"
 #include "covers/musicbrainzcoverprovider.h"
 #include "engines/enginebase.h"
+#include "library/libraryquery.h"
 #include "smartplaylists/generator.h"
 #include "ui/iconloader.h"
 #include "ui/mainwindow.h"
@@ -329,6 +331,10 @@ int main(int argc, char* argv[]) {
   // Initialise logging
   logging::Init();
   logging::SetLevels(options.log_levels());
+  LibraryQuery::set_audit_query_plans(options.audit_query_plans());
+  if (options.db_stats_msec() >= 0) {
+    Database::EnableStats(options.db_stats_msec());
+  }
   g_log_set_default_handler(reinterpret_cast<GLogFunc>(&logging::GLog),
                             nullptr);
 
@@ -497,6 +503,12 @@ int main(int argc, char* argv[]) {
 
   int ret = a.exec();
 
+  if (Database::stats()) {
+    for (const QString& line : Database::stats()->Dump()) {
+      qLog(Info) << qPrintable(line);
+    }
+  }
+
 #ifdef Q_OS_LINUX
   // The nvidia driver would cause Clementine (or any application that used
   // opengl) to use 100% cpu on shutdown.  See:
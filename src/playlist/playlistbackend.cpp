@@ -61,7 +61,7 @@ PlaylistBackend::PlaylistList PlaylistBackend::GetAllFavoritePlaylists() {
 
 PlaylistBackend::PlaylistList PlaylistBackend::GetPlaylists(
     GetPlaylistsFlags flags) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), "playlists");
   QSqlDatabase db(db_->Connect());
 
   PlaylistList ret;
@@ -107,7 +107,7 @@ PlaylistBackend::PlaylistList PlaylistBackend::GetPlaylists(
 }
 
 PlaylistBackend::Playlist PlaylistBackend::GetPlaylist(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), "playlists");
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(
@@ -138,7 +138,7 @@ PlaylistBackend::Playlist PlaylistBackend::GetPlaylist(int id) {
 }
 
 QList<SqlRow> PlaylistBackend::GetPlaylistRows(int playlist) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), "playlists");
   QSqlDatabase db(db_->Connect());
 
   QString query = "SELECT songs.ROWID, " + Song::JoinSpec("songs") +
@@ -161,23 +161,42 @@ QList<SqlRow> PlaylistBackend::GetPlaylistRows(int playlist) {
                   " LEFT JOIN jamendo.songs AS jamendo_songs"
                   "    ON p.library_id = jamendo_songs.ROWID"
                   " WHERE p.playlist = :playlist";
-  QSqlQuery q(query, db);
+  Database::PreparedQuery q(db_->CachedQuery(query, db));
 
   q.bindValue(":playlist", playlist);
   q.exec();
   if (db_->CheckErrors(q)) return QList<SqlRow>();
 
+  // The song tables get joined first, plus one each for the song ROWIDs
+  const int song_width = Song::kColumns.count() + 1;
+  const int type_column = song_width * kSongTableJoins;
+
   QList<SqlRow> rows;
 
-  while (q.next()) {
-    rows << SqlRow(q);
+  SqlRowReader reader(q);
+  while (reader.Next()) {
+    // Decode the one song this type of item is going to read straight from
+    // the statement.  Items from the library tables use their own table's
+    // columns, everything else uses the copy in playlist_items.
+    const QString type = reader.value(type_column).toString();
+    int song_table = kSongTableJoins - 1;
+    if (type == "Library") {
+      song_table = 0;
+    } else if (type == "Magnatune") {
+      song_table = 1;
+    } else if (type == "Jamendo") {
+      song_table = 2;
+    }
+
+    rows << SqlRow(reader, song_table * song_width,
+                   song_table != kSongTableJoins - 1);
   }
 
   return rows;
 }
 
 QFuture<PlaylistItemPtr> PlaylistBackend::GetPlaylistItems(int playlist) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), "playlists");
   QList<SqlRow> rows = GetPlaylistRows(playlist);
 
   // it's probable that we'll have a few songs associated with the
@@ -189,7 +208,7 @@ QFuture<PlaylistItemPtr> PlaylistBackend::GetPlaylistItems(int playlist) {
 }
 
 QFuture<Song> PlaylistBackend::GetPlaylistSongs(int playlist) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->ReadMutex(), "playlists");
   QList<SqlRow> rows = GetPlaylistRows(playlist);
 
   // it's probable that we'll have a few songs associated with the
@@ -284,26 +303,27 @@ void PlaylistBackend::SavePlaylistAsync(int playlist,
 
 void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
                                    int last_played, GeneratorPtr dynamic) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery clear("DELETE FROM playlist_items WHERE playlist = :playlist", db);
-  QSqlQuery insert(
+  Database::PreparedQuery clear(db_->CachedQuery(
+      "DELETE FROM playlist_items WHERE playlist = :playlist", db));
+  Database::PreparedQuery insert(db_->CachedQuery(
       "INSERT INTO playlist_items"
       " (playlist, type, library_id, radio_service, " +
           Song::kColumnSpec +
           ")"
           " VALUES (:playlist, :type, :library_id, :radio_service, " +
           Song::kBindSpec + ")",
-      db);
-  QSqlQuery update(
+      db));
+  Database::PreparedQuery update(db_->CachedQuery(
       "UPDATE playlists SET "
       "   last_played=:last_played,"
       "   dynamic_playlist_type=:dynamic_type,"
       "   dynamic_playlist_data=:dynamic_data,"
       "   dynamic_playlist_backend=:dynamic_backend"
       " WHERE ROWID=:playlist",
-      db);
+      db));
 
   ScopedTransaction transaction(&db);
 
@@ -341,7 +361,7 @@ void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
 
 int PlaylistBackend::CreatePlaylist(const QString& name,
                                     const QString& special_type) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(
@@ -357,7 +377,7 @@ int PlaylistBackend::CreatePlaylist(const QString& name,
 }
 
 void PlaylistBackend::RemovePlaylist(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
   QSqlQuery delete_playlist("DELETE FROM playlists WHERE ROWID=:id", db);
   QSqlQuery delete_items("DELETE FROM playlist_items WHERE playlist=:id", db);
@@ -377,7 +397,7 @@ void PlaylistBackend::RemovePlaylist(int id) {
 }
 
 void PlaylistBackend::RenamePlaylist(int id, const QString& new_name) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
   QSqlQuery q("UPDATE playlists SET name=:name WHERE ROWID=:id", db);
   q.bindValue(":name", new_name);
@@ -388,7 +408,7 @@ void PlaylistBackend::RenamePlaylist(int id, const QString& new_name) {
 }
 
 void PlaylistBackend::FavoritePlaylist(int id, bool is_favorite) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
   QSqlQuery q("UPDATE playlists SET is_favorite=:is_favorite WHERE ROWID=:id",
               db);
@@ -400,7 +420,7 @@ void PlaylistBackend::FavoritePlaylist(int id, bool is_favorite) {
 }
 
 void PlaylistBackend::SetPlaylistOrder(const QList<int>& ids) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
   ScopedTransaction transaction(&db);
 
@@ -420,7 +440,7 @@ void PlaylistBackend::SetPlaylistOrder(const QList<int>& ids) {
 }
 
 void PlaylistBackend::SetPlaylistUiPath(int id, const QString& path) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_->Mutex(), "playlists");
   QSqlDatabase db(db_->Connect());
   QSqlQuery q("UPDATE playlists SET ui_path=:path WHERE ROWID=:id", db);
 
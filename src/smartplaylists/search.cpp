@@ -43,14 +43,15 @@ void Search::Reset() {
   first_item_ = 0;
 }
 
-QString Search::ToSql(const QString& songs_table) const {
+QString Search::ToSql(const QString& songs_table,
+                      const QString& fts_table) const {
   QString sql = "SELECT ROWID," + Song::kColumnSpec + " FROM " + songs_table;
 
   // Add search terms
   QStringList where_clauses;
   QStringList term_where_clauses;
   for (const SearchTerm& term : terms_) {
-    term_where_clauses << term.ToSql();
+    term_where_clauses << term.ToSql(fts_table);
   }
 
   if (!terms_.isEmpty() && search_type_ != Type_All) {
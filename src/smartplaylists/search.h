@@ -52,7 +52,8 @@ class Search {
   int first_item_;
 
   void Reset();
-  QString ToSql(const QString& songs_table) const;
+  QString ToSql(const QString& songs_table,
+                const QString& fts_table = QString()) const;
 };
 
 }  // namespace
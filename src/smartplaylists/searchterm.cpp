@@ -16,6 +16,7 @@
 */
 
 #include "searchterm.h"
+#include "core/song.h"
 #include "playlist/playlist.h"
 
 namespace smart_playlists {
@@ -25,7 +26,38 @@ SearchTerm::SearchTerm() : field_(Field_Title), operator_(Op_Equals) {}
 SearchTerm::SearchTerm(Field field, Operator op, const QVariant& value)
     : field_(field), operator_(op), value_(value) {}
 
-QString SearchTerm::ToSql() const {
+QString SearchTerm::FtsSql(const QString& fts_table) const {
+  if (fts_table.isEmpty() || TypeOf(field_) != Type_Text) return QString();
+  if (operator_ != Op_StartsWith && operator_ != Op_Equals) return QString();
+
+  const QString fts_column = "fts" + FieldColumnName(field_);
+  if (!Song::kFtsColumns.contains(fts_column)) return QString();
+
+  // The LIKE treats these as wildcards, so a prefix search on whole words
+  // might miss things it would match.
+  QString value = value_.toString();
+  if (value.contains('%') || value.contains('_')) return QString();
+
+  bool has_words = false;
+  for (const QChar& c : value) {
+    if (c.isLetterOrNumber()) {
+      has_words = true;
+      break;
+    }
+  }
+  if (!has_words) return QString();
+
+  value.replace('"', ' ');
+  value.replace('\'', "''");
+
+  QString phrase = fts_column + " : \"" + value + "\"";
+  if (operator_ == Op_StartsWith) phrase += "*";
+
+  return QString("ROWID IN (SELECT ROWID FROM %1 WHERE %2 MATCH '%3') AND ")
+      .arg(fts_table, fts_table.section('.', -1, -1), phrase);
+}
+
+QString SearchTerm::ToSql(const QString& fts_table) const {
   QString col = FieldColumnName(field_);
   QString date = DateName(date_, true);
   QString value = value_.toString();
@@ -76,12 +108,12 @@ QString SearchTerm::ToSql() const {
     case Op_NotContains:
       return col + " NOT LIKE '%" + value + "%'";
     case Op_StartsWith:
-      return col + " LIKE '" + value + "%'";
+      return "(" + FtsSql(fts_table) + col + " LIKE '" + value + "%')";
     case Op_EndsWith:
       return col + " LIKE '%" + value + "'";
     case Op_Equals:
       if (TypeOf(field_) == Type_Text)
-        return col + " LIKE '" + value + "'";
+        return "(" + FtsSql(fts_table) + col + " LIKE '" + value + "')";
       else if (TypeOf(field_) == Type_Rating || TypeOf(field_) == Type_Date ||
                TypeOf(field_) == Type_Time)
         return col + " = " + value;
@@ -105,7 +105,9 @@ class SearchTerm {
   // else
   QVariant second_value_;
 
-  QString ToSql() const;
+  // If fts_table is given, text searches that can be narrowed down with the
+  // full text index use it first.
+  QString ToSql(const QString& fts_table = QString()) const;
   bool is_valid() const;
   bool operator==(const SearchTerm& other) const;
   bool operator!=(const SearchTerm& other) const { return !(*this == other); }
@@ -117,6 +119,11 @@ class SearchTerm {
   static QString FieldColumnName(Field field);
   static QString FieldSortOrderText(Type type, bool ascending);
   static QString DateName(DateType date, bool forQuery);
+
+ private:
+  // A MATCH on the FTS table that finds at least every row the LIKE in
+  // ToSql() would, or an empty string if there isn't one.
+  QString FtsSql(const QString& fts_table) const;
 };
 
 typedef QList<SearchTerm::Operator> OperatorList;
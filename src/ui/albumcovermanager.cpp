@@ -87,6 +87,9 @@ AlbumCoverManager::AlbumCoverManager(Application* app,
 
   album_cover_choice_controller_->SetApplication(app_);
 
+  // The covers in the list are small, and the same ones every time.
+  cover_loader_options_.use_thumbnail_cache_ = true;
+
   // Get a square version of nocover.png
   QImage nocover(":/nocover.png");
   nocover =
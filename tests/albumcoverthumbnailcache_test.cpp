@@ -0,0 +1,134 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "covers/albumcoverthumbnailcache.h"
+
+namespace {
+
+class AlbumCoverThumbnailCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    directory_ = QDir::tempPath() +
+                 QString("/thumbnailcachetest-%1")
+                     .arg(QCoreApplication::applicationPid());
+    RemoveDirectory();
+  }
+
+  void TearDown() { RemoveDirectory(); }
+
+  void RemoveDirectory() {
+    QFile::remove(directory_ + "/" +
+                  AlbumCoverThumbnailCache::kPackFilename);
+    QFile::remove(directory_ + "/" +
+                  AlbumCoverThumbnailCache::kIndexFilename);
+    QDir().rmdir(directory_);
+  }
+
+  static QImage Image(int width, int height) {
+    QImage image(width, height, QImage::Format_RGB32);
+    image.fill(0xff336699);
+    return image;
+  }
+
+  QString directory_;
+};
+
+TEST_F(AlbumCoverThumbnailCacheTest, LoadsSmallestLevelBigEnough) {
+  AlbumCoverThumbnailCache cache(directory_);
+  cache.Save("/music/cover.jpg", 10, Image(400, 200));
+
+  QImage image = cache.Load("/music/cover.jpg", 10, 20);
+  EXPECT_EQ(32, image.width());
+  EXPECT_EQ(16, image.height());
+
+  image = cache.Load("/music/cover.jpg", 10, 40);
+  EXPECT_EQ(64, image.width());
+
+  image = cache.Load("/music/cover.jpg", 10, 128);
+  EXPECT_EQ(128, image.width());
+  EXPECT_EQ(64, image.height());
+
+  // Nothing's bigger than the largest size.
+  EXPECT_TRUE(cache.Load("/music/cover.jpg", 10, 200).isNull());
+}
+
+TEST_F(AlbumCoverThumbnailCacheTest, MissesChangedFiles) {
+  AlbumCoverThumbnailCache cache(directory_);
+  cache.Save("/music/cover.jpg", 10, Image(200, 200));
+
+  EXPECT_TRUE(cache.Load("/music/cover.jpg", 11, 32).isNull());
+  EXPECT_TRUE(cache.Load("/music/other.jpg", 10, 32).isNull());
+}
+
+TEST_F(AlbumCoverThumbnailCacheTest, DoesntScaleUp) {
+  AlbumCoverThumbnailCache cache(directory_);
+  cache.Save("/music/cover.jpg", 10, Image(50, 50));
+
+  EXPECT_EQ(32, cache.Load("/music/cover.jpg", 10, 32).width());
+  EXPECT_EQ(50, cache.Load("/music/cover.jpg", 10, 40).width());
+
+  // Bigger sizes get the original rather than missing the cache.
+  EXPECT_EQ(50, cache.Load("/music/cover.jpg", 10, 100).width());
+  EXPECT_EQ(50, cache.Load("/music/cover.jpg", 10, 128).width());
+  EXPECT_EQ(50, cache.Load("/music/cover.jpg", 10, 128).height());
+}
+
+TEST_F(AlbumCoverThumbnailCacheTest, PersistsAfterFlush) {
+  {
+    AlbumCoverThumbnailCache cache(directory_);
+    cache.Save("/music/cover.jpg", 10, Image(200, 200));
+    cache.Flush();
+  }
+
+  AlbumCoverThumbnailCache cache(directory_);
+  QImage image = cache.Load("/music/cover.jpg", 10, 64);
+  EXPECT_EQ(64, image.width());
+  EXPECT_EQ(0xff336699, image.pixel(10, 10));
+}
+
+TEST_F(AlbumCoverThumbnailCacheTest, CompactsReplacedThumbnails) {
+  const QString pack =
+      directory_ + "/" + AlbumCoverThumbnailCache::kPackFilename;
+  qint64 size = 0;
+  {
+    AlbumCoverThumbnailCache cache(directory_);
+    cache.Save("/music/cover.jpg", 10, Image(200, 200));
+    cache.Flush();
+    size = QFileInfo(pack).size();
+
+    // The old versions stay in the pack file until it's opened again.
+    cache.Save("/music/cover.jpg", 11, Image(200, 200));
+    cache.Save("/music/cover.jpg", 12, Image(200, 200));
+    cache.Flush();
+    EXPECT_EQ(size * 3, QFileInfo(pack).size());
+  }
+
+  AlbumCoverThumbnailCache cache(directory_);
+  QImage image = cache.Load("/music/cover.jpg", 12, 64);
+  EXPECT_EQ(64, image.width());
+  EXPECT_EQ(0xff336699, image.pixel(10, 10));
+  EXPECT_EQ(size, QFileInfo(pack).size());
+}
+
+}  // namespace
@@ -15,6 +15,7 @@
    along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
 #include <memory>
 
 #include "test_utils.h"
@@ -23,13 +24,14 @@
 #include "core/database.h"
 
 #include <QtDebug>
+#include <QRegExp>
 #include <QSqlQuery>
 #include <QVariant>
 
 class DatabaseTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
-    database_.reset(new MemoryDatabase);
+    database_.reset(new MemoryDatabase(nullptr));
   }
 
   std::unique_ptr<Database> database_;
@@ -53,53 +55,141 @@ TEST_F(DatabaseTest, DatabaseInitialises) {
   EXPECT_FALSE(q.next());
 }
 
+TEST_F(DatabaseTest, CachedQueryIsReused) {
+  QSqlDatabase db(database_->Connect());
+  const QString sql = "SELECT version FROM schema_version WHERE version = :v";
+
+  const QSqlResult* result = nullptr;
+  {
+    Database::PreparedQuery q1(database_->CachedQuery(sql, db));
+    q1.bindValue(":v", Database::kSchemaVersion);
+    ASSERT_TRUE(q1.exec());
+    ASSERT_TRUE(q1.next());
+    EXPECT_EQ(Database::kSchemaVersion, q1.value(0).toInt());
+    result = q1.result();
+  }
+
+  // Asking again gives back the same statement, reset and ready to go.
+  Database::PreparedQuery q2(database_->CachedQuery(sql, db));
+  EXPECT_EQ(result, q2.result());
+  q2.bindValue(":v", -1);
+  ASSERT_TRUE(q2.exec());
+  EXPECT_FALSE(q2.next());
+}
+
+TEST_F(DatabaseTest, CachedQueryCanBeNested) {
+  QSqlDatabase db(database_->Connect());
+  const QString sql = "SELECT version FROM schema_version WHERE version >= :v";
+
+  Database::PreparedQuery outer(database_->CachedQuery(sql, db));
+  outer.bindValue(":v", 0);
+  ASSERT_TRUE(outer.exec());
+  ASSERT_TRUE(outer.next());
+
+  {
+    // The outer query is still being read, so this gets its own statement.
+    Database::PreparedQuery inner(database_->CachedQuery(sql, db));
+    EXPECT_NE(outer.result(), inner.result());
+    inner.bindValue(":v", Database::kSchemaVersion + 1);
+    ASSERT_TRUE(inner.exec());
+    EXPECT_FALSE(inner.next());
+  }
+
+  EXPECT_TRUE(outer.isActive());
+  EXPECT_EQ(Database::kSchemaVersion, outer.value(0).toInt());
+}
+
+TEST_F(DatabaseTest, GroupingQueriesDontScanSongs) {
+  // The kind of queries LibraryModel runs to fill in a genre node.
+  const QStringList queries = QStringList()
+      << "SELECT DISTINCT genre FROM songs WHERE unavailable = 0"
+      << "SELECT DISTINCT artist FROM songs WHERE genre = 'Rock'"
+         " AND effective_compilation = 0 AND unavailable = 0"
+      << "SELECT DISTINCT album FROM songs WHERE genre = 'Rock'"
+         " AND effective_compilation = 0 AND artist = 'A'"
+         " AND unavailable = 0";
+
+  QRegExp full_scan("SCAN (TABLE )?songs");
+  for (const QString& sql : queries) {
+    QSqlQuery q("EXPLAIN QUERY PLAN " + sql, database_->Connect());
+    ASSERT_TRUE(q.exec());
+    while (q.next()) {
+      EXPECT_FALSE(full_scan.exactMatch(q.value(3).toString())) << sql;
+    }
+  }
+}
+
 TEST_F(DatabaseTest, FTSOpenParsesSimpleInput) {
   sqlite3_tokenizer_cursor* cursor = nullptr;
   Database::FTSOpen(nullptr, "foo", 3, &cursor);
   ASSERT_TRUE(cursor);
-  Database::UnicodeTokenizerCursor* real_cursor = reinterpret_cast<Database::UnicodeTokenizerCursor*>(cursor);
-  QList<Database::Token> tokens = real_cursor->tokens;
-  ASSERT_EQ(1, tokens.length());
-  EXPECT_EQ(0, real_cursor->position);
-  EXPECT_TRUE(real_cursor->current_utf8.isEmpty());
-
-  EXPECT_EQ("foo", tokens[0].token);
-  EXPECT_EQ(0, tokens[0].start_offset);
-  EXPECT_EQ(3, tokens[0].end_offset);
+
+  const char* token;
+  int bytes = 0;
+  int start_offset = 0;
+  int end_offset = 0;
+  int position = 0;
+  ASSERT_EQ(SQLITE_OK, Database::FTSNext(cursor, &token, &bytes, &start_offset,
+                                         &end_offset, &position));
+  EXPECT_EQ("foo", QString::fromUtf8(token, bytes));
+  EXPECT_EQ(0, start_offset);
+  EXPECT_EQ(3, end_offset);
+  EXPECT_EQ(0, position);
+
+  EXPECT_EQ(SQLITE_DONE, Database::FTSNext(cursor, &token, &bytes,
+                                           &start_offset, &end_offset,
+                                           &position));
+  Database::FTSClose(cursor);
 }
 
 TEST_F(DatabaseTest, FTSOpenParsesUTF8Input) {
   sqlite3_tokenizer_cursor* cursor = nullptr;
   Database::FTSOpen(nullptr, "Röyksopp", 9, &cursor);
   ASSERT_TRUE(cursor);
-  Database::UnicodeTokenizerCursor* real_cursor = reinterpret_cast<Database::UnicodeTokenizerCursor*>(cursor);
-  QList<Database::Token> tokens = real_cursor->tokens;
-  ASSERT_EQ(1, tokens.length());
-  EXPECT_EQ(0, real_cursor->position);
-  EXPECT_TRUE(real_cursor->current_utf8.isEmpty());
-
-  EXPECT_EQ("royksopp", tokens[0].token);
-  EXPECT_EQ(0, tokens[0].start_offset);
-  EXPECT_EQ(9, tokens[0].end_offset);
+
+  const char* token;
+  int bytes = 0;
+  int start_offset = 0;
+  int end_offset = 0;
+  int position = 0;
+  ASSERT_EQ(SQLITE_OK, Database::FTSNext(cursor, &token, &bytes, &start_offset,
+                                         &end_offset, &position));
+  EXPECT_EQ("royksopp", QString::fromUtf8(token, bytes));
+  EXPECT_EQ(0, start_offset);
+  EXPECT_EQ(9, end_offset);
+
+  EXPECT_EQ(SQLITE_DONE, Database::FTSNext(cursor, &token, &bytes,
+                                           &start_offset, &end_offset,
+                                           &position));
+  Database::FTSClose(cursor);
 }
 
 TEST_F(DatabaseTest, FTSOpenParsesMultipleTokens) {
   sqlite3_tokenizer_cursor* cursor = nullptr;
   Database::FTSOpen(nullptr, "Röyksopp foo", 13, &cursor);
   ASSERT_TRUE(cursor);
-  Database::UnicodeTokenizerCursor* real_cursor = reinterpret_cast<Database::UnicodeTokenizerCursor*>(cursor);
-  QList<Database::Token> tokens = real_cursor->tokens;
-  ASSERT_EQ(2, tokens.length());
-  EXPECT_EQ(0, real_cursor->position);
-  EXPECT_TRUE(real_cursor->current_utf8.isEmpty());
-
-  EXPECT_EQ("royksopp", tokens[0].token);
-  EXPECT_EQ(0, tokens[0].start_offset);
-  EXPECT_EQ(9, tokens[0].end_offset);
-
-  EXPECT_EQ("foo", tokens[1].token);
-  EXPECT_EQ(10, tokens[1].start_offset);
-  EXPECT_EQ(13, tokens[1].end_offset);
+
+  const char* token;
+  int bytes = 0;
+  int start_offset = 0;
+  int end_offset = 0;
+  int position = 0;
+  ASSERT_EQ(SQLITE_OK, Database::FTSNext(cursor, &token, &bytes, &start_offset,
+                                         &end_offset, &position));
+  EXPECT_EQ("royksopp", QString::fromUtf8(token, bytes));
+  EXPECT_EQ(0, start_offset);
+  EXPECT_EQ(9, end_offset);
+
+  ASSERT_EQ(SQLITE_OK, Database::FTSNext(cursor, &token, &bytes, &start_offset,
+                                         &end_offset, &position));
+  EXPECT_EQ("foo", QString::fromUtf8(token, bytes));
+  EXPECT_EQ(10, start_offset);
+  EXPECT_EQ(13, end_offset);
+
+  EXPECT_EQ(SQLITE_DONE, Database::FTSNext(cursor, &token, &bytes,
+                                           &start_offset, &end_offset,
+                                           &position));
+  Database::FTSClose(cursor);
 }
 
 TEST_F(DatabaseTest, FTSOpenLeavesCyrillicQueries) {
@@ -107,15 +197,48 @@ TEST_F(DatabaseTest, FTSOpenLeavesCyrillicQueries) {
   const char* query = "Снег";
   Database::FTSOpen(nullptr, query, strlen(query), &cursor);
   ASSERT_TRUE(cursor);
-  Database::UnicodeTokenizerCursor* real_cursor = reinterpret_cast<Database::UnicodeTokenizerCursor*>(cursor);
-  QList<Database::Token> tokens = real_cursor->tokens;
-  ASSERT_EQ(1, tokens.length());
-  EXPECT_EQ(0, real_cursor->position);
-  EXPECT_TRUE(real_cursor->current_utf8.isEmpty());
-
-  EXPECT_EQ(QString::fromUtf8("снег"), tokens[0].token);
-  EXPECT_EQ(0, tokens[0].start_offset);
-  EXPECT_EQ(strlen(query), tokens[0].end_offset);
+
+  const char* token;
+  int bytes = 0;
+  int start_offset = 0;
+  int end_offset = 0;
+  int position = 0;
+  ASSERT_EQ(SQLITE_OK, Database::FTSNext(cursor, &token, &bytes, &start_offset,
+                                         &end_offset, &position));
+  EXPECT_EQ(QString::fromUtf8("снег"), QString::fromUtf8(token, bytes));
+  EXPECT_EQ(0, start_offset);
+  EXPECT_EQ(strlen(query), end_offset);
+
+  EXPECT_EQ(SQLITE_DONE, Database::FTSNext(cursor, &token, &bytes,
+                                           &start_offset, &end_offset,
+                                           &position));
+  Database::FTSClose(cursor);
+}
+
+TEST_F(DatabaseTest, FTSOpenParsesLongTokens) {
+  // Longer than the space a token gets before it needs to allocate.
+  const QByteArray word(300, 'A');
+  const QByteArray input = word + " " + word;
+
+  sqlite3_tokenizer_cursor* cursor = nullptr;
+  Database::FTSOpen(nullptr, input.constData(), input.size(), &cursor);
+  ASSERT_TRUE(cursor);
+
+  const char* token;
+  int bytes = 0;
+  int start_offset = 0;
+  int end_offset = 0;
+  int position = 0;
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_EQ(SQLITE_OK, Database::FTSNext(cursor, &token, &bytes,
+                                           &start_offset, &end_offset,
+                                           &position));
+    EXPECT_EQ(word.toLower(), QByteArray(token, bytes));
+    EXPECT_EQ(i * 301, start_offset);
+    EXPECT_EQ(i * 301 + 300, end_offset);
+    EXPECT_EQ(i, position);
+  }
+  Database::FTSClose(cursor);
 }
 
 TEST_F(DatabaseTest, FTSCursorWorks) {
@@ -148,3 +271,18 @@ TEST_F(DatabaseTest, FTSCursorWorks) {
   rc = Database::FTSNext(cursor, &token, &bytes, &start_offset, &end_offset, &position);
   EXPECT_EQ(SQLITE_DONE, rc);
 }
+
+TEST_F(DatabaseTest, FTS5TokenizerFoldsDiacritics) {
+  QSqlDatabase db(database_->Connect());
+  QSqlQuery q(db);
+  ASSERT_TRUE(q.exec(
+      "CREATE VIRTUAL TABLE test_fts USING fts5("
+      "  ftsartist, tokenize='unicode', prefix='2 3')"));
+  ASSERT_TRUE(q.exec("INSERT INTO test_fts (ROWID, ftsartist)"
+                     " VALUES (1, 'Röyksopp')"));
+
+  ASSERT_TRUE(q.exec("SELECT ROWID FROM test_fts"
+                     " WHERE test_fts MATCH 'ftsartist : \"RO\"*'"));
+  ASSERT_TRUE(q.next());
+  EXPECT_EQ(1, q.value(0).toInt());
+}
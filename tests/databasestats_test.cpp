@@ -0,0 +1,90 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <sqlite3.h>
+
+#include "core/databasestats.h"
+
+namespace {
+
+TEST(DatabaseStatsTest, NormalisesLiterals) {
+  EXPECT_EQ("SELECT a FROM songs WHERE b = ? AND c = ? AND d = ?",
+            DatabaseStats::NormaliseSql(
+                "SELECT a FROM songs\n  WHERE b = 'it''s' AND c = 1.5"
+                " AND d = :d"));
+  EXPECT_EQ("SELECT a FROM device_3_songs WHERE ROWID IN (?, ...)",
+            DatabaseStats::NormaliseSql(
+                "SELECT a FROM device_3_songs WHERE ROWID IN (1, 2, 30)"));
+}
+
+TEST(DatabaseStatsTest, SubsystemIsFirstTable) {
+  EXPECT_EQ("songs", DatabaseStats::Subsystem(
+                         "SELECT a FROM songs INNER JOIN songs_fts"));
+  EXPECT_EQ("jamendo.songs",
+            DatabaseStats::Subsystem("INSERT INTO jamendo.songs (a) VALUES ?"));
+  EXPECT_EQ("playlists",
+            DatabaseStats::Subsystem("update playlists SET name = ?"));
+  EXPECT_EQ("other", DatabaseStats::Subsystem("PRAGMA journal_mode"));
+}
+
+TEST(DatabaseStatsTest, RecordsHistogram) {
+  DatabaseStats stats(1000);
+  stats.RecordStatement("songs", "SELECT", 50000, 2);
+  stats.RecordStatement("songs", "SELECT", 2000000, 3);
+
+  DatabaseStats::Statement s = stats.statement("songs", "SELECT");
+  EXPECT_EQ(2, s.count_);
+  EXPECT_EQ(5, s.rows_);
+  EXPECT_EQ(2050000, s.total_nsec_);
+  EXPECT_EQ(2000000, s.max_nsec_);
+  ASSERT_EQ(DatabaseStats::kBucketCount, s.histogram_.count());
+  EXPECT_EQ(1, s.histogram_[0]);
+  EXPECT_EQ(1, s.histogram_[2]);
+
+  EXPECT_EQ(0, stats.statement("playlists", "SELECT").count_);
+  EXPECT_TRUE(stats.slow_queries().isEmpty());
+}
+
+TEST(DatabaseStatsTest, TracesConnection) {
+  sqlite3* connection = nullptr;
+  ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &connection));
+
+  // Everything is slower than 0 ms.
+  DatabaseStats stats(0);
+  stats.Attach(connection);
+
+  sqlite3_exec(connection,
+               "CREATE TABLE songs (title TEXT);"
+               "INSERT INTO songs VALUES ('a'), ('b'), ('c');"
+               "SELECT title FROM songs WHERE title != 'z';",
+               nullptr, nullptr, nullptr);
+  sqlite3_close(connection);
+
+  DatabaseStats::Statement s =
+      stats.statement("songs", "SELECT title FROM songs WHERE title != ?");
+  EXPECT_EQ(1, s.count_);
+  EXPECT_EQ(3, s.rows_);
+
+  QList<DatabaseStats::SlowQuery> slow = stats.slow_queries();
+  ASSERT_EQ(3, slow.count());
+  EXPECT_EQ("songs", slow[2].subsystem_);
+  EXPECT_EQ("SELECT title FROM songs WHERE title != 'z';", slow[2].sql_);
+}
+
+}  // namespace
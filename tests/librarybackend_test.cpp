@@ -35,9 +35,9 @@ namespace {
 class LibraryBackendTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
-    database_.reset(new MemoryDatabase);
+    database_.reset(new MemoryDatabase(nullptr));
     backend_.reset(new LibraryBackend);
-    backend_->Init(database_, Library::kSongsTable,
+    backend_->Init(database_.get(), Library::kSongsTable,
                    Library::kDirsTable, Library::kSubdirsTable,
                    Library::kFtsTable);
   }
@@ -53,7 +53,7 @@ class LibraryBackendTest : public ::testing::Test {
     return ret;
   }
 
-  std::shared_ptr<Database> database_;
+  std::unique_ptr<Database> database_;
   std::unique_ptr<LibraryBackend> backend_;
 };
 
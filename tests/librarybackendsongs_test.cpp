@@ -0,0 +1,157 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QSignalSpy>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "devices/devicedatabasebackend.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/libraryquery.h"
+
+namespace {
+
+class LibraryBackendSongsTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+
+    // This will get ID 1.
+    backend_->AddDirectory("/tmp");
+  }
+
+  static Song MakeSong(int directory_id, const QString& filename) {
+    Song ret;
+    ret.set_directory_id(directory_id);
+    ret.set_url(QUrl::fromLocalFile(filename));
+    ret.set_mtime(1);
+    ret.set_ctime(1);
+    ret.set_filesize(1);
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(LibraryBackendSongsTest, AddSongsInBulk) {
+  // Enough songs to take the multi-row INSERT path, and more than fit in one
+  // statement.
+  SongList songs;
+  for (int i = 0; i < 250; ++i) {
+    Song song = MakeSong(1, QString("song%1.mp3").arg(i));
+    song.set_title(QString("Title %1").arg(i));
+    song.set_artist("Artist");
+    songs << song;
+  }
+  // This one's directory doesn't exist, so it should be dropped.
+  songs << MakeSong(2, "foo.mp3");
+
+  QSignalSpy spy(backend_.get(), SIGNAL(SongsDiscovered(SongList)));
+  backend_->AddOrUpdateSongs(songs);
+
+  ASSERT_EQ(1, spy.count());
+  SongList added = spy[0][0].value<SongList>();
+  ASSERT_EQ(250, added.count());
+
+  Song last = backend_->GetSongById(added.last().id());
+  EXPECT_EQ("Title 249", last.title());
+
+  // The FTS index should have caught up too.
+  QueryOptions opt;
+  opt.set_filter("Title 249");
+  LibraryQuery query(opt);
+  query.SetColumnSpec("%songs_table.ROWID");
+  ASSERT_TRUE(backend_->ExecQuery(&query));
+  ASSERT_TRUE(query.Next());
+  EXPECT_EQ(added.last().id(), query.Value(0).toInt());
+}
+
+TEST_F(LibraryBackendSongsTest, GetSongsById) {
+  Song song = MakeSong(1, "foo.mp3");
+  song.set_title(QString::fromUtf8("T\xc3\xaftle"));
+  song.set_artist("Artist");
+  song.set_album("Album");
+  song.set_track(3);
+  song.set_length_nanosec(123456789);
+  backend_->AddOrUpdateSongs(SongList() << song);
+
+  // GetSongsById reads straight from the statement, GetSongById goes through
+  // a SqlRow.  Both should end up with the same song.
+  SongList songs = backend_->GetSongsById(QList<int>() << 1);
+  ASSERT_EQ(1, songs.size());
+  Song expected = backend_->GetSongById(1);
+
+  EXPECT_EQ(1, songs[0].id());
+  EXPECT_EQ(song.title(), songs[0].title());
+  EXPECT_EQ(expected.url(), songs[0].url());
+  EXPECT_EQ(3, songs[0].track());
+  EXPECT_EQ(123456789, songs[0].length_nanosec());
+
+  // Fields that were never set.
+  EXPECT_EQ(expected.composer(), songs[0].composer());
+  EXPECT_EQ(-1, songs[0].disc());
+  EXPECT_EQ(expected.year(), songs[0].year());
+}
+
+TEST_F(LibraryBackendSongsTest, MoveDeletedDeviceSong) {
+  // Device backends really delete songs that disappear, so the old row can be
+  // gone by the time the move is committed.
+  DeviceDatabaseBackend devices;
+  devices.Init(database_.get());
+  const int device_id = devices.AddDevice(DeviceDatabaseBackend::Device());
+  ASSERT_NE(-1, device_id);
+
+  LibraryBackend backend;
+  backend.Init(database_.get(), QString("device_%1_songs").arg(device_id),
+               QString("device_%1_directories").arg(device_id),
+               QString("device_%1_subdirectories").arg(device_id),
+               QString("device_%1_fts").arg(device_id));
+  backend.AddDirectory("/media/device");
+
+  Song song = MakeSong(1, "/media/device/old.mp3");
+  song.set_title("Title");
+  song.set_playcount(3);
+  backend.AddOrUpdateSongs(SongList() << song);
+  song = backend.GetSongsByUrl(QUrl::fromLocalFile("/media/device/old.mp3"))
+             .first();
+  backend.DeleteSongs(SongList() << song);
+
+  song.set_url(QUrl::fromLocalFile("/media/device/new.mp3"));
+  song.set_basefilename("new.mp3");
+  backend.MoveSongs(SongList() << song);
+
+  SongList moved =
+      backend.GetSongsByUrl(QUrl::fromLocalFile("/media/device/new.mp3"));
+  ASSERT_EQ(1, moved.count());
+  EXPECT_EQ("Title", moved[0].title());
+  EXPECT_EQ(3, moved[0].playcount());
+  EXPECT_TRUE(
+      backend.GetSongsByUrl(QUrl::fromLocalFile("/media/device/old.mp3"))
+          .isEmpty());
+}
+
+}  // namespace
@@ -0,0 +1,122 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QtAlgorithms>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/libraryindex.h"
+#include "library/libraryquery.h"
+
+namespace {
+
+class LibraryIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+
+    // This will get ID 1.
+    backend_->AddDirectory("/tmp");
+  }
+
+  static Song MakeSong(const QString& filename) {
+    Song ret;
+    ret.set_directory_id(1);
+    ret.set_url(QUrl::fromLocalFile(filename));
+    ret.set_mtime(1);
+    ret.set_ctime(1);
+    ret.set_filesize(1);
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(LibraryIndexTest, AnswersDistinctQueries) {
+  const QString sigur_ros = QString::fromUtf8("Sigur R\xc3\xb3s");
+  SongList songs;
+  for (int i = 0; i < 4; ++i) {
+    Song song = MakeSong(QString("song%1.mp3").arg(i));
+    song.set_title(QString("Title %1").arg(i));
+    song.set_artist(i < 2 ? sigur_ros : "Beatles");
+    song.set_album(i % 2 ? "Album" : "");
+    songs << song;
+  }
+  backend_->AddOrUpdateSongs(songs);
+
+  backend_->EnableIndex(true);
+  ASSERT_TRUE(backend_->index()->is_loaded());
+  EXPECT_EQ(4, backend_->index()->song_count());
+
+  QStringList artists = backend_->GetAllArtists();
+  qSort(artists);
+  EXPECT_EQ(QStringList() << "Beatles" << sigur_ros, artists);
+  EXPECT_EQ(2, backend_->GetAllArtistsWithAlbums().count());
+
+  // Words match the start of a word anywhere, without the accents.
+  QueryOptions opt;
+  opt.set_filter("ros 3");
+  EXPECT_EQ(QStringList(), backend_->GetAllArtists(opt));
+  opt.set_filter("artist:ros 1");
+  EXPECT_EQ(QStringList() << sigur_ros, backend_->GetAllArtists(opt));
+
+  opt.set_query_mode(QueryOptions::QueryMode_Untagged);
+  EXPECT_EQ(2, backend_->GetAll("title", opt).count());
+
+  // The index follows songs being added and removed.
+  Song song = MakeSong("song4.mp3");
+  song.set_artist("Abba");
+  backend_->AddOrUpdateSongs(SongList() << song);
+  EXPECT_EQ(3, backend_->GetAllArtists().count());
+
+  backend_->DeleteSongs(backend_->GetSongsByUrl(songs[2].url()) +
+                        backend_->GetSongsByUrl(songs[3].url()));
+  EXPECT_EQ(2, backend_->GetAllArtists().count());
+  EXPECT_EQ(3, backend_->index()->song_count());
+}
+
+TEST(QueryOptionsTest, MatchesLikeFts) {
+  Song song;
+  song.Init(QString::fromUtf8("Hopp\xc3\xadpolla"),
+            QString::fromUtf8("Sigur R\xc3\xb3s"), "Takk...", 123);
+
+  QueryOptions opt;
+  opt.set_filter("ros hopp");
+  EXPECT_TRUE(opt.Matches(song));
+  opt.set_filter("title:hopp");
+  EXPECT_TRUE(opt.Matches(song));
+  opt.set_filter("artist:hopp");
+  EXPECT_FALSE(opt.Matches(song));
+  opt.set_filter("igur");
+  EXPECT_FALSE(opt.Matches(song));
+
+  opt.set_query_mode(QueryOptions::QueryMode_Untagged);
+  EXPECT_FALSE(opt.Matches(song));
+}
+
+}  // namespace
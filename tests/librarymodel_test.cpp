@@ -35,9 +35,9 @@ namespace {
 class LibraryModelTest : public ::testing::Test {
  protected:
   void SetUp() {
-    database_.reset(new MemoryDatabase);
+    database_.reset(new MemoryDatabase(nullptr));
     backend_.reset(new LibraryBackend);
-    backend_->Init(database_, Library::kSongsTable,
+    backend_->Init(database_.get(), Library::kSongsTable,
                    Library::kDirsTable, Library::kSubdirsTable, Library::kFtsTable);
     model_.reset(new LibraryModel(backend_.get(), nullptr));
 
@@ -72,7 +72,7 @@ class LibraryModelTest : public ::testing::Test {
     return AddSong(song);
   }
 
-  std::shared_ptr<Database> database_;
+  std::unique_ptr<Database> database_;
   std::unique_ptr<LibraryBackend> backend_;
   std::unique_ptr<LibraryModel> model_;
   std::unique_ptr<QSortFilterProxyModel> model_sorted_;
@@ -0,0 +1,205 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QSignalSpy>
+#include <QSortFilterProxyModel>
+#include <QTime>
+
+#include "core/database.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/librarymodel.h"
+
+namespace {
+
+class LibraryModelUpdatesTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    model_.reset(new LibraryModel(backend_.get(), nullptr));
+
+    // This will get ID 1.
+    backend_->AddDirectory("/tmp");
+
+    model_sorted_.reset(new QSortFilterProxyModel);
+    model_sorted_->setSourceModel(model_.get());
+    model_sorted_->setSortRole(LibraryModel::Role_SortText);
+    model_sorted_->setDynamicSortFilter(true);
+    model_sorted_->sort(0);
+  }
+
+  static Song MakeSong(const QString& title, const QString& artist,
+                       const QString& album) {
+    Song song;
+    song.Init(title, artist, album, 123);
+    song.set_directory_id(1);
+    song.set_mtime(1);
+    song.set_ctime(1);
+    song.set_url(QUrl("file:///tmp/" + artist + "/" + title));
+    song.set_filesize(1);
+    return song;
+  }
+
+  void AddSong(const QString& title, const QString& artist,
+               const QString& album) {
+    backend_->AddOrUpdateSongs(SongList() << MakeSong(title, artist, album));
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  std::unique_ptr<LibraryModel> model_;
+  std::unique_ptr<QSortFilterProxyModel> model_sorted_;
+};
+
+TEST_F(LibraryModelUpdatesTest, SongsDiscoveredInsertsOncePerParent) {
+  qRegisterMetaType<QModelIndex>("QModelIndex");
+  AddSong("Title 1", "Artist", "Album");
+  model_->Init(false);
+
+  // The artist comes before its divider.
+  QModelIndex artist_index = model_->index(0, 0, QModelIndex());
+  model_->fetchMore(artist_index);
+  QModelIndex album_index = model_->index(0, 0, artist_index);
+  model_->fetchMore(album_index);
+  ASSERT_EQ(1, model_->rowCount(album_index));
+
+  QSignalSpy spy_insert(model_.get(),
+                        SIGNAL(rowsInserted(QModelIndex, int, int)));
+  QSignalSpy spy_reset(model_.get(), SIGNAL(modelReset()));
+
+  backend_->AddOrUpdateSongs(SongList()
+                             << MakeSong("Title 2", "Artist", "Album")
+                             << MakeSong("Title 3", "Artist", "Album")
+                             << MakeSong("Title", "Bob", "Album")
+                             << MakeSong("Title", "Bert", "Album"));
+
+  // One insert for the album's two songs, and one for the two artists and the
+  // "B" divider.
+  ASSERT_EQ(0, spy_reset.count());
+  ASSERT_EQ(2, spy_insert.count());
+  EXPECT_EQ(album_index, spy_insert[0][0].value<QModelIndex>());
+  EXPECT_EQ(1, spy_insert[0][1].toInt());
+  EXPECT_EQ(2, spy_insert[0][2].toInt());
+  EXPECT_EQ(QModelIndex(), spy_insert[1][0].value<QModelIndex>());
+  EXPECT_EQ(2, spy_insert[1][1].toInt());
+  EXPECT_EQ(4, spy_insert[1][2].toInt());
+
+  EXPECT_EQ(3, model_->rowCount(album_index));
+  EXPECT_EQ(5, model_sorted_->rowCount(QModelIndex()));
+}
+
+TEST_F(LibraryModelUpdatesTest, SongsDiscoveredFindsAlbumUnderRightArtist) {
+  AddSong("Title 1", "Artist 1", "Album");
+  AddSong("Title 2", "Artist 2", "Album");
+  model_->Init(false);
+
+  // Load both artists' albums.  Artist 1's divider is between them.
+  for (int row : QList<int>() << 0 << 2) {
+    QModelIndex artist_index = model_->index(row, 0, QModelIndex());
+    model_->fetchMore(artist_index);
+    model_->fetchMore(model_->index(0, 0, artist_index));
+  }
+
+  AddSong("Title 3", "Artist 2", "Album");
+
+  QModelIndex artist_index = model_->index(2, 0, QModelIndex());
+  ASSERT_EQ("Artist 2", artist_index.data().toString());
+  QModelIndex album_index = model_->index(0, 0, artist_index);
+  EXPECT_EQ(2, model_->rowCount(album_index));
+
+  artist_index = model_->index(0, 0, QModelIndex());
+  ASSERT_EQ("Artist 1", artist_index.data().toString());
+  album_index = model_->index(0, 0, artist_index);
+  EXPECT_EQ(1, model_->rowCount(album_index));
+}
+
+TEST_F(LibraryModelUpdatesTest, LazyPopulateOnWorkerThread) {
+  AddSong("Title", "Artist", "Album");
+  model_->Init(false);
+  model_->set_lazy_populate_wait_msec(0);
+
+  QModelIndex artist_index = model_->index(0, 0, QModelIndex());
+  model_->fetchMore(artist_index);
+
+  // Either the album or a placeholder is there straight away, and the
+  // placeholder is replaced when the query finishes.
+  ASSERT_EQ(1, model_->rowCount(artist_index));
+  QTime timeout;
+  timeout.start();
+  while (model_->index(0, 0, artist_index).data().toString() != "Album" &&
+         timeout.elapsed() < 5000) {
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+  }
+
+  ASSERT_EQ(1, model_->rowCount(artist_index));
+  EXPECT_EQ("Album", model_->index(0, 0, artist_index).data().toString());
+}
+
+TEST_F(LibraryModelUpdatesTest, RefiningFilterDoesntQuery) {
+  AddSong("Karma Police", "Radiohead", "OK Computer");
+  AddSong("Paranoid Android", "Radiohead", "OK Computer");
+  AddSong("Rain", "Beatles", "Revolver");
+  AddSong("Uprising", "Muse", "The Resistance");
+  model_->Init(false);
+  ASSERT_EQ(6, model_->rowCount(QModelIndex()));
+
+  // Radiohead and Beatles, each with a divider.
+  model_->SetFilterText("ra");
+  QTime timeout;
+  timeout.start();
+  while (model_->rowCount(QModelIndex()) != 4 && timeout.elapsed() < 5000) {
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+  }
+  ASSERT_EQ(4, model_->rowCount(QModelIndex()));
+
+  // Typing more of a word is filtered straight away.
+  model_->SetFilterText("radio");
+  ASSERT_EQ(2, model_sorted_->rowCount(QModelIndex()));
+  EXPECT_EQ("Radiohead",
+            model_sorted_->index(1, 0, QModelIndex()).data().toString());
+
+  // Songs added in the meantime are still found, and so is another word.
+  AddSong("Radio Song", "Muse", "Showbiz");
+  model_->SetFilterText("radio s");
+  ASSERT_EQ(2, model_sorted_->rowCount(QModelIndex()));
+  EXPECT_EQ("Muse",
+            model_sorted_->index(1, 0, QModelIndex()).data().toString());
+
+  // A different word needs a new query.
+  model_->SetFilterText("rain");
+  EXPECT_EQ("Muse",
+            model_sorted_->index(1, 0, QModelIndex()).data().toString());
+  timeout.start();
+  while (model_sorted_->index(1, 0, QModelIndex()).data().toString() !=
+             "Beatles" &&
+         timeout.elapsed() < 5000) {
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+  }
+  EXPECT_EQ("Beatles",
+            model_sorted_->index(1, 0, QModelIndex()).data().toString());
+}
+
+}  // namespace
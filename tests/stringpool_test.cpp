@@ -0,0 +1,95 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include "core/song.h"
+#include "core/stringpool.h"
+#include "tagreadermessages.pb.h"
+
+namespace {
+
+TEST(StringPoolTest, SharesEqualStrings) {
+  const QString a = StringPool::Intern(QString("Some Artist"));
+  const QString b = StringPool::Intern(QString("Some ") + "Artist");
+  EXPECT_EQ("Some Artist", b);
+  EXPECT_EQ(a.constData(), b.constData());
+
+  const std::string utf8("Some Artist");
+  const QString c = StringPool::Intern(utf8);
+  EXPECT_EQ(a.constData(), c.constData());
+}
+
+TEST(StringPoolTest, DropsUnusedStrings) {
+  const QString kept = StringPool::Intern(QString("Kept Artist"));
+
+  for (int i = 0; i < 10000; ++i) {
+    StringPool::Intern(QString("Unused Artist %1").arg(i));
+  }
+  EXPECT_LT(StringPool::size(), 5000);
+
+  const QString again = StringPool::Intern(QString("Kept ") + "Artist");
+  EXPECT_EQ(kept.constData(), again.constData());
+}
+
+TEST(StringPoolTest, InternsUtf16) {
+  const QString a = StringPool::Intern(QString("Utf16 Artist"));
+  const QString b("Utf16 Artist");
+  const QString c = StringPool::Intern(b.constData(), b.size());
+  EXPECT_EQ(a.constData(), c.constData());
+}
+
+TEST(StringPoolTest, KeepsNullAndEmptyStrings) {
+  EXPECT_TRUE(StringPool::Intern(QString()).isNull());
+  EXPECT_TRUE(StringPool::Intern(QString("")).isEmpty());
+  EXPECT_TRUE(StringPool::Intern(std::string()).isEmpty());
+}
+
+TEST(StringPoolTest, DecodesUtf8) {
+  const QString str = StringPool::Intern(std::string("Bj\xc3\xb6rk"));
+  EXPECT_EQ(QString::fromUtf8("Bj\xc3\xb6rk"), str);
+}
+
+TEST(StringPoolTest, SongsShareFields) {
+  pb::tagreader::SongMetadata pb;
+  pb.set_valid(true);
+  pb.set_artist("Pooled Artist");
+  pb.set_album("Pooled Album");
+
+  Song one;
+  one.InitFromProtobuf(pb);
+  pb.set_title("Another title");
+  Song two;
+  two.InitFromProtobuf(pb);
+
+  EXPECT_EQ(one.artist().constData(), two.artist().constData());
+  EXPECT_EQ(one.album().constData(), two.album().constData());
+}
+
+TEST(StringPoolTest, DoesntPoolPaths) {
+  pb::tagreader::SongMetadata pb;
+  pb.set_valid(true);
+  pb.set_art_automatic("/music/Some Artist/Some Album/cover.jpg");
+
+  const int size = StringPool::size();
+  Song song;
+  song.InitFromProtobuf(pb);
+  EXPECT_EQ("/music/Some Artist/Some Album/cover.jpg", song.art_automatic());
+  EXPECT_EQ(size, StringPool::size());
+}
+
+}  // namespace
@@ -0,0 +1,117 @@
+/* This file is part of Clementine.
+   Copyright 2026, agent <agent@local>
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <functional>
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QThreadPool>
+
+#include "core/concurrentrun.h"
+#include "core/workstealingqueue.h"
+
+TEST(WorkStealingQueueTest, PopsOwnTasksLastInFirstOut) {
+  WorkStealingQueue<int> queue(1);
+  queue.Push(1);
+  queue.Push(2);
+  queue.Push(3);
+
+  int task = 0;
+  ASSERT_TRUE(queue.Pop(&task));
+  EXPECT_EQ(3, task);
+  queue.TaskDone();
+
+  ASSERT_TRUE(queue.Pop(&task));
+  EXPECT_EQ(2, task);
+  queue.TaskDone();
+
+  ASSERT_TRUE(queue.Pop(&task));
+  EXPECT_EQ(1, task);
+  queue.TaskDone();
+
+  EXPECT_FALSE(queue.Pop(&task));
+}
+
+TEST(WorkStealingQueueTest, StealsFromOtherDeques) {
+  // The first push goes to deque 0 and the second to deque 1.  This thread
+  // owns deque 0, so it should steal the second task once its own is done.
+  WorkStealingQueue<int> queue(2);
+  queue.Push(1);
+  queue.Push(2);
+
+  int task = 0;
+  ASSERT_TRUE(queue.Pop(&task));
+  EXPECT_EQ(1, task);
+  queue.TaskDone();
+
+  ASSERT_TRUE(queue.Pop(&task));
+  EXPECT_EQ(2, task);
+  queue.TaskDone();
+
+  EXPECT_FALSE(queue.Pop(&task));
+}
+
+TEST(WorkStealingQueueTest, AbortStopsPopping) {
+  WorkStealingQueue<int> queue(1);
+  queue.Push(1);
+  queue.Abort();
+
+  int task = 0;
+  EXPECT_FALSE(queue.Pop(&task));
+}
+
+namespace {
+
+// Each task with a value > 0 pushes two more tasks with value - 1, so a task
+// with value n creates 2^(n+1) - 1 tasks in total.
+void RunTree(WorkStealingQueue<int>* queue, QAtomicInt* count) {
+  int task = 0;
+  while (queue->Pop(&task)) {
+    count->fetchAndAddOrdered(1);
+    if (task > 0) {
+      queue->Push(task - 1);
+      queue->Push(task - 1);
+    }
+    queue->TaskDone();
+  }
+}
+
+}  // namespace
+
+TEST(WorkStealingQueueTest, TasksCanPushMoreTasks) {
+  const int kThreads = 4;
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(kThreads);
+
+  WorkStealingQueue<int> queue(kThreads);
+  queue.Push(10);
+
+  QAtomicInt count(0);
+  QList<QFuture<void>> futures;
+  for (int i = 0; i < kThreads; ++i) {
+    futures << ConcurrentRun::Run<void>(&pool,
+                                        std::bind(&RunTree, &queue, &count));
+  }
+  for (QFuture<void> future : futures) {
+    future.waitForFinished();
+  }
+
+  EXPECT_EQ(2047, int(count));
+}